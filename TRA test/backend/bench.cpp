@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "engine/scene.hpp"
+#include "engine/tra.hpp"
+#include "engine/view_factors.hpp"
+
+// Engine benchmarks: ./bench [MB]
+//   parse   JSON parse throughput on a synthetic payload of explicit receiver
+//           points (the frontend's heaviest format), best of several parses
+//   kernel  single-threaded rays/s of the view-factor kernel
+//   solve   end-to-end tra::solve on a seeded grid, cold and then cached
+// Build the bench_<arch> variants to compare instruction-set targets.
+
+static int runParseBenchmark(size_t targetMB) {
+	std::string payload;
+	payload.reserve(targetMB * 1024 * 1024 + 4096);
+	payload += "{\"receiver_planes\":{";
+	size_t plane = 0, points = 0;
+	std::mt19937_64 rng(1);
+	std::uniform_real_distribution<double> coord(-50.0, 50.0);
+	while (payload.size() < targetMB * 1024 * 1024) {
+		if (plane > 0) payload += ",";
+		payload += "\"plane" + std::to_string(plane++) + "\":{\"width\":100,\"height\":100,\"points\":[";
+		for (size_t k = 0; k < 10000; ++k, ++points) {
+			if (k > 0) payload += ",";
+			std::ostringstream pt;
+			pt << "{\"origin\":[" << coord(rng) << "," << coord(rng) << "," << coord(rng) << "],\"normal\":[0,0,1]}";
+			payload += pt.str();
+		}
+		payload += "]}";
+	}
+	payload += "},\"polygons\":[{\"polygon\":[[-2,0,0],[2,0,0],[2,4,0],[-2,4,0]],\"temperature\":84}],\"num_rays\":1000}";
+
+	double bestSeconds = std::numeric_limits<double>::infinity();
+	for (int run = 0; run < 5; ++run) {
+		JsonInput in;
+		std::string err;
+		auto start = std::chrono::steady_clock::now();
+		if (!parseInputJson(payload, in, err)) {
+			std::cerr << "Benchmark payload failed to parse: " << err << std::endl;
+			return 1;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		bestSeconds = std::min(bestSeconds, seconds);
+	}
+	double mb = static_cast<double>(payload.size()) / (1024.0 * 1024.0);
+	std::cout << "parse:  " << std::fixed << std::setprecision(1) << mb << " MB (" << points << " receiver points) in "
+	          << std::setprecision(3) << bestSeconds * 1000.0 << " ms: " << std::setprecision(1) << mb / bestSeconds << " MB/s" << std::endl;
+	return 0;
+}
+
+// A receiver facing a row of emitters with blockers in between
+static void benchScene(std::vector<PolygonWithTemp>& emitters, std::vector<std::vector<Vec3>>& blockers) {
+	for (int k = 0; k < 8; ++k) {
+		double x = -4.0 + k;
+		emitters.push_back({{{x, 0, 2}, {x + 0.8, 0, 2}, {x + 0.8, 2, 2}, {x, 2, 2}}, 50.0 + k, nullptr});
+		blockers.push_back({{x, 0.5, 1}, {x + 0.4, 0.5, 1}, {x + 0.4, 1.5, 1}, {x, 1.5, 1}});
+	}
+}
+
+static void runKernelBenchmark() {
+	std::vector<PolygonWithTemp> emitters;
+	std::vector<std::vector<Vec3>> blockers;
+	benchScene(emitters, blockers);
+	const size_t rays = 200000;
+	double bestSeconds = std::numeric_limits<double>::infinity();
+	for (int run = 0; run < 5; ++run) {
+		std::mt19937_64 rng(1);
+		auto start = std::chrono::steady_clock::now();
+		calculateViewFactorsWithBlockage({0, 1, 0}, {0, 0, 1}, emitters, blockers, rays, rng);
+		bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	const double tests = static_cast<double>(rays * (emitters.size() + blockers.size()));
+	std::cout << "kernel: " << std::fixed << std::setprecision(2) << static_cast<double>(rays) / bestSeconds * 1e-6 << " Mrays/s, "
+	          << tests / static_cast<double>(rays) << " polygons per ray, " << bestSeconds * 1e9 / tests << " ns per test" << std::endl;
+}
+
+static int runSolveBenchmark() {
+	std::vector<PolygonWithTemp> emitters;
+	std::vector<std::vector<Vec3>> blockers;
+	benchScene(emitters, blockers);
+	tra::Scene scene;
+	for (const auto& e : emitters) scene.addEmitter(e.vertices, e.temperature);
+	for (const auto& b : blockers) scene.addBlocker(b);
+	scene.addReceiverGrid("bench", 32, 32, {-4, -1, 0}, {8, 0, 0}, {0, 4, 0}, {0, 0, 1});
+	scene.setRays(4000);
+	scene.setSeed(1);
+
+	auto start = std::chrono::steady_clock::now();
+	tra::Results cold = tra::solve(scene);
+	double coldSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+	tra::Results cached = tra::solve(scene);
+	double cachedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double rays = static_cast<double>(scene.numPoints() * scene.numRays());
+	std::cout << "solve:  " << scene.numPoints() << " points x " << scene.numRays() << " rays in " << std::fixed << std::setprecision(1)
+	          << coldSeconds * 1000.0 << " ms (" << std::setprecision(2) << rays / coldSeconds * 1e-6 << " Mrays/s), cached "
+	          << std::setprecision(3) << cachedSeconds * 1000.0 << " ms" << std::endl;
+	if (cold.planes.empty() || cold.planes[0].values != cached.planes[0].values) {
+		std::cerr << "Cached solve differs from the cold one" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	size_t mb = argc >= 2 ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 50;
+	if (int rc = runParseBenchmark(mb > 0 ? mb : 50)) return rc;
+	runKernelBenchmark();
+	return runSolveBenchmark();
+}
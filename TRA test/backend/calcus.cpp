@@ -1,868 +1,421 @@
-#include <algorithm>
-#include <array>
-#include <cmath>
-#include <cstdint>
-#include <iomanip>
-#include <iostream>
-#include <limits>
-#include <numeric>
-#include <optional>
-#include <random>
-#include <string>
-#include <tuple>
-#include <utility>
-#include <vector>
-#include <fstream>
-#include <sstream>
-#include <cstdlib>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-// Simple 3D vector struct with basic operations
-struct Vec3 {
-    double x;
-    double y;
-    double z;
-
-    Vec3() : x(0.0), y(0.0), z(0.0) {}
-    Vec3(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
-
-    Vec3 operator+(const Vec3& other) const { return {x + other.x, y + other.y, z + other.z}; }
-    Vec3 operator-(const Vec3& other) const { return {x - other.x, y - other.y, z - other.z}; }
-    Vec3 operator*(double s) const { return {x * s, y * s, z * s}; }
-    Vec3 operator/(double s) const { return {x / s, y / s, z / s}; }
-
-    Vec3& operator+=(const Vec3& other) { x += other.x; y += other.y; z += other.z; return *this; }
-    Vec3& operator-=(const Vec3& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
-    Vec3& operator*=(double s) { x *= s; y *= s; z *= s; return *this; }
-    Vec3& operator/=(double s) { x /= s; y /= s; z /= s; return *this; }
-};
-
-static inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-static inline Vec3 cross(const Vec3& a, const Vec3& b) {
-    return {
-        a.y * b.z - a.z * b.y,
-        a.z * b.x - a.x * b.z,
-        a.x * b.y - a.y * b.x
-    };
-}
-static inline double length(const Vec3& v) { return std::sqrt(dot(v, v)); }
-static inline Vec3 normalize(const Vec3& v) {
-    double len = length(v);
-    if (len <= 1e-12) return {0.0, 0.0, 0.0};
-    return v / len;
-}
-
-struct Plane {
-    Vec3 normal;
-    Vec3 point; // any point on plane
-};
-
-struct PolygonWithTemp {
-	std::vector<Vec3> vertices;
-	double temperature;
-};
-
-struct ReceiverPoint {
-	Vec3 origin;
-	Vec3 normal;
-};
-
-// Compute plane from polygon vertices (assumes first 3 non-collinear define plane)
-inline std::optional<Plane> getPolygonPlane(const std::vector<Vec3>& verts) {
-    if (verts.size() < 3) return std::nullopt;
-    Vec3 v1 = verts[1] - verts[0];
-    Vec3 v2 = verts[2] - verts[0];
-    Vec3 n = cross(v1, v2);
-    double nmag = length(n);
-    if (nmag < 1e-9) return std::nullopt;
-    n = n / nmag;
-    return Plane{n, verts[0]};
-}
-
-// Ray-plane intersection: returns intersection point and t, or nullopt/inf if no forward hit
-inline std::pair<std::optional<Vec3>, double> rayPlaneIntersect(
-    const Vec3& rayOrigin,
-    const Vec3& rayDir,
-    const Vec3& planeNormal,
-    const Vec3& pointOnPlane
-) {
-    double ndotu = dot(planeNormal, rayDir);
-    if (std::fabs(ndotu) < 1e-9) {
-        return {std::nullopt, std::numeric_limits<double>::infinity()};
-    }
-    Vec3 w = rayOrigin - pointOnPlane;
-    double t = -dot(planeNormal, w) / ndotu;
-    if (t < 1e-7) {
-        return {std::nullopt, std::numeric_limits<double>::infinity()};
-    }
-    Vec3 p = rayOrigin + rayDir * t;
-    return {p, t};
-}
-
-// Project 3D polygon and point onto the dominant plane and do 2D point-in-polygon test (winding/non-zero)
-static bool isPointInPolygon2D(const std::vector<std::array<double,2>>& poly, double x, double y) {
-    // Ray casting even-odd rule
-    bool inside = false;
-    size_t n = poly.size();
-    for (size_t i = 0, j = n - 1; i < n; j = i++) {
-        const auto& pi = poly[i];
-        const auto& pj = poly[j];
-        bool intersect = ((pi[1] > y) != (pj[1] > y)) &&
-                         (x < (pj[0] - pi[0]) * (y - pi[1]) / ((pj[1] - pi[1]) + 1e-30) + pi[0]);
-        if (intersect) inside = !inside;
-    }
-    return inside;
-}
-
-inline bool isPointInPolygon3D(const Vec3& p, const std::vector<Vec3>& polygon, const Vec3& polygonNormal) {
-    Vec3 absn { std::fabs(polygonNormal.x), std::fabs(polygonNormal.y), std::fabs(polygonNormal.z) };
-    int a = 0, b = 1; // indices to keep
-    if (absn.x >= absn.y && absn.x >= absn.z) { a = 1; b = 2; }
-    else if (absn.y >= absn.x && absn.y >= absn.z) { a = 0; b = 2; }
-    else { a = 0; b = 1; }
-
-    std::vector<std::array<double,2>> poly2d;
-    poly2d.reserve(polygon.size());
-    for (const auto& v : polygon) {
-        double coords[3] = {v.x, v.y, v.z};
-        poly2d.push_back({coords[a], coords[b]});
-    }
-    double pc[3] = {p.x, p.y, p.z};
-    return isPointInPolygon2D(poly2d, pc[a], pc[b]);
-}
-
-// Generate cosine-weighted hemisphere directions around a given normal (using provided RNG)
-std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng) {
-    std::vector<Vec3> rays;
-    if (numRays == 0) return rays;
-    rays.reserve(numRays);
-
-    Vec3 w = normalize(surfaceNormal);
-    Vec3 u;
-    if (std::fabs(w.x) > 0.9999) {
-        u = normalize(cross({0.0, 1.0, 0.0}, w));
-    } else {
-        u = normalize(cross({1.0, 0.0, 0.0}, w));
-    }
-	Vec3 v = cross(w, u);
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
-
-    for (size_t i = 0; i < numRays; ++i) {
-        double u1 = dist(rng);
-        double u2 = dist(rng);
-        double phi = 2.0 * M_PI * u1;
-        double cosTheta = std::sqrt(1.0 - u2);
-        double sinTheta = std::sqrt(u2);
-        double x = sinTheta * std::cos(phi);
-        double y = sinTheta * std::sin(phi);
-        double z = cosTheta;
-        Vec3 local {x, y, z};
-        // rotate to world
-        Vec3 world {
-            u.x * local.x + v.x * local.y + w.x * local.z,
-            u.y * local.x + v.y * local.y + w.y * local.z,
-            u.z * local.x + v.z * local.y + w.z * local.z
-        };
-        rays.push_back(world);
-    }
-    return rays;
-}
-
-// Convenience overload: non-deterministic RNG per call
-std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal) {
-	std::random_device rd;
-	std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
-	std::mt19937_64 rng(seedSeq);
-	return generateCosineHemisphereRays(numRays, surfaceNormal, rng);
-}
-
-// Calculate view factors from a point origin to a set of polygon emitters with occlusion between them
-struct ViewFactorResult {
-    std::vector<double> viewFactors; // per polygon
-    std::vector<Vec3> allRayDirs;
-    std::vector<Vec3> hitPoints;
-    std::vector<Vec3> hitRayDirs; // those rays that hit some polygon
-};
-
-ViewFactorResult calculateViewFactorsWithBlockageLegacy(
-    const Vec3& origin,
-    const Vec3& originNormal,
-    const std::vector<std::vector<Vec3>>& emitterPolygons,
-    const std::vector<std::vector<Vec3>>& inertPolygons,
-    size_t numRays
-) {
-    ViewFactorResult res;
-    res.viewFactors.assign(emitterPolygons.size(), 0.0);
-    if (numRays == 0) return res;
-
-    std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, originNormal);
-    res.allRayDirs = rays;
-
-    struct PolyData { std::vector<Vec3> verts; Vec3 normal; Vec3 point; bool valid; };
-    std::vector<PolyData> inertScene;
-    inertScene.reserve(inertPolygons.size());
-    for (const auto& poly : inertPolygons) {
-        auto pl = getPolygonPlane(poly);
-        if (!pl) inertScene.push_back({poly, {0,0,0}, {0,0,0}, false});
-        else inertScene.push_back({poly, pl->normal, pl->point, true});
-    }
-
-    std::vector<PolyData> emitScene;
-    emitScene.reserve(emitterPolygons.size());
-    for (const auto& poly : emitterPolygons) {
-        auto pl = getPolygonPlane(poly);
-        if (!pl) emitScene.push_back({poly, {0,0,0}, {0,0,0}, false});
-        else emitScene.push_back({poly, pl->normal, pl->point, true});
-    }
-
-    std::vector<std::size_t> hitCounts(emitterPolygons.size(), 0);
-
-    for (size_t i = 0; i < numRays; ++i) {
-        const Vec3& rdir = rays[i];
-        double closestInert = std::numeric_limits<double>::infinity();
-        double closestEmit = std::numeric_limits<double>::infinity();
-        int finalIdx = -1;
-        Vec3 closestPoint;
-
-        // Check inert polygons first (find closest inert hit)
-        for (size_t p = 0; p < inertScene.size(); ++p) {
-            const auto& pd = inertScene[p];
-            if (!pd.valid) continue;
-            auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-            if (hit) {
-                if (t < closestInert) {
-                    if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-                        closestInert = t;
-                    }
-                }
-            }
-        }
-
-        // Then check emitter polygons (find closest emitter hit)
-        for (size_t p = 0; p < emitScene.size(); ++p) {
-            const auto& pd = emitScene[p];
-            if (!pd.valid) continue;
-            auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-            if (hit) {
-                if (t < closestEmit) {
-                    if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-                        closestEmit = t;
-                        finalIdx = static_cast<int>(p);
-                        closestPoint = *hit;
-                    }
-                }
-            }
-        }
-
-        bool blockedByInert = (closestInert < std::numeric_limits<double>::infinity()) && (closestInert <= closestEmit);
-        if (!blockedByInert && finalIdx != -1) {
-            hitCounts[static_cast<size_t>(finalIdx)] += 1;
-            res.hitPoints.push_back(closestPoint);
-            res.hitRayDirs.push_back(rdir);
-        }
-    }
-
-    for (size_t p = 0; p < emitterPolygons.size(); ++p) {
-        res.viewFactors[p] = static_cast<double>(hitCounts[p]) / static_cast<double>(numRays);
-    }
-    return res;
-}
-
-// Overload that accepts external RNG for reproducible runs and JSON-driven seed
-
-ViewFactorResult calculateViewFactorsWithBlockage(
-	const Vec3& origin,
-	const Vec3& originNormal,
-	const std::vector<PolygonWithTemp>& emitterPolygons,
-	const std::vector<std::vector<Vec3>>& inertPolygons,
-	size_t numRays,
-	std::mt19937_64& rng
-) {
-	ViewFactorResult res;
-	res.viewFactors.assign(emitterPolygons.size(), 0.0);
-	if (numRays == 0) return res;
-
-	std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, originNormal, rng);
-	res.allRayDirs = rays;
-
-	struct PolyData { std::vector<Vec3> verts; Vec3 normal; Vec3 point; bool valid; };
-	std::vector<PolyData> inertScene;
-	inertScene.reserve(inertPolygons.size());
-	for (const auto& poly : inertPolygons) {
-		auto pl = getPolygonPlane(poly);
-		if (!pl) inertScene.push_back({poly, {0,0,0}, {0,0,0}, false});
-		else inertScene.push_back({poly, pl->normal, pl->point, true});
-	}
-
-	std::vector<PolyData> emitScene;
-	emitScene.reserve(emitterPolygons.size());
-	for (const auto& poly : emitterPolygons) {
-		auto pl = getPolygonPlane(poly.vertices);
-		if (!pl) emitScene.push_back({poly.vertices, {0,0,0}, {0,0,0}, false});
-		else emitScene.push_back({poly.vertices, pl->normal, pl->point, true});
-	}
-
-	std::vector<std::size_t> hitCounts(emitterPolygons.size(), 0);
-
-	for (size_t i = 0; i < numRays; ++i) {
-		const Vec3& rdir = rays[i];
-		double closestInert = std::numeric_limits<double>::infinity();
-		double closestEmit = std::numeric_limits<double>::infinity();
-		int finalIdx = -1;
-		Vec3 closestPoint;
-
-		// Check inert polygons first (find closest inert hit)
-		for (size_t p = 0; p < inertScene.size(); ++p) {
-			const auto& pd = inertScene[p];
-			if (!pd.valid) continue;
-			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-			if (hit) {
-				if (t < closestInert) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-						closestInert = t;
-					}
-				}
-			}
-		}
-
-		// Then check emitter polygons (find closest emitter hit)
-		for (size_t p = 0; p < emitScene.size(); ++p) {
-			const auto& pd = emitScene[p];
-			if (!pd.valid) continue;
-			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-			if (hit) {
-				if (t < closestEmit) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-						closestEmit = t;
-						finalIdx = static_cast<int>(p);
-						closestPoint = *hit;
-					}
-				}
-			}
-		}
-
-		bool blockedByInert = (closestInert < std::numeric_limits<double>::infinity()) && (closestInert <= closestEmit);
-		if (!blockedByInert && finalIdx != -1) {
-			hitCounts[static_cast<size_t>(finalIdx)] += 1;
-			res.hitPoints.push_back(closestPoint);
-			res.hitRayDirs.push_back(rdir);
-		}
-	}
-
-	for (size_t p = 0; p < emitterPolygons.size(); ++p) {
-		res.viewFactors[p] = static_cast<double>(hitCounts[p]) / static_cast<double>(numRays);
-	}
-	return res;
-}
-
-// Minimal schema-specific JSON parser for our expected input
-// Expected input JSON:
-// {
-//   "receiver_points": [
-//     {
-//       "origin": [x,y,z],
-//       "normal": [nx,ny,nz]
-//     },
-//     ...
-//   ],
-//   "polygons": [
-//     {
-//       "polygon": [[x,y,z], ...],
-//       "temperature": 100.0
-//     },
-//     ...
-//   ],
-//   "inert_polygons": [ [[x,y,z], ...], ... ],        // optional blockers only
-//   "num_rays": 100000,          // optional (default 100000)
-//   "seed": 123456789            // optional (deterministic if provided)
-// }
-
-
-namespace mini_json {
-	inline void skipSpaces(const std::string& s, size_t& i) {
-		while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) ++i;
-	}
-	inline bool expectChar(const std::string& s, size_t& i, char c) {
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == c) { ++i; return true; }
-		return false;
-	}
-	inline bool parseNumber(const std::string& s, size_t& i, double& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		out = std::strtod(start, &endptr);
-		if (endptr == start) return false;
-		i += static_cast<size_t>(endptr - start);
-		return true;
-	}
-	inline bool parseUInt64(const std::string& s, size_t& i, std::uint64_t& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		unsigned long long v = std::strtoull(start, &endptr, 10);
-		if (endptr == start) return false;
-		out = static_cast<std::uint64_t>(v);
-		i += static_cast<size_t>(endptr - start);
-		return true;
-	}
-	inline bool parseKey(const std::string& s, size_t& i, const std::string& key) {
-		skipSpaces(s, i);
-		if (!expectChar(s, i, '"')) return false;
-		size_t k = i;
-		while (k < s.size() && s[k] != '"') ++k;
-		if (k >= s.size()) return false;
-		std::string found = s.substr(i, k - i);
-		i = k + 1;
-		skipSpaces(s, i);
-		if (!expectChar(s, i, ':')) return false;
-		return found == key;
-	}
-	inline bool parseVec3(const std::string& s, size_t& i, Vec3& v) {
-		if (!expectChar(s, i, '[')) return false;
-		double a, b, c;
-		if (!parseNumber(s, i, a)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, b)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, c)) return false;
-		if (!expectChar(s, i, ']')) return false;
-		v = Vec3{a, b, c};
-		return true;
-	}
-	inline bool parsePolygons(const std::string& s, size_t& i, std::vector<std::vector<Vec3>>& polys) {
-		if (!expectChar(s, i, '[')) return false; // polygons array start
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		while (i < s.size()) {
-			if (!expectChar(s, i, '[')) return false; // one polygon start
-			std::vector<Vec3> poly;
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ']') { ++i; polys.push_back(std::move(poly)); }
-			else {
-				while (i < s.size()) {
-					Vec3 v;
-					if (!parseVec3(s, i, v)) return false;
-					poly.push_back(v);
-					skipSpaces(s, i);
-					if (i < s.size() && s[i] == ',') { ++i; continue; }
-					if (i < s.size() && s[i] == ']') { ++i; break; }
-					return false;
-				}
-				polys.push_back(std::move(poly));
-			}
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-	inline bool parseReceiverPoint(const std::string& s, size_t& i, ReceiverPoint& rp) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool haveOrigin = false, haveNormal = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "origin")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.origin = v; haveOrigin = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "normal")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.normal = v; haveNormal = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return haveOrigin && haveNormal;
-	}
-	inline bool parseReceiverPoints(const std::string& s, size_t& i, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			ReceiverPoint rp;
-			if (!parseReceiverPoint(s, i, rp)) return false;
-			points.push_back(rp);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-	
-	inline bool parseReceiverPlaneData(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "width")) {
-				double w;
-				if (!parseNumber(s, i, w)) return false;
-				width = w;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "height")) {
-				double h;
-				if (!parseNumber(s, i, h)) return false;
-				height = h;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "points")) {
-				if (!parseReceiverPoints(s, i, points)) return false;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		return true;
-	}
-	
-	inline bool parseReceiverPlanes(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			// Parse plane name as key
-			if (!expectChar(s, i, '"')) return false;
-			size_t nameStart = i;
-			while (i < s.size() && s[i] != '"') ++i;
-			if (i >= s.size()) return false;
-			planeName = s.substr(nameStart, i - nameStart);
-			++i; // skip closing quote
-			
-			skipSpaces(s, i);
-			if (!expectChar(s, i, ':')) return false;
-			
-			if (!parseReceiverPlaneData(s, i, planeName, width, height, points)) return false;
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		return true;
-	}
-	
-	inline bool parseSinglePolygon(const std::string& s, size_t& i, std::vector<Vec3>& vertices) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			Vec3 v;
-			if (!parseVec3(s, i, v)) return false;
-			vertices.push_back(v);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-	
-	inline bool parsePolygonWithTemp(const std::string& s, size_t& i, PolygonWithTemp& poly) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool havePolygon = false, haveTemperature = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "polygon")) {
-				if (!parseSinglePolygon(s, i, poly.vertices)) return false;
-				havePolygon = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "temperature")) {
-				double temp;
-				if (!parseNumber(s, i, temp)) return false;
-				poly.temperature = temp;
-				haveTemperature = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return havePolygon && haveTemperature;
-	}
-	
-	inline bool parsePolygonsWithTemp(const std::string& s, size_t& i, std::vector<PolygonWithTemp>& polys) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			PolygonWithTemp poly;
-			if (!parsePolygonWithTemp(s, i, poly)) return false;
-			polys.push_back(poly);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-}
-
-struct JsonInput {
-	std::vector<ReceiverPoint> receiverPoints;  // All points from receiver_planes
-	std::vector<PolygonWithTemp> polygons;           // emitter polygons with temperature
-	std::vector<std::vector<Vec3>> inertPolygons;      // optional blockers
-	std::size_t numRays {100000};
-	std::optional<std::uint64_t> seed;
-	
-	// Plane information for output
-	std::string planeName;
-	double planeWidth;
-	double planeHeight;
-};
-
-static bool parseInputJson(const std::string& json, JsonInput& out, std::string& error) {
-	using namespace mini_json;
-	size_t i = 0;
-	skipSpaces(json, i);
-	if (!expectChar(json, i, '{')) { error = "Expected '{'"; return false; }
-
-	bool haveReceiverPlanes = false, havePolygons = false;
-
-	while (i < json.size()) {
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == '}') { ++i; break; }
-
-		// Try known keys
-		size_t save = i;
-		if (parseKey(json, i, "receiver_planes")) {
-			if (!parseReceiverPlanes(json, i, out.planeName, out.planeWidth, out.planeHeight, out.receiverPoints)) { 
-				error = "Invalid receiver_planes"; 
-				return false; 
-			}
-			haveReceiverPlanes = true;
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "polygons")) {
-			// Try new format first (polygons with temperature)
-			size_t savePos = i;
-			if (parsePolygonsWithTemp(json, i, out.polygons)) {
-				// Successfully parsed new format
-				havePolygons = true;
-			} else {
-				// Try legacy format (simple array of polygons)
-				i = savePos;
-				std::vector<std::vector<Vec3>> legacyPolygons;
-				if (parsePolygons(json, i, legacyPolygons)) {
-					// Convert to new format with default temperature
-					out.polygons.clear();
-					for (const auto& poly : legacyPolygons) {
-						out.polygons.push_back({poly, 0.0}); // Default temperature of 0
-					}
-					havePolygons = true;
-				} else {
-					error = "Invalid polygons format - neither new format (with temperature) nor legacy format (simple arrays)";
-					return false;
-				}
-			}
-		} else { i = save; }
-
-		// optional inert polygons (blockers)
-		save = i;
-		if (parseKey(json, i, "inert_polygons")) {
-			std::vector<std::vector<Vec3>> tmp;
-			if (!parsePolygons(json, i, tmp)) { error = "Invalid inert_polygons"; return false; }
-			out.inertPolygons = std::move(tmp);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "num_rays")) {
-			double n; if (!parseNumber(json, i, n)) { error = "Invalid num_rays"; return false; }
-			if (n < 0) n = 0; out.numRays = static_cast<std::size_t>(n);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "seed")) {
-			std::uint64_t s; if (!parseUInt64(json, i, s)) { error = "Invalid seed"; return false; }
-			out.seed = s;
-		} else { i = save; }
-
-		// optional comma
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == ',') { ++i; continue; }
-	}
-
-	// Validate required fields
-	if (!haveReceiverPlanes) {
-		error = "Must provide 'receiver_planes' field";
-		return false;
-	}
-	
-	if (out.receiverPoints.empty()) {
-		error = "receiver_planes is empty";
-		return false;
-	}
-	
-	if (!havePolygons) { error = "Missing polygons"; return false; }
-	return true;
-}
-
-static std::string runFromJsonString(const std::string& jsonInput, bool& ok) {
-	JsonInput in;
-	std::string err;
-	if (!parseInputJson(jsonInput, in, err)) {
-		ok = false;
-		return std::string("{\"error\": \"") + err + "\"}\n";
-	}
-
-	std::mt19937_64 rng;
-	if (in.seed.has_value()) {
-		rng.seed(in.seed.value());
-	} else {
-		std::random_device rd;
-		std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
-		rng = std::mt19937_64(seedSeq);
-	}
-
-	// Process receiver points and calculate temperature contributions
-	size_t numPoints = in.receiverPoints.size();
-	std::vector<double> pointTemperatures(numPoints, 0.0);
-	
-	for (size_t pointIdx = 0; pointIdx < in.receiverPoints.size(); ++pointIdx) {
-		const auto& receiverPoint = in.receiverPoints[pointIdx];
-		
-		// Create a new RNG for each point to ensure deterministic results
-		std::mt19937_64 pointRng = rng;
-		if (in.seed.has_value()) {
-			// Use different seeds for each point for better randomness
-			pointRng.seed(in.seed.value() + pointIdx * 12345);
-		}
-		
-		auto res = calculateViewFactorsWithBlockage(receiverPoint.origin, receiverPoint.normal, in.polygons, in.inertPolygons, in.numRays, pointRng);
-		
-		// Calculate temperature contribution from each polygon
-		double totalTemperature = 0.0;
-		for (size_t p = 0; p < in.polygons.size(); ++p) {
-			double temperatureContribution = res.viewFactors[p] * in.polygons[p].temperature;
-			totalTemperature += temperatureContribution;
-		}
-		
-		pointTemperatures[pointIdx] = totalTemperature;
-	}
-
-	// Output in the requested format
-	std::ostringstream out;
-	out.setf(std::ios::fixed); 
-	out << std::setprecision(6); // Reduced precision for cleaner output
-	
-	// Output plane information
-	out << "Plane: " << in.planeName << "\n";
-	out << "Width: " << in.planeWidth << "\n";
-	out << "Height: " << in.planeHeight << "\n";
-	
-	// Output temperature values for all points
-	for (size_t i = 0; i < pointTemperatures.size(); ++i) {
-		if (i > 0) out << " ";
-		out << pointTemperatures[i];
-	}
-	out << "\n";
-	
-	ok = true;
-	return out.str();
-}
-
-static bool fileExists(const std::string& path) {
-	std::ifstream f(path);
-	return f.good();
-}
-
-static bool readFileText(const std::string& path, std::string& out, std::string& error) {
-	if (!fileExists(path)) {
-		error = "File does not exist: " + path;
-		return false;
-	}
-	
-	std::ifstream f(path, std::ios::in | std::ios::binary);
-	if (!f) { 
-		error = "Cannot open file: " + path; 
-		return false; 
-	}
-	std::ostringstream ss; ss << f.rdbuf();
-	out = ss.str();
-	return true;
-}
-
-int main(int argc, char* argv[]) {
-	// Check if file path is provided as command line argument
-	if (argc < 2) {
-		std::cerr << "{\"error\": \"Usage: " << argv[0] << " <json_file_path>\"}\n";
-		return 64; // usage error
-	}
-	
-	std::string jsonFilePath = argv[1];
-	
-	// Remove any quotes that might have been copied from file explorer
-	if (!jsonFilePath.empty() && jsonFilePath.front() == '"' && jsonFilePath.back() == '"') {
-		jsonFilePath = jsonFilePath.substr(1, jsonFilePath.length() - 2);
-	}
-	
-	// Remove any leading/trailing whitespace
-	jsonFilePath.erase(0, jsonFilePath.find_first_not_of(" \t\r\n"));
-	jsonFilePath.erase(jsonFilePath.find_last_not_of(" \t\r\n") + 1);
-	
-	if (jsonFilePath.empty()) {
-		std::cerr << "{\"error\": \"No file path provided\"}\n";
-		return 64; // usage error
-	}
-	
-	// Check if file exists
-	if (!fileExists(jsonFilePath)) {
-		std::cerr << "{\"error\": \"File does not exist: " << jsonFilePath << "\"}\n";
-		return 1;
-	}
-
-	std::string jsonText, err;
-	if (!readFileText(jsonFilePath, jsonText, err)) {
-		std::cerr << "{\"error\": \"" << err << "\"}\n";
-		return 1;
-	}
-	
-	bool ok = false;
-	std::string out = runFromJsonString(jsonText, ok);
-	if (!ok) {
-		std::cerr << out;
-		return 2;
-	}
-	std::cout << out;
-	return 0;
-}
-
-
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "engine/json.hpp"
+#include "engine/parallel.hpp"
+#include "engine/tra.hpp"
+
+// Input: the server's /calculate request schema, e.g.
+// {
+//   "receiver_planes": {
+//     "plane": { "width": 10, "height": 10, "points": [ {"origin": [x,y,z], "normal": [nx,ny,nz]}, ... ] }
+//   },
+//   "polygons": [ {"polygon": [[x,y,z], ...], "temperature": 100.0}, ... ],
+//   "inert_polygons": [ [[x,y,z], ...], ... ],        // optional blockers only
+//   "num_rays": 100000,          // optional (default 100000)
+//   "seed": 123456789            // optional (deterministic if provided)
+// }
+// Output: per plane, "Plane:", "Width:" and "Height:" lines and then its values.
+//
+// Batch mode: calcus --batch [directory] [--jobs N]
+// Jobs are read as NDJSON from stdin (one request per line), or from a directory
+// (*.json files hold one request, *.ndjson/*.jsonl files one per line, in name
+// order). Each job writes one NDJSON line in input order,
+//   {"job":"<source>:<line>","planes":[...]}   or   {"job":...,"error":"..."}
+// with planes[] as in the server's /calculate response. Jobs are parsed ahead on
+// a reader thread and solved by N workers (default 1; every solve already uses
+// all cores) on the engine's worker pool, so N is capped at its size. They share
+// the view-factor cache, so repeated geometry with new temperatures skips tracing.
+
+static std::string runFromJsonString(std::string_view jsonInput, bool& ok) {
+	std::string err;
+	std::optional<tra::Scene> scene = tra::Scene::fromJson(jsonInput, err);
+	if (!scene) {
+		ok = false;
+		return std::string("{\"error\": \"") + err + "\"}\n";
+	}
+	tra::Results results = tra::solve(*scene);
+
+	// Output in the requested format
+	std::ostringstream out;
+	out.setf(std::ios::fixed); 
+	out << std::setprecision(6); // Reduced precision for cleaner output
+	
+	for (const tra::PlaneResult& plane : results.planes) {
+		out << "Plane: " << plane.name << "\n";
+		out << "Width: " << static_cast<double>(plane.width) << "\n";
+		out << "Height: " << static_cast<double>(plane.height) << "\n";
+		for (size_t i = 0; i < plane.values.size(); ++i) {
+			if (i > 0) out << " ";
+			out << plane.values[i];
+		}
+		out << "\n";
+	}
+	
+	ok = true;
+	return out.str();
+}
+
+// ===== Input files =====
+// A regular file is mapped read-only and parsed in place; anything else (pipes,
+// FIFOs, /dev/stdin, files that cannot be mapped) is read once into a buffer.
+
+class InputFile {
+public:
+	InputFile() = default;
+	InputFile(const InputFile&) = delete;
+	InputFile& operator=(const InputFile&) = delete;
+	~InputFile() { unmap(); }
+
+	bool open(const std::string& path, std::string& error) {
+		std::error_code ec;
+		const std::filesystem::file_status status = std::filesystem::status(path, ec);
+		if (!std::filesystem::exists(status)) {
+			error = "File does not exist: " + path;
+			return false;
+		}
+		if (std::filesystem::is_regular_file(status) && map(path)) return true;
+		return readAll(path, error);
+	}
+
+	std::string_view text() const { return data_ ? std::string_view(data_, size_) : std::string_view(buffer_); }
+
+private:
+#ifdef _WIN32
+	bool map(const std::string& path) {
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) return unmap();
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping_) return unmap();
+		data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		if (!data_) return unmap();
+		size_ = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	bool unmap() {
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+		data_ = nullptr;
+		mapping_ = nullptr;
+		file_ = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	HANDLE file_ {INVALID_HANDLE_VALUE};
+	HANDLE mapping_ {nullptr};
+#else
+	bool map(const std::string& path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);    // the mapping keeps the file referenced
+		if (addr == MAP_FAILED) return false;
+		madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+		data_ = static_cast<const char*>(addr);
+		size_ = static_cast<size_t>(st.st_size);
+		return true;
+	}
+
+	bool unmap() {
+		if (data_) munmap(const_cast<char*>(data_), size_);
+		data_ = nullptr;
+		return false;
+	}
+#endif
+
+	// Streaming fallback: one growing buffer, no intermediate copies
+	bool readAll(const std::string& path, std::string& error) {
+		std::ifstream f(path, std::ios::in | std::ios::binary);
+		if (!f) {
+			error = "Cannot open file: " + path;
+			return false;
+		}
+		const size_t chunk = 1 << 20;
+		size_t used = 0;
+		for (;;) {
+			buffer_.resize(used + chunk);
+			f.read(&buffer_[used], static_cast<std::streamsize>(chunk));
+			used += static_cast<size_t>(f.gcount());
+			if (!f) break;
+		}
+		buffer_.resize(used);
+		if (f.bad()) {
+			error = "Cannot read file: " + path;
+			return false;
+		}
+		return true;
+	}
+
+	const char* data_ {nullptr};
+	size_t size_ {0};
+	std::string buffer_;
+};
+
+// ===== Batch mode =====
+
+class BatchPipeline {
+public:
+	// Workers run on the engine's pool, whose loops then fall back to the job's own thread
+	explicit BatchPipeline(size_t workers) : window_(workers * 2 + 2) {
+		const size_t helpers = std::min(workers, workerPool().size() + 1) - 1;
+		runner_ = std::thread([this, helpers] { workerPool().run(helpers, [this] { work(); }); });
+	}
+
+	// Parses one job and queues it
+	void submit(const std::string& id, std::string_view json) {
+		Job job;
+		job.id = id;
+		try {
+			job.scene = tra::Scene::fromJson(json, job.error);
+		} catch (const std::exception& e) {
+			job.error = e.what();
+		}
+		enqueue(std::move(job));
+	}
+
+	// A job that could not be read; reported in order like a parse failure
+	void submitError(const std::string& id, const std::string& error) {
+		Job job;
+		job.id = id;
+		job.error = error;
+		enqueue(std::move(job));
+	}
+
+	// Waits for every queued job; 0 if all succeeded, 2 otherwise
+	int finish() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_ = true;
+		}
+		ready_.notify_all();
+		runner_.join();
+		return failed_ ? 2 : 0;
+	}
+
+private:
+	struct Job {
+		size_t seq {0};
+		std::string id;
+		std::optional<tra::Scene> scene;
+		std::string error;
+	};
+
+	// Blocks while the window of unwritten jobs is full
+	void enqueue(Job job) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		space_.wait(lock, [this] { return submitted_ - written_ < window_; });
+		job.seq = submitted_++;
+		queue_.push_back(std::move(job));
+		ready_.notify_one();
+	}
+
+	void work() {
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				ready_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+				if (queue_.empty()) return;
+				job = std::move(queue_.front());
+				queue_.pop_front();
+			}
+			std::string line;
+			try {
+				line = run(job);
+			} catch (const std::exception& e) {
+				// e.g. std::bad_alloc on an oversized scene; the batch carries on
+				job.scene.reset();
+				job.error = e.what();
+				line = run(job);
+			}
+			emit(job.seq, std::move(line));
+		}
+	}
+
+	std::string run(Job& job) {
+		JsonWriter out(job.id.size() + 64, 6);
+		out.raw("{\"job\":").string(job.id);
+		if (!job.scene) {
+			failed_ = true;
+			out.raw(",\"error\":").string(job.error).raw('}');
+			return out.take();
+		}
+		// Splice the plane list of {"planes":[...]} in after the job id
+		std::string planes = tra::toJson(tra::solve(*job.scene), job.scene->precision());
+		out.raw(',').raw(std::string_view(planes).substr(1));
+		return out.take();
+	}
+
+	// Results are written in submission order as soon as their predecessors are
+	void emit(size_t seq, std::string line) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		done_.emplace(seq, std::move(line));
+		for (auto it = done_.find(written_); it != done_.end(); it = done_.find(written_)) {
+			std::cout << it->second << '\n';
+			done_.erase(it);
+			++written_;
+		}
+		std::cout.flush();
+		space_.notify_one();
+	}
+
+	const size_t window_;
+	std::thread runner_;
+	std::mutex mutex_;
+	std::condition_variable ready_, space_;
+	std::deque<Job> queue_;
+	std::map<size_t, std::string> done_;
+	size_t submitted_ {0};
+	size_t written_ {0};
+	bool closed_ {false};
+	std::atomic<bool> failed_ {false};
+};
+
+// One job per non-blank line
+static void submitLine(BatchPipeline& batch, std::string_view line, const std::string& source, size_t lineNo) {
+	if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+	if (line.find_first_not_of(" \t") == std::string_view::npos) return;
+	batch.submit(source + ":" + std::to_string(lineNo), line);
+}
+
+// Jobs start as soon as their line arrives
+static void submitLines(BatchPipeline& batch, std::istream& in, const std::string& source) {
+	std::string line;
+	for (size_t lineNo = 1; std::getline(in, line); ++lineNo) submitLine(batch, line, source, lineNo);
+}
+
+static void submitLines(BatchPipeline& batch, std::string_view text, const std::string& source) {
+	for (size_t lineNo = 1; !text.empty(); ++lineNo) {
+		const size_t end = std::min(text.find('\n'), text.size());
+		submitLine(batch, text.substr(0, end), source, lineNo);
+		text.remove_prefix(std::min(end + 1, text.size()));
+	}
+}
+
+static int runBatch(const std::string& directory, size_t workers) {
+	namespace fs = std::filesystem;
+	BatchPipeline batch(workers);
+	if (directory.empty()) {
+		submitLines(batch, std::cin, "stdin");
+		return batch.finish();
+	}
+
+	std::error_code ec;
+	std::vector<fs::path> files;
+	for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		const std::string ext = it->path().extension().string();
+		if (it->is_regular_file(ec) && (ext == ".json" || ext == ".ndjson" || ext == ".jsonl")) files.push_back(it->path());
+	}
+	if (ec) {
+		batch.finish();
+		std::cerr << errorJson("Cannot read directory: " + directory + " (" + ec.message() + ")") << "\n";
+		return 1;
+	}
+	std::sort(files.begin(), files.end());
+
+	for (const fs::path& path : files) {
+		const std::string name = path.filename().string();
+		InputFile file;
+		std::string err;
+		if (!file.open(path.string(), err)) batch.submitError(name, err);
+		else if (path.extension() == ".json") batch.submit(name, file.text());
+		else submitLines(batch, file.text(), name);
+	}
+	return batch.finish();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc >= 2 && std::string(argv[1]) == "--batch") {
+		std::string directory;
+		size_t workers = 1;
+		for (int k = 2; k < argc; ++k) {
+			const std::string arg = argv[k];
+			if (arg == "--jobs" && k + 1 < argc) {
+				workers = std::max<size_t>(1, std::strtoul(argv[++k], nullptr, 10));
+			} else if (directory.empty() && arg.rfind("--", 0) != 0) {
+				directory = arg;
+			} else {
+				std::cerr << "{\"error\": \"Usage: " << argv[0] << " --batch [directory] [--jobs N]\"}\n";
+				return 64;
+			}
+		}
+		return runBatch(directory, workers);
+	}
+
+	// Check if file path is provided as command line argument
+	if (argc < 2) {
+		std::cerr << "{\"error\": \"Usage: " << argv[0] << " <json_file_path>\"}\n";
+		return 64; // usage error
+	}
+	
+	std::string jsonFilePath = argv[1];
+	
+	// Remove any quotes that might have been copied from file explorer
+	if (!jsonFilePath.empty() && jsonFilePath.front() == '"' && jsonFilePath.back() == '"') {
+		jsonFilePath = jsonFilePath.substr(1, jsonFilePath.length() - 2);
+	}
+	
+	// Remove any leading/trailing whitespace
+	jsonFilePath.erase(0, jsonFilePath.find_first_not_of(" \t\r\n"));
+	jsonFilePath.erase(jsonFilePath.find_last_not_of(" \t\r\n") + 1);
+	
+	if (jsonFilePath.empty()) {
+		std::cerr << "{\"error\": \"No file path provided\"}\n";
+		return 64; // usage error
+	}
+	
+	InputFile file;
+	std::string err;
+	if (!file.open(jsonFilePath, err)) {
+		std::cerr << "{\"error\": \"" << err << "\"}\n";
+		return 1;
+	}
+	
+	bool ok = false;
+	std::string out = runFromJsonString(file.text(), ok);
+	if (!ok) {
+		std::cerr << out;
+		return 2;
+	}
+	std::cout << out;
+	return 0;
+}
+
+
@@ -0,0 +1,176 @@
+#include "admission.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "calculation.hpp"
+#include "json.hpp"
+#include "radiosity.hpp"
+#include "telemetry.hpp"
+#include "view_factors.hpp"
+
+AdmissionPolicy g_admission;
+double g_nsPerRayTest = 0.0;
+
+double calibrateRayTestCost() {
+	std::vector<PolygonWithTemp> emitters;
+	std::vector<std::vector<Vec3>> blockers;
+	for (int k = 0; k < 8; ++k) {
+		double x = -4.0 + k;
+		emitters.push_back({{{x, 0, 2}, {x + 0.8, 0, 2}, {x + 0.8, 2, 2}, {x, 2, 2}}, 50.0, nullptr});
+		blockers.push_back({{x, 0.5, 1}, {x + 0.4, 0.5, 1}, {x + 0.4, 1.5, 1}, {x, 1.5, 1}});
+	}
+	const size_t rays = 40000;
+	std::mt19937_64 rng(1);
+	const std::uint64_t raysBefore = g_engineCounters.raysTraced.load(), testsBefore = g_engineCounters.polygonTests.load();
+	auto start = std::chrono::steady_clock::now();
+	calculateViewFactorsWithBlockage({0, 1, 0}, {0, 0, 1}, emitters, blockers, rays, rng);
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	// Calibration is not client work; keep it out of /metrics
+	g_engineCounters.raysTraced = raysBefore;
+	g_engineCounters.polygonTests = testsBefore;
+	return ns / static_cast<double>(rays * (emitters.size() + blockers.size()));
+}
+
+static CostEstimate estimateCost(const JsonInput& in) {
+	CostEstimate c;
+	c.points = receiverPointCount(in);
+	c.rays = in.numRays;
+	c.polygons = std::max<size_t>(1, in.polygons.size() + in.inertPolygons.size() + in.media.volumes.size());
+	const double fullGrid = static_cast<double>(c.points) * static_cast<double>(c.rays);
+	const double threads = static_cast<double>(std::max(1u, std::thread::hardware_concurrency()));
+
+	double parallelRays = 0.0, serialRays = 0.0;
+	if (in.separation) {
+		parallelRays = separationSearchRays(in);
+	} else if (in.query == "max") {
+		serialRays = std::min(fullGrid, static_cast<double>(in.planeDataMap.size()) * 400.0 * static_cast<double>(c.rays));
+	} else if (in.query == "exceedance") {
+		serialRays = fullGrid;
+	} else {
+		// Budgeted solves trace afresh every time
+		c.cached = !reflectionsActive(in) && !budgetRequested(in) && g_viewFactorCache.contains(hashSceneGeometry(in));
+		parallelRays = c.cached ? 0.0 : fullGrid;
+		// Batch variations that swap blockers may retrace everything
+		for (const auto& v : in.variations) if (v.inertPolygons) parallelRays += fullGrid;
+		if (reflectionsActive(in)) {
+			size_t patches = buildRadiosityScene(in, *in.reflections).patches.size();
+			parallelRays += 2.0 * static_cast<double>(patches) * static_cast<double>(in.reflections->raysPerPatch);
+		}
+	}
+	c.tracedRays = parallelRays + serialRays;
+	c.rayTests = c.tracedRays * static_cast<double>(c.polygons);
+	const double secondsPerTest = g_nsPerRayTest * 1e-9;
+	c.predictedSeconds = (parallelRays / threads + serialRays) * static_cast<double>(c.polygons) * secondsPerTest;
+	// Only the budgeted full-grid solve stops at its deadline (the other endpoints
+	// refuse deadline_ms), and never before its pilot pass has covered every point
+	const bool budgeted = in.query.empty() && !in.separation && in.variations.empty() && !reflectionsActive(in);
+	if (in.deadlineMs > 0.0 && budgeted) {
+		const double pilotSeconds = static_cast<double>(c.points) * static_cast<double>(budgetPilotRays(in)) / threads *
+		                            static_cast<double>(c.polygons) * secondsPerTest;
+		c.predictedSeconds = std::max(std::min(c.predictedSeconds, in.deadlineMs * 1e-3), pilotSeconds);
+	}
+	return c;
+}
+
+HeavyJobQueue g_heavyJobs;
+
+const char* admissionName(AdmissionPolicy::Mode mode) {
+	switch (mode) {
+		case AdmissionPolicy::Mode::Reject: return "reject";
+		case AdmissionPolicy::Mode::Queue: return "queue";
+		case AdmissionPolicy::Mode::Downgrade: return "downgrade";
+	}
+	return "";
+}
+
+// Rays per point that bring the prediction under the limit, or 0 if even minRays does not
+static size_t downgradedRays(const JsonInput& in, const CostEstimate& c) {
+	if (c.predictedSeconds <= 0.0) return in.numRays;
+	double scale = g_admission.maxJobSeconds / c.predictedSeconds;
+	size_t rays = static_cast<size_t>(static_cast<double>(in.numRays) * scale);
+	return rays >= g_admission.minRays ? rays : 0;
+}
+
+static bool applyPolicy(JsonInput& in, JobReport& job, std::string& error) {
+	job.estimate = estimateCost(in);
+	const CostEstimate& c = job.estimate;
+	LogRecord(LogLevel::Info, "Cost estimate").field("points", c.points).field("rays", c.rays).field("polygons", c.polygons)
+		.field("predicted_seconds", c.predictedSeconds).field("cached", c.cached);
+	if (g_admission.maxJobSeconds <= 0.0 || c.predictedSeconds <= g_admission.maxJobSeconds) return true;
+
+	std::ostringstream why;
+	why << "Predicted runtime " << c.predictedSeconds << " s exceeds the server limit of "
+	    << g_admission.maxJobSeconds << " s";
+	switch (g_admission.mode) {
+		case AdmissionPolicy::Mode::Reject:
+			job.status = 413;
+			error = errorJson(why.str() + "; reduce num_rays or the receiver grid");
+			return false;
+		case AdmissionPolicy::Mode::Downgrade: {
+			size_t rays = downgradedRays(in, c);
+			if (rays == 0) {
+				job.status = 413;
+				error = errorJson(why.str() + " even at the minimum ray count");
+				return false;
+			}
+			LogRecord(LogLevel::Warn, "Admission: downgrading num_rays").field("reason", why.str()).field("requested", in.numRays).field("rays", rays);
+			job.requestedRays = in.numRays;
+			in.numRays = rays;
+			job.estimate = estimateCost(in);
+			return true;
+		}
+		case AdmissionPolicy::Mode::Queue:
+			LogRecord(LogLevel::Warn, "Admission: queued").field("reason", why.str()).field("waiting", g_heavyJobs.waiting());
+			{
+				TraceSpan span("admission", "queue wait");
+				job.slot = g_heavyJobs.acquire(g_admission.maxQueued);
+			}
+			if (!job.slot) {
+				job.status = 503;
+				error = errorJson(why.str() + " and the heavy-job queue is full; try again later");
+				return false;
+			}
+			return true;
+	}
+	return true;
+}
+
+bool admitJob(JsonInput& in, JobReport& job, std::string& error) {
+	if (!applyPolicy(in, job, error)) return false;
+	// Only admitted jobs pay for their receiver grids
+	expandReceiverGrids(in);
+	return true;
+}
+
+std::string runEstimate(std::string_view input, const WireFormat& wire, bool& ok) {
+	JsonInput in;
+	std::string err;
+	bool parsed = wire.binaryRequest ? parseInputBinary(input, in, err) : parseInputJson(input, in, err);
+	if (!parsed) {
+		ok = false;
+		return errorJson(err);
+	}
+	CostEstimate c = estimateCost(in);
+	const bool overLimit = g_admission.maxJobSeconds > 0.0 && c.predictedSeconds > g_admission.maxJobSeconds;
+	JsonWriter out(512, 6);
+	out.raw("{\"success\":true,\"points\":").integer(c.points);
+	out.raw(",\"rays\":").integer(c.rays);
+	out.raw(",\"polygons\":").integer(c.polygons);
+	out.raw(",\"traced_rays\":").number(c.tracedRays);
+	out.raw(",\"ray_tests\":").number(c.rayTests);
+	out.raw(",\"cached\":").raw(c.cached ? "true" : "false");
+	out.raw(",\"predicted_seconds\":").number(c.predictedSeconds);
+	out.raw(",\"limit_seconds\":").number(g_admission.maxJobSeconds);
+	out.raw(",\"admission\":\"").raw(overLimit ? admissionName(g_admission.mode) : "run").raw('"');
+	if (overLimit && g_admission.mode == AdmissionPolicy::Mode::Downgrade) {
+		out.raw(",\"downgraded_rays\":").integer(downgradedRays(in, c));
+	}
+	out.raw('}');
+	ok = true;
+	return out.take();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "scene.hpp"
+#include "wire.hpp"
+
+// ===== Cost model and admission control =====
+// Tracing dominates: its cost is (rays traced) x (polygons each ray is tested
+// against) x (time per ray-polygon test), the last measured at startup with the
+// real kernel. Full-grid builds run on every core; point searches (queries,
+// separation) are serial. Jobs predicted to exceed --max-job-seconds are rejected,
+// queued behind other heavy jobs, or run with fewer rays (--admission).
+
+struct CostEstimate {
+	size_t points {0};
+	size_t rays {0};
+	size_t polygons {0};         // tested per ray: emitters, blockers, media volumes
+	double tracedRays {0.0};     // whole job
+	double rayTests {0.0};
+	bool cached {false};         // matrix already cached: no tracing
+	double predictedSeconds {0.0};
+};
+
+struct AdmissionPolicy {
+	enum class Mode { Reject, Queue, Downgrade };
+	Mode mode {Mode::Queue};
+	double maxJobSeconds {900.0};    // 0 disables the limit
+	size_t maxQueued {4};            // heavy jobs waiting before new ones are turned away
+	size_t minRays {1000};           // downgrade floor
+};
+
+extern AdmissionPolicy g_admission;
+extern double g_nsPerRayTest;    // per ray-polygon test; 0 until calibrated
+
+// Time the kernel on a small synthetic scene (a receiver facing a ring of
+// emitters and blockers), single-threaded
+double calibrateRayTestCost();
+
+// One heavy job runs at a time; the rest wait in arrival order up to maxQueued
+class HeavyJobQueue {
+public:
+	class Slot {
+	public:
+		explicit Slot(HeavyJobQueue& q) : q_(q) {}
+		~Slot() { q_.release(); }
+	private:
+		HeavyJobQueue& q_;
+	};
+
+	std::unique_ptr<Slot> acquire(size_t maxQueued) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (running_ && waiting_ >= maxQueued) return nullptr;
+		++waiting_;
+		cv_.wait(lock, [this]() { return !running_; });
+		--waiting_;
+		running_ = true;
+		return std::make_unique<Slot>(*this);
+	}
+
+	size_t waiting() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return waiting_;
+	}
+
+	bool running() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return running_;
+	}
+
+private:
+	void release() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_ = false;
+		}
+		cv_.notify_one();
+	}
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool running_ {false};
+	size_t waiting_ {0};
+};
+
+extern HeavyJobQueue g_heavyJobs;
+
+// Admission outcome for one request, kept alive until its response is sent
+struct JobReport {
+	CostEstimate estimate;
+	int status {400};                          // HTTP status when the job fails
+	size_t requestedRays {0};                  // non-zero when downgraded
+	std::unique_ptr<HeavyJobQueue::Slot> slot;
+};
+
+const char* admissionName(AdmissionPolicy::Mode mode);
+
+// Estimate the job and apply the policy; may lower in.numRays. Admitted jobs have
+// their receiver grids expanded. On refusal returns false with the error body in
+// 'error' and the HTTP status in job.status.
+bool admitJob(JsonInput& in, JobReport& job, std::string& error);
+
+// Dry run: parse and estimate without tracing
+std::string runEstimate(std::string_view input, const WireFormat& wire, bool& ok);
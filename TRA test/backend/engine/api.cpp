@@ -0,0 +1,131 @@
+#include "tra.hpp"
+
+#include <utility>
+
+#include "calculation.hpp"
+#include "json.hpp"
+#include "parallel.hpp"
+#include "radiosity.hpp"
+#include "scene.hpp"
+
+namespace tra {
+
+Scene::Scene() : in_(std::make_unique<JsonInput>()) {}
+Scene::~Scene() = default;
+Scene::Scene(const Scene& other) : in_(std::make_unique<JsonInput>(*other.in_)) {}
+Scene& Scene::operator=(const Scene& other) {
+	if (this != &other) *in_ = *other.in_;
+	return *this;
+}
+Scene::Scene(Scene&&) noexcept = default;
+Scene& Scene::operator=(Scene&&) noexcept = default;
+
+std::optional<Scene> Scene::fromJson(std::string_view json, std::string& error) {
+	Scene scene;
+	if (!parseInputJson(json, *scene.in_, error)) return std::nullopt;
+	expandReceiverGrids(*scene.in_);
+	return scene;
+}
+
+void Scene::addEmitter(std::vector<Vec3> polygon, double temperature) {
+	in_->polygons.push_back({std::move(polygon), temperature, nullptr});
+	in_->emitterSeries.emplace_back();
+}
+
+void Scene::addBlocker(std::vector<Vec3> polygon, double reflectivity) {
+	in_->inertPolygons.push_back(std::move(polygon));
+	in_->inertReflectivity.push_back(reflectivity);
+}
+
+bool Scene::addReceiverPlane(const std::string& name, size_t width, size_t height, std::vector<ReceiverPoint> points) {
+	if (in_->planeDataMap.count(name)) return false;
+	if (boundedGridPoints(width, height) == 0 || points.size() != width * height) return false;
+	if (in_->receiverPoints.size() + points.size() > kMaxReceiverPoints) return false;
+	PlaneData pd;
+	pd.width = width;
+	pd.height = height;
+	pd.numPoints = points.size();
+	pd.firstPoint = in_->receiverPoints.size();
+	in_->receiverPoints.insert(in_->receiverPoints.end(), points.begin(), points.end());
+	in_->planeDataMap[name] = pd;
+	return true;
+}
+
+bool Scene::addReceiverGrid(const std::string& name, size_t width, size_t height,
+                            const Vec3& origin, const Vec3& u, const Vec3& v, const Vec3& normal) {
+	if (boundedGridPoints(width, height) == 0 || in_->receiverPoints.size() + width * height > kMaxReceiverPoints) return false;
+	ReceiverGridSpec grid;
+	grid.origin = origin;
+	grid.uAxis = u;
+	grid.vAxis = v;
+	grid.normal = normal;
+	std::vector<ReceiverPoint> points;
+	generateReceiverGrid(grid, width, height, points);
+	return addReceiverPlane(name, width, height, std::move(points));
+}
+
+void Scene::setTemperature(size_t emitter, double temperature) {
+	PolygonWithTemp& poly = in_->polygons.at(emitter);
+	poly.temperature = temperature;
+	poly.field.reset();
+}
+
+void Scene::setRays(size_t raysPerPoint) { in_->numRays = raysPerPoint; }
+void Scene::setSeed(std::uint64_t seed) { in_->seed = seed; }
+
+void Scene::setReflections(bool enabled) {
+	if (enabled) in_->reflections.emplace();
+	else in_->reflections.reset();
+}
+
+size_t Scene::numPoints() const { return in_->receiverPoints.size(); }
+size_t Scene::numEmitters() const { return in_->polygons.size(); }
+size_t Scene::numRays() const { return in_->numRays; }
+int Scene::precision() const { return in_->precision; }
+
+bool Scene::validate(std::string& error) const {
+	if (in_->receiverPoints.empty()) {
+		error = "receiver_planes is empty";
+		return false;
+	}
+	if (in_->polygons.empty()) {
+		error = "Missing polygons";
+		return false;
+	}
+	return true;
+}
+
+Results solve(const Scene& scene) {
+	return *solve(scene, SolveOptions {});
+}
+
+std::optional<Results> solve(const Scene& scene, const SolveOptions& options) {
+	const JsonInput& in = *scene.in_;
+	JobControl job(in.receiverPoints.size(), options.progress, options.cancel);
+	ActiveJob activeJob(&job);
+	const bool budgeted = (in.deadlineMs > 0.0 || in.allocation) && !reflectionsActive(in);
+	CalculationResult result = budgeted ? computeBudgetedCalculation(in) : computeCalculation(in);
+	if (job.cancelled()) return std::nullopt;
+	job.finish();
+	return Results {std::move(result.planes)};
+}
+
+bool solveInto(const Scene& scene, const SolveOptions& options, double* values) {
+	const JsonInput& in = *scene.in_;
+	JobControl job(in.receiverPoints.size(), options.progress, options.cancel);
+	ActiveJob activeJob(&job);
+	computePointValues(in, values);
+	if (job.cancelled()) return false;
+	job.finish();
+	return true;
+}
+
+std::string toJson(const Results& results, int precision) {
+	JsonWriter out(estimateJsonSize(results.planes, precision), precision);
+	out.raw('{');
+	writePlanesJson(out, results.planes);
+	out.raw('}');
+	return out.take();
+}
+
+}  // namespace tra
@@ -0,0 +1,177 @@
+#include "calculation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+#include "admission.hpp"
+#include "parallel.hpp"
+#include "view_factors.hpp"
+
+// ===== Budgeted calculation ("deadline_ms", "allocation") =====
+// A pilot pass at every point measures the actual rays/s and gives first
+// estimates with their standard errors. The rest of the budget (num_rays x
+// points, or whatever the deadline leaves) is then traced in phases, each pooled
+// with what came before: evenly, or by per-point variance when "allocation" is
+// set. Points reached after the deadline keep the rays they already have.
+// These results are not cached; with a deadline they also depend on timing.
+
+static constexpr size_t kMinPilotRays = 16;
+static constexpr size_t kMaxPilotRays = 256;
+static constexpr double kPilotShare = 0.2;       // of the deadline, by the startup cost model
+static constexpr double kDeadlineMargin = 0.1;   // of the deadline, kept for output
+static constexpr double kVarianceFloor = 0.01;   // of the mean per-ray variance
+
+// Combine two independent estimates of n1 and n2 rays
+static PointEstimate poolEstimates(const PointEstimate& a, size_t na, const PointEstimate& b, size_t nb) {
+	if (nb == 0) return a;
+	if (na == 0) return b;
+	const double n = static_cast<double>(na + nb);
+	const double wa = static_cast<double>(na) / n, wb = static_cast<double>(nb) / n;
+	const double meanSqA = a.stdError * a.stdError * static_cast<double>(na) + a.value * a.value;
+	const double meanSqB = b.stdError * b.stdError * static_cast<double>(nb) + b.value * b.value;
+	PointEstimate est;
+	est.value = wa * a.value + wb * b.value;
+	est.stdError = std::sqrt(std::max(0.0, wa * meanSqA + wb * meanSqB - est.value * est.value) / n);
+	return est;
+}
+
+size_t budgetPilotRays(const JsonInput& in) {
+	if (in.allocation && in.allocation->pilotRays > 0) return std::min(in.numRays, in.allocation->pilotRays);
+	if (in.deadlineMs <= 0.0) return std::min(in.numRays, std::max(kMinPilotRays, in.numRays / 10));
+	const double threads = static_cast<double>(std::max(1u, std::thread::hardware_concurrency()));
+	const double polygons = static_cast<double>(std::max<size_t>(1, in.polygons.size() + in.inertPolygons.size() + in.media.volumes.size()));
+	const double secondsPerRay = polygons * g_nsPerRayTest * 1e-9 * static_cast<double>(receiverPointCount(in)) / threads;
+	double rays = secondsPerRay > 0.0 ? kPilotShare * in.deadlineMs * 1e-3 / secondsPerRay : static_cast<double>(kMaxPilotRays);
+	rays = std::clamp(rays, static_cast<double>(kMinPilotRays), static_cast<double>(kMaxPilotRays));
+	return std::min(in.numRays, static_cast<size_t>(rays));
+}
+
+// Extra rays per point for this phase. With per-ray deviation s_i the error is
+// s_i / sqrt(n_i): equal errors (minmax) need n_i ~ s_i^2, the least mean error
+// needs n_i ~ s_i^(2/3). Totals are water-filled above the rays already spent.
+// Variances are floored so a point whose pilot saw nothing still gets some rays.
+static std::vector<size_t> allocateByVariance(const std::vector<PointEstimate>& estimates, const std::vector<size_t>& rays,
+                                              double budget, RayAllocation::Objective objective) {
+	const size_t n = estimates.size();
+	std::vector<double> weight(n);
+	double meanVariance = 0.0;
+	for (size_t k = 0; k < n; ++k) {
+		weight[k] = estimates[k].stdError * estimates[k].stdError * static_cast<double>(rays[k]);
+		meanVariance += weight[k] / static_cast<double>(n);
+	}
+	const double floor = meanVariance > 0.0 ? kVarianceFloor * meanVariance : 1.0;
+	for (double& w : weight) {
+		w = std::max(w, floor);
+		if (objective == RayAllocation::Objective::Mean) w = std::cbrt(w);
+	}
+
+	auto demand = [&](double c) {
+		double total = 0.0;
+		for (size_t k = 0; k < n; ++k) total += std::max(0.0, c * weight[k] - static_cast<double>(rays[k]));
+		return total;
+	};
+	double lo = 0.0, hi = 1.0;
+	while (demand(hi) < budget) hi *= 2.0;
+	for (int it = 0; it < 64; ++it) {
+		double mid = 0.5 * (lo + hi);
+		(demand(mid) < budget ? lo : hi) = mid;
+	}
+	std::vector<size_t> extra(n);
+	for (size_t k = 0; k < n; ++k) extra[k] = static_cast<size_t>(std::max(0.0, lo * weight[k] - static_cast<double>(rays[k])));
+	return extra;
+}
+
+static std::vector<PlaneAccuracy> planeAccuracy(const JsonInput& in, const std::vector<PointEstimate>& estimates, const std::vector<size_t>& rays) {
+	std::vector<PlaneAccuracy> planes;
+	for (const auto& [name, pd] : in.planeDataMap) {
+		PlaneAccuracy acc;
+		acc.name = name;
+		acc.minRays = std::numeric_limits<size_t>::max();
+		const size_t end = std::min(pd.firstPoint + pd.numPoints, estimates.size());
+		for (size_t k = pd.firstPoint; k < end; ++k) {
+			acc.minRays = std::min(acc.minRays, rays[k]);
+			acc.maxRays = std::max(acc.maxRays, rays[k]);
+			acc.meanStdError += estimates[k].stdError;
+			acc.maxStdError = std::max(acc.maxStdError, estimates[k].stdError);
+		}
+		if (end > pd.firstPoint) acc.meanStdError /= static_cast<double>(end - pd.firstPoint);
+		else acc.minRays = 0;
+		planes.push_back(std::move(acc));
+	}
+	return planes;
+}
+
+std::vector<double> computeBudgetedPointValues(const JsonInput& in, BudgetReport& report) {
+	StageTimer timer(Stage::Trace);
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	const bool hasDeadline = in.deadlineMs > 0.0;
+	const auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(in.deadlineMs));
+	const std::uint64_t seed = resolveSeed(in);
+	const size_t numPoints = in.receiverPoints.size();
+
+	report = BudgetReport();
+	report.deadlineMs = in.deadlineMs;
+	report.pilotRays = budgetPilotRays(in);
+	report.objective = !in.allocation ? "uniform" : in.allocation->objective == RayAllocation::Objective::Mean ? "mean" : "minmax";
+	report.phases = in.allocation ? in.allocation->phases : 1;
+
+	std::vector<PointEstimate> estimates(numPoints);
+	parallelFor(numPoints, [&](size_t idx) {
+		estimates[idx] = estimatePointValue(in, in.receiverPoints[idx], pointSeedFor(seed, idx), report.pilotRays);
+	});
+	const double pilotSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	const double pilotTotal = static_cast<double>(report.pilotRays) * static_cast<double>(numPoints);
+	report.raysPerSecond = pilotSeconds > 0.0 ? pilotTotal / pilotSeconds : 0.0;
+
+	// Rays left after the pilot; a deadline also limits them by the measured throughput
+	double budget = static_cast<double>(in.numRays - report.pilotRays) * static_cast<double>(numPoints);
+	if (hasDeadline) {
+		const double leftSeconds = in.deadlineMs * 1e-3 * (1.0 - kDeadlineMargin) - pilotSeconds;
+		budget = std::min(budget, std::max(0.0, leftSeconds) * report.raysPerSecond);
+	}
+
+	std::vector<size_t> rays(numPoints, report.pilotRays);
+	std::atomic<bool> late {false};
+	for (size_t phase = 0; phase < report.phases && budget >= 1.0 && !late && !jobCancelled(); ++phase) {
+		const double phaseBudget = budget / static_cast<double>(report.phases - phase);
+		std::vector<size_t> extra = in.allocation
+			? allocateByVariance(estimates, rays, phaseBudget, in.allocation->objective)
+			: std::vector<size_t>(numPoints, static_cast<size_t>(phaseBudget / static_cast<double>(std::max<size_t>(1, numPoints))));
+		const std::uint64_t phaseSeed = seed ^ (0x5851f42d4c957f2dull * (phase + 1));
+		parallelFor(numPoints, [&](size_t idx) {
+			if (extra[idx] == 0) return;
+			if (hasDeadline && Clock::now() >= deadline) {
+				late = true;
+				return;
+			}
+			PointEstimate more = estimatePointValue(in, in.receiverPoints[idx], pointSeedFor(phaseSeed, idx), extra[idx]);
+			estimates[idx] = poolEstimates(estimates[idx], rays[idx], more, extra[idx]);
+			rays[idx] += extra[idx];
+		});
+		for (size_t k = 0; k < numPoints; ++k) budget -= static_cast<double>(extra[k]);
+	}
+
+	std::vector<double> pointValues(numPoints);
+	for (size_t k = 0; k < numPoints; ++k) {
+		pointValues[k] = estimates[k].value;
+		report.totalRays += static_cast<double>(rays[k]);
+	}
+	report.complete = !late;
+	report.planes = planeAccuracy(in, estimates, rays);
+	report.elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	LogRecord(report.complete ? LogLevel::Info : LogLevel::Warn, "Budgeted calculation").field("objective", report.objective)
+		.field("pilot_rays", report.pilotRays).field("rays_per_second", report.raysPerSecond).field("total_rays", report.totalRays)
+		.field("elapsed_ms", report.elapsedMs).field("complete", report.complete);
+	return pointValues;
+}
+
+CalculationResult computeBudgetedCalculation(const JsonInput& in) {
+	BudgetReport report;
+	std::vector<double> pointValues = computeBudgetedPointValues(in, report);
+	CalculationResult result = buildPlaneResults(in, pointValues, true);
+	result.budget = std::move(report);
+	return result;
+}
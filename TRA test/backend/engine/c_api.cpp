@@ -0,0 +1,166 @@
+#include "tra_c.h"
+
+#include <atomic>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "scene.hpp"
+#include "tra.hpp"
+
+struct tra_scene {
+	tra::Scene scene;
+	std::atomic<bool> cancel {false};
+};
+
+static thread_local std::string t_lastError;
+
+static tra_status fail(tra_status status, std::string message) {
+	t_lastError = std::move(message);
+	return status;
+}
+
+static Vec3 vec3At(const double* xyz, size_t index) {
+	return {xyz[3 * index], xyz[3 * index + 1], xyz[3 * index + 2]};
+}
+
+// Splits the packed vertex array into polygons; false if any has fewer than 3 vertices
+static bool unpackPolygons(size_t count, const size_t* vertexCounts, const double* vertices, std::vector<std::vector<Vec3>>& polygons) {
+	size_t next = 0;
+	polygons.resize(count);
+	for (size_t k = 0; k < count; ++k) {
+		if (vertexCounts[k] < 3) return false;
+		polygons[k].reserve(vertexCounts[k]);
+		for (size_t i = 0; i < vertexCounts[k]; ++i) polygons[k].push_back(vec3At(vertices, next++));
+	}
+	return true;
+}
+
+extern "C" {
+
+tra_scene* tra_scene_create(void) {
+	try {
+		return new tra_scene();
+	} catch (const std::exception& e) {
+		fail(TRA_INTERNAL_ERROR, e.what());
+		return nullptr;
+	}
+}
+
+void tra_scene_destroy(tra_scene* scene) { delete scene; }
+
+tra_status tra_scene_add_emitters(tra_scene* scene, size_t count, const size_t* vertex_counts, const double* vertices, const double* temperatures) {
+	if (!scene || (count > 0 && (!vertex_counts || !vertices || !temperatures))) return fail(TRA_INVALID_ARGUMENT, "Null scene or emitter array");
+	try {
+		std::vector<std::vector<Vec3>> polygons;
+		if (!unpackPolygons(count, vertex_counts, vertices, polygons)) return fail(TRA_INVALID_ARGUMENT, "Emitter polygons need at least 3 vertices");
+		for (size_t k = 0; k < count; ++k) scene->scene.addEmitter(std::move(polygons[k]), temperatures[k]);
+		return TRA_OK;
+	} catch (const std::exception& e) {
+		return fail(TRA_INTERNAL_ERROR, e.what());
+	}
+}
+
+tra_status tra_scene_add_blockers(tra_scene* scene, size_t count, const size_t* vertex_counts, const double* vertices, const double* reflectivities) {
+	if (!scene || (count > 0 && (!vertex_counts || !vertices))) return fail(TRA_INVALID_ARGUMENT, "Null scene or blocker array");
+	try {
+		std::vector<std::vector<Vec3>> polygons;
+		if (!unpackPolygons(count, vertex_counts, vertices, polygons)) return fail(TRA_INVALID_ARGUMENT, "Blocker polygons need at least 3 vertices");
+		for (size_t k = 0; k < count; ++k) {
+			const double rho = reflectivities ? reflectivities[k] : 0.0;
+			if (rho < 0.0 || rho >= 1.0) return fail(TRA_INVALID_ARGUMENT, "Reflectivity must be in [0, 1)");
+		}
+		for (size_t k = 0; k < count; ++k) scene->scene.addBlocker(std::move(polygons[k]), reflectivities ? reflectivities[k] : 0.0);
+		return TRA_OK;
+	} catch (const std::exception& e) {
+		return fail(TRA_INTERNAL_ERROR, e.what());
+	}
+}
+
+tra_status tra_scene_add_receivers(tra_scene* scene, const char* name, size_t width, size_t height,
+                                   size_t count, const double* origins, const double* normals) {
+	if (!scene || !name || (count > 0 && (!origins || !normals))) return fail(TRA_INVALID_ARGUMENT, "Null scene, name or receiver array");
+	const size_t planePoints = boundedGridPoints(width, height);
+	if (planePoints == 0 || count != planePoints) {
+		return fail(TRA_INVALID_ARGUMENT, std::string("Receiver plane '") + name + "' needs count == width * height, at least 1");
+	}
+	if (count > kMaxReceiverPoints - scene->scene.numPoints()) {
+		return fail(TRA_INVALID_ARGUMENT, std::string("Receiver plane '") + name + "' takes the scene past " + std::to_string(kMaxReceiverPoints) + " points");
+	}
+	try {
+		std::vector<tra::ReceiverPoint> points(count);
+		for (size_t i = 0; i < count; ++i) points[i] = {vec3At(origins, i), vec3At(normals, i)};
+		if (!scene->scene.addReceiverPlane(name, width, height, std::move(points))) {
+			return fail(TRA_INVALID_ARGUMENT, std::string("Duplicate receiver plane '") + name + "'");
+		}
+		return TRA_OK;
+	} catch (const std::exception& e) {
+		return fail(TRA_INTERNAL_ERROR, e.what());
+	}
+}
+
+tra_status tra_scene_add_receiver_grid(tra_scene* scene, const char* name, size_t width, size_t height,
+                                       const double origin[3], const double u[3], const double v[3], const double normal[3]) {
+	if (!scene || !name || !origin || !u || !v || !normal) return fail(TRA_INVALID_ARGUMENT, "Null scene, name or grid vector");
+	try {
+		if (!scene->scene.addReceiverGrid(name, width, height, vec3At(origin, 0), vec3At(u, 0), vec3At(v, 0), vec3At(normal, 0))) {
+			return fail(TRA_INVALID_ARGUMENT, std::string("Receiver plane '") + name + "' is a duplicate, or its grid is empty or too large");
+		}
+		return TRA_OK;
+	} catch (const std::exception& e) {
+		return fail(TRA_INTERNAL_ERROR, e.what());
+	}
+}
+
+tra_status tra_scene_set_temperatures(tra_scene* scene, size_t count, const double* temperatures) {
+	if (!scene || (count > 0 && !temperatures)) return fail(TRA_INVALID_ARGUMENT, "Null scene or temperature array");
+	if (count > scene->scene.numEmitters()) return fail(TRA_INVALID_ARGUMENT, "More temperatures than emitters");
+	for (size_t k = 0; k < count; ++k) scene->scene.setTemperature(k, temperatures[k]);
+	return TRA_OK;
+}
+
+void tra_scene_set_rays(tra_scene* scene, size_t rays_per_point) {
+	if (scene) scene->scene.setRays(rays_per_point);
+}
+
+void tra_scene_set_seed(tra_scene* scene, uint64_t seed) {
+	if (scene) scene->scene.setSeed(seed);
+}
+
+void tra_scene_set_reflections(tra_scene* scene, int enabled) {
+	if (scene) scene->scene.setReflections(enabled != 0);
+}
+
+size_t tra_scene_num_points(const tra_scene* scene) { return scene ? scene->scene.numPoints() : 0; }
+
+tra_status tra_solve(tra_scene* scene, double* values, size_t capacity, tra_progress_fn progress, void* user_data) {
+	if (!scene || !values) return fail(TRA_INVALID_ARGUMENT, "Null scene or value buffer");
+	std::string error;
+	if (!scene->scene.validate(error)) return fail(TRA_INVALID_SCENE, error);
+	if (capacity < scene->scene.numPoints()) return fail(TRA_BUFFER_TOO_SMALL, "Value buffer holds fewer than tra_scene_num_points values");
+	// The cancel flag is cleared only once the solve is over, so a tra_scene_cancel
+	// that lands just before the solve starts still stops it
+	tra::SolveOptions options;
+	options.cancel = &scene->cancel;
+	if (progress) {
+		options.progress = [scene, progress, user_data](double fraction) {
+			if (progress(fraction, user_data) != 0) scene->cancel.store(true, std::memory_order_relaxed);
+		};
+	}
+	tra_status status = TRA_OK;
+	try {
+		if (!tra::solveInto(scene->scene, options, values)) status = fail(TRA_CANCELLED, "Solve cancelled");
+	} catch (const std::exception& e) {
+		status = fail(TRA_INTERNAL_ERROR, e.what());
+	}
+	scene->cancel.store(false, std::memory_order_relaxed);
+	return status;
+}
+
+void tra_scene_cancel(tra_scene* scene) {
+	if (scene) scene->cancel.store(true, std::memory_order_relaxed);
+}
+
+const char* tra_last_error(void) { return t_lastError.c_str(); }
+
+}  // extern "C"
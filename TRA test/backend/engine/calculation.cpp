@@ -0,0 +1,373 @@
+#include "calculation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+
+#include "admission.hpp"
+#include "jobs.hpp"
+#include "parallel.hpp"
+#include "queries.hpp"
+#include "view_factors.hpp"
+#include "wire.hpp"
+
+// Debug-level dump of a plane and every emitter; skipped entirely above debug
+static void logPlaneSummary(const JsonInput& in, const std::string& planeName, const PlaneData& planeData) {
+	if (!logEnabled(LogLevel::Debug)) return;
+	{
+		LogRecord record(LogLevel::Debug, "Processing plane");
+		record.field("plane", planeName).field("width", planeData.width).field("height", planeData.height)
+			.field("points", planeData.numPoints).field("first_point", planeData.firstPoint).field("emitters", in.polygons.size());
+		if (planeData.firstPoint < in.receiverPoints.size()) {
+			const auto& firstPoint = in.receiverPoints[planeData.firstPoint];
+			record.field("sample_origin", firstPoint.origin).field("sample_normal", firstPoint.normal);
+		}
+	}
+	for (size_t i = 0; i < in.polygons.size(); ++i) {
+		LogRecord record(LogLevel::Debug, "Emitter");
+		record.field("plane", planeName).field("index", i).field("temperature", in.polygons[i].temperature)
+			.field("vertices", in.polygons[i].vertices.size());
+		if (!in.polygons[i].vertices.empty()) record.field("first_vertex", in.polygons[i].vertices[0]);
+	}
+}
+
+CalculationResult buildPlaneResults(const JsonInput& in, const std::vector<double>& pointValues, bool verbose) {
+	CalculationResult result;
+	result.planes.reserve(in.planeDataMap.size());
+	
+	if (verbose) LogRecord(LogLevel::Info, "Assembling planes").field("planes", in.planeDataMap.size()).field("points", in.receiverPoints.size());
+	
+	// Iterate through each plane in the map
+	for (const auto& planePair : in.planeDataMap) {
+		const std::string& planeName = planePair.first;
+		const PlaneData& planeData = planePair.second;
+		TraceSpan span("plane", planeName);
+		
+		if (verbose) logPlaneSummary(in, planeName, planeData);
+		
+		double minTemp = std::numeric_limits<double>::infinity();
+		double maxTemp = -std::numeric_limits<double>::infinity();
+		
+		size_t planeEnd = planeData.firstPoint + planeData.numPoints;
+		if (planeEnd > pointValues.size()) {
+			LogRecord(LogLevel::Error, "Plane extends past the receiver points").field("plane", planeName).field("end", planeEnd).field("points", pointValues.size());
+			planeEnd = pointValues.size();
+		}
+		
+		PlaneResult plane;
+		plane.name = planeName;
+		plane.width = planeData.width;
+		plane.height = planeData.height;
+		plane.values.assign(pointValues.begin() + static_cast<std::ptrdiff_t>(planeData.firstPoint), pointValues.begin() + static_cast<std::ptrdiff_t>(planeEnd));
+		for (double v : plane.values) {
+			if (v < minTemp) minTemp = v;
+			if (v > maxTemp) maxTemp = v;
+		}
+		
+		if (verbose) LogRecord(LogLevel::Debug, "Finished plane").field("plane", planeName).field("min", minTemp).field("max", maxTemp);
+		
+		result.planes.push_back(std::move(plane));
+	}
+	return result;
+}
+
+CalculationResult computeCalculation(const JsonInput& in) {
+	if (reflectionsActive(in)) {
+		RadiosityStats stats;
+		std::vector<double> pointValues = computeWithReflections(in, stats);
+		CalculationResult result = buildPlaneResults(in, pointValues, true);
+		result.reflections = stats;
+		return result;
+	}
+	std::shared_ptr<const ViewFactorMatrix> matrix = acquireViewFactorMatrix(in);
+	std::vector<double> pointValues = applyViewFactorMatrix(*matrix, in.polygons);
+	return buildPlaneResults(in, pointValues, true);
+}
+
+void computePointValues(const JsonInput& in, double* values) {
+	std::vector<double> pointValues;
+	if (reflectionsActive(in)) {
+		RadiosityStats stats;
+		pointValues = computeWithReflections(in, stats);
+	} else if (budgetRequested(in)) {
+		BudgetReport report;
+		pointValues = computeBudgetedPointValues(in, report);
+	} else {
+		applyViewFactorMatrix(*acquireViewFactorMatrix(in), in.polygons, values);
+		return;
+	}
+	std::copy(pointValues.begin(), pointValues.end(), values);
+}
+
+size_t estimateJsonSize(const std::vector<PlaneResult>& planes, int precision) {
+	size_t numValues = 0;
+	for (const auto& plane : planes) numValues += plane.values.size();
+	return 64 + planes.size() * 96 + numValues * (JsonWriter::maxNumberChars(precision) + 1);
+}
+
+void writePlanesJson(JsonWriter& out, const std::vector<PlaneResult>& planes) {
+	out.raw("\"planes\":[");
+	for (size_t p = 0; p < planes.size(); ++p) {
+		const PlaneResult& plane = planes[p];
+		if (p > 0) out.raw(',');
+		out.raw("{\"name\":").string(plane.name);
+		out.raw(",\"width\":").integer(plane.width);
+		out.raw(",\"height\":").integer(plane.height);
+		out.raw(",\"values\":[");
+		for (size_t i = 0; i < plane.values.size(); ++i) {
+			if (i > 0) out.raw(',');
+			out.number(plane.values[i]);
+		}
+		out.raw("]}");
+	}
+	out.raw(']');
+}
+
+// "profile" member; serialiseNs is the part of serialisation already done
+static void writeProfileJson(JsonWriter& out, const RequestProfile& profile, std::uint64_t serialiseNs, std::uint64_t serialiseCpuNs) {
+	const ProfileTimestamp now = ProfileTimestamp::now();
+	out.raw("\"profile\":{\"elapsed_ms\":").number(std::chrono::duration<double, std::milli>(now.wall - profile.started.wall).count());
+	out.raw(",\"threads\":").integer(std::max(1u, std::thread::hardware_concurrency()));
+	out.raw(",\"stages\":{");
+	for (size_t s = 0; s < static_cast<size_t>(ProfileStage::Count); ++s) {
+		const bool serialise = s == static_cast<size_t>(ProfileStage::Serialise);
+		std::uint64_t wall = profile.wallNs[s].load() + (serialise ? serialiseNs : 0);
+		std::uint64_t cpu = profile.cpuNs[s].load() + (serialise ? serialiseCpuNs : 0);
+		if (s > 0) out.raw(',');
+		out.raw('"').raw(kProfileStageNames[s]).raw("\":{\"wall_ms\":").number(static_cast<double>(wall) * 1e-6);
+		out.raw(",\"cpu_ms\":").number(static_cast<double>(cpu) * 1e-6).raw('}');
+	}
+	out.raw("},\"rays\":").integer(profile.rays.load());
+	out.raw(",\"polygon_tests\":").integer(profile.polygonTests.load());
+	out.raw(",\"point_in_polygon_tests\":").integer(profile.pointInPolygonTests.load());
+	out.raw(",\"hits\":").integer(profile.hits.load()).raw('}');
+}
+
+static std::string writeJsonResult(const CalculationResult& result, int precision) {
+	StageTimer timer(Stage::Serialise);
+	const ProfileTimestamp started = ProfileTimestamp::now();
+	JsonWriter out(estimateJsonSize(result.planes, precision), precision);
+	out.raw("{\"success\":true,");
+	if (result.reflections) {
+		const RadiosityStats& stats = *result.reflections;
+		out.raw("\"reflections\":{\"patches\":").integer(stats.patches);
+		out.raw(",\"iterations\":").integer(stats.iterations);
+		out.raw(",\"residual\":").number(stats.residual);
+		out.raw(",\"converged\":").raw(stats.converged ? "true" : "false").raw("},");
+	}
+	if (result.budget) {
+		const BudgetReport& budget = *result.budget;
+		out.raw("\"budget\":{\"objective\":").string(budget.objective);
+		out.raw(",\"phases\":").integer(budget.phases);
+		if (budget.deadlineMs > 0.0) out.raw(",\"deadline_ms\":").number(budget.deadlineMs);
+		out.raw(",\"elapsed_ms\":").number(budget.elapsedMs);
+		out.raw(",\"rays_per_second\":").number(budget.raysPerSecond);
+		out.raw(",\"pilot_rays\":").integer(budget.pilotRays);
+		out.raw(",\"total_rays\":").number(budget.totalRays);
+		out.raw(",\"complete\":").raw(budget.complete ? "true" : "false");
+		out.raw(",\"planes\":[");
+		for (size_t p = 0; p < budget.planes.size(); ++p) {
+			const PlaneAccuracy& acc = budget.planes[p];
+			if (p > 0) out.raw(',');
+			out.raw("{\"name\":").string(acc.name);
+			out.raw(",\"min_rays\":").integer(acc.minRays);
+			out.raw(",\"max_rays\":").integer(acc.maxRays);
+			out.raw(",\"mean_std_error\":").number(acc.meanStdError);
+			out.raw(",\"max_std_error\":").number(acc.maxStdError).raw('}');
+		}
+		out.raw("]},");
+	}
+	writePlanesJson(out, result.planes);
+	if (result.profile) {
+		const ProfileTimestamp now = ProfileTimestamp::now();
+		out.raw(',');
+		writeProfileJson(out, *result.profile, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now.wall - started.wall).count()),
+		                 now.cpuNs - started.cpuNs);
+	}
+	out.raw('}');
+	return out.take();
+}
+
+static std::string writeBinaryResult(const CalculationResult& result, size_t scalarBytes) {
+	StageTimer timer(Stage::Serialise);
+	size_t size = 16;
+	for (const auto& plane : result.planes) size += 16 + plane.name.size() + 8 + plane.values.size() * scalarBytes + 8;
+	BinaryWriter out(size);
+	out.bytes("TRAR", 4);
+	out.value(kBinaryVersion);
+	out.value(static_cast<std::uint8_t>(scalarBytes));
+	out.value(static_cast<std::uint8_t>(0));
+	out.value(static_cast<std::uint32_t>(result.planes.size()));
+	out.value(static_cast<std::uint32_t>(0));
+	for (const auto& plane : result.planes) {
+		out.value(static_cast<std::uint32_t>(plane.name.size()));
+		out.value(static_cast<std::uint32_t>(plane.width));
+		out.value(static_cast<std::uint32_t>(plane.height));
+		out.value(static_cast<std::uint32_t>(plane.values.size()));
+		out.bytes(plane.name.data(), plane.name.size());
+		out.align8();
+		for (double v : plane.values) out.scalar(v, scalarBytes);
+		out.align8();
+	}
+	return out.take();
+}
+
+WireFormat negotiateWireFormat(const std::string& contentType, const std::string& accept) {
+	WireFormat wire;
+	wire.binaryRequest = contentType.rfind(kBinaryContentType, 0) == 0;
+	wire.binaryResponse = accept.find(kBinaryContentType) != std::string::npos;
+	if (accept.find("scalar=f64") != std::string::npos) wire.responseScalarBytes = 8;
+	return wire;
+}
+
+std::string runCalculation(std::string_view input, WireFormat& wire, JobReport& job, bool& ok) {
+	JsonInput in;
+	std::string err;
+	const ProfileTimestamp parseStart = ProfileTimestamp::now();
+	bool parsed = wire.binaryRequest ? parseInputBinary(input, in, err) : parseInputJson(input, in, err);
+	if (!parsed) {
+		ok = false;
+		return errorJson(err);
+	}
+	// The flag is only known once parsed, so parse time is charged afterwards
+	std::unique_ptr<RequestProfile> profile;
+	if (in.profile) {
+		profile = std::make_unique<RequestProfile>();
+		profile->started = parseStart;
+		profile->add(ProfileStage::Parse, parseStart);
+	}
+	ActiveProfile activeProfile(profile.get());
+	if (budgetRequested(in) && !in.query.empty()) {
+		ok = false;
+		return errorJson("'deadline_ms' and 'allocation' are not supported by queries");
+	}
+	if (!in.query.empty() && reflectionsActive(in)) {
+		ok = false;
+		return errorJson("Reflections are not supported by queries");
+	}
+	if (budgetRequested(in) && reflectionsActive(in)) {
+		ok = false;
+		return errorJson("'deadline_ms' and 'allocation' are not supported with reflections");
+	}
+	if (reflectionsActive(in) && reflectiveTriangleCount(in) > in.reflections->maxPatches) {
+		ok = false;
+		return errorJson("Reflective polygons have " + std::to_string(reflectiveTriangleCount(in)) +
+		                 " triangles, more than reflections.max_patches (" + std::to_string(in.reflections->maxPatches) + ")");
+	}
+	std::string refusal;
+	if (!admitJob(in, job, refusal)) {
+		ok = false;
+		return refusal;
+	}
+
+	if (!in.query.empty()) {
+		// Query modes answer with small JSON summaries
+		wire.binaryResponse = false;
+		if (in.query == "max") {
+			ok = true;
+			return runPeakQuery(in);
+		}
+		if (in.query == "exceedance") return runExceedanceQuery(in, ok);
+		ok = false;
+		return errorJson("Unknown query '" + in.query + "'");
+	}
+
+	CalculationResult result = budgetRequested(in) ? computeBudgetedCalculation(in) : computeCalculation(in);
+	result.profile = profile.get();
+	ok = true;
+	if (wire.binaryResponse) return writeBinaryResult(result, wire.responseScalarBytes);
+	return writeJsonResult(result, in.precision);
+}
+
+std::string runBatchCalculation(std::string_view input, JobReport& job, bool& ok) {
+	JsonInput base;
+	std::string err;
+	if (!parseInputJson(input, base, err)) {
+		ok = false;
+		return errorJson(err);
+	}
+	if (base.variations.empty()) {
+		ok = false;
+		return errorJson("Batch request needs a non-empty 'variations' array");
+	}
+	if (budgetRequested(base)) {
+		ok = false;
+		return errorJson("'deadline_ms' and 'allocation' are only supported by /calculate");
+	}
+	if (reflectionsActive(base)) {
+		ok = false;
+		return errorJson("Reflections are only supported by /calculate");
+	}
+	for (const auto& v : base.variations) {
+		if (v.temperatures && v.temperatures->size() != base.polygons.size()) {
+			ok = false;
+			return errorJson("Variation '" + v.name + "': temperatures must have one value per emitter");
+		}
+		for (size_t idx : v.disabledEmitters) {
+			if (idx >= base.polygons.size()) {
+				ok = false;
+				return errorJson("Variation '" + v.name + "': disabled emitter index out of range");
+			}
+		}
+	}
+
+	std::string refusal;
+	if (!admitJob(base, job, refusal)) {
+		ok = false;
+		return refusal;
+	}
+
+	LogRecord(LogLevel::Info, "Batch").field("variations", base.variations.size()).field("points", base.receiverPoints.size())
+		.field("emitters", base.polygons.size());
+	std::shared_ptr<const ViewFactorMatrix> baseMatrix = acquireViewFactorMatrix(base);
+
+	std::vector<std::pair<std::string, CalculationResult>> results;
+	results.reserve(base.variations.size());
+	size_t resultBytes = 64;
+	for (const auto& v : base.variations) {
+		JsonInput variant;
+		variant.receiverPoints = base.receiverPoints;
+		variant.polygons = base.polygons;
+		variant.inertPolygons = v.inertPolygons ? *v.inertPolygons : base.inertPolygons;
+		variant.numRays = base.numRays;
+		variant.seed = base.seed;
+		variant.media = base.media;
+		variant.planeDataMap = base.planeDataMap;
+
+		// Temperatures only change column values, so the geometry (and any field
+		// sample layout) stays the base scene's; overridden emitters become uniform
+		std::vector<PolygonWithTemp> emitters = base.polygons;
+		if (v.temperatures) {
+			for (size_t e = 0; e < emitters.size(); ++e) {
+				emitters[e].temperature = (*v.temperatures)[e];
+				emitters[e].field.reset();
+			}
+		}
+		// A disabled emitter is a cold opaque surface: same geometry, zero contribution
+		for (size_t idx : v.disabledEmitters) {
+			emitters[idx].temperature = 0.0;
+			emitters[idx].field.reset();
+		}
+
+		std::shared_ptr<const ViewFactorMatrix> matrix = v.inertPolygons ? deriveViewFactorMatrix(base, baseMatrix, variant) : baseMatrix;
+		CalculationResult result = buildPlaneResults(variant, applyViewFactorMatrix(*matrix, emitters), false);
+		resultBytes += v.name.size() + 32 + estimateJsonSize(result.planes, base.precision);
+		results.emplace_back(v.name, std::move(result));
+	}
+
+	StageTimer timer(Stage::Serialise);
+	JsonWriter out(resultBytes, base.precision);
+	out.raw("{\"success\":true,\"variations\":[");
+	for (size_t k = 0; k < results.size(); ++k) {
+		if (k > 0) out.raw(',');
+		out.raw("{\"name\":").string(results[k].first).raw(',');
+		writePlanesJson(out, results[k].second.planes);
+		out.raw('}');
+	}
+	out.raw("]}");
+	ok = true;
+	return out.take();
+}
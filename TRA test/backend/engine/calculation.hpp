@@ -0,0 +1,72 @@
+#pragma once
+
+// Full-grid calculations: per-plane results, the direct and budgeted solvers and
+// the response encoders
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "radiosity.hpp"
+#include "scene.hpp"
+#include "telemetry.hpp"
+#include "tra.hpp"
+
+// ===== Calculation =====
+
+using tra::PlaneResult;
+
+// Achieved accuracy of a deadline-bounded plane
+struct PlaneAccuracy {
+	std::string name;
+	size_t minRays {0};
+	size_t maxRays {0};
+	double meanStdError {0.0};
+	double maxStdError {0.0};
+};
+
+struct BudgetReport {
+	double deadlineMs {0.0};
+	double elapsedMs {0.0};
+	double raysPerSecond {0.0};
+	size_t pilotRays {0};
+	std::string objective;               // "uniform", "minmax" or "mean"
+	size_t phases {1};
+	double totalRays {0.0};
+	bool complete {true};                // every point received its allocation
+	std::vector<PlaneAccuracy> planes;
+};
+
+struct CalculationResult {
+	std::vector<PlaneResult> planes;
+	std::optional<RadiosityStats> reflections;
+	std::optional<BudgetReport> budget;
+	const RequestProfile* profile {nullptr};
+};
+
+// Slice per-point values into the response planes (map order); verbose logs each plane
+CalculationResult buildPlaneResults(const JsonInput& in, const std::vector<double>& pointValues, bool verbose);
+
+// Every receiver point at num_rays: reflections if requested, otherwise the
+// cached view-factor matrix times the emitter temperatures
+CalculationResult computeCalculation(const JsonInput& in);
+
+// "deadline_ms" / "allocation": pilot pass, then the remaining budget in phases
+CalculationResult computeBudgetedCalculation(const JsonInput& in);
+std::vector<double> computeBudgetedPointValues(const JsonInput& in, BudgetReport& report);
+
+// Either solver's values in receiver point order, written to values[0, points)
+// without assembling planes; the direct solver writes them in place
+void computePointValues(const JsonInput& in, double* values);
+
+// Rays per point of the pilot pass, which runs to completion whatever the deadline
+size_t budgetPilotRays(const JsonInput& in);
+
+// Rays a separation search traces at most, for admission
+double separationSearchRays(const JsonInput& in);
+
+// "planes":[...] member shared by the single and batch responses, and its size bound
+size_t estimateJsonSize(const std::vector<PlaneResult>& planes, int precision);
+void writePlanesJson(JsonWriter& out, const std::vector<PlaneResult>& planes);
@@ -0,0 +1,45 @@
+#include "geometry.hpp"
+
+// Row-major, rows outermost: same ordering as the frontend's generatePointsOnPlane
+void generateReceiverGrid(const ReceiverGridSpec& spec, size_t width, size_t height, std::vector<ReceiverPoint>& points) {
+	points.reserve(points.size() + width * height);
+	for (size_t row = 0; row < height; ++row) {
+		for (size_t col = 0; col < width; ++col) points.push_back(receiverGridPoint(spec, width, height, col, row));
+	}
+}
+
+std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng) {
+    std::vector<Vec3> rays;
+    if (numRays == 0) return rays;
+    rays.reserve(numRays);
+
+    Vec3 w = normalize(surfaceNormal);
+    Vec3 u;
+    if (std::fabs(w.x) > 0.9999) {
+        u = normalize(cross({0.0, 1.0, 0.0}, w));
+    } else {
+        u = normalize(cross({1.0, 0.0, 0.0}, w));
+    }
+	Vec3 v = cross(w, u);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+    for (size_t i = 0; i < numRays; ++i) {
+        double u1 = dist(rng);
+        double u2 = dist(rng);
+        double phi = 2.0 * M_PI * u1;
+        double cosTheta = std::sqrt(1.0 - u2);
+        double sinTheta = std::sqrt(u2);
+        double x = sinTheta * std::cos(phi);
+        double y = sinTheta * std::sin(phi);
+        double z = cosTheta;
+        Vec3 local {x, y, z};
+        // rotate to world
+        Vec3 world {
+            u.x * local.x + v.x * local.y + w.x * local.z,
+            u.y * local.x + v.y * local.y + w.y * local.z,
+            u.z * local.x + v.z * local.y + w.z * local.z
+        };
+        rays.push_back(world);
+    }
+    return rays;
+}
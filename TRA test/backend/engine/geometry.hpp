@@ -0,0 +1,290 @@
+#pragma once
+
+// Scene geometry: vectors, polygons, receiver points and participating media,
+// plus the ray/polygon primitives the kernels are built from.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Simple 3D vector struct with basic operations
+struct Vec3 {
+    double x;
+    double y;
+    double z;
+
+    Vec3() : x(0.0), y(0.0), z(0.0) {}
+    Vec3(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+
+    Vec3 operator+(const Vec3& other) const { return {x + other.x, y + other.y, z + other.z}; }
+    Vec3 operator-(const Vec3& other) const { return {x - other.x, y - other.y, z - other.z}; }
+    Vec3 operator*(double s) const { return {x * s, y * s, z * s}; }
+    Vec3 operator/(double s) const { return {x / s, y / s, z / s}; }
+
+    Vec3& operator+=(const Vec3& other) { x += other.x; y += other.y; z += other.z; return *this; }
+    Vec3& operator-=(const Vec3& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
+    Vec3& operator*=(double s) { x *= s; y *= s; z *= s; return *this; }
+    Vec3& operator/=(double s) { x /= s; y /= s; z /= s; return *this; }
+};
+
+inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return {
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x
+    };
+}
+inline double length(const Vec3& v) { return std::sqrt(dot(v, v)); }
+inline Vec3 normalize(const Vec3& v) {
+    double len = length(v);
+    if (len <= 1e-12) return {0.0, 0.0, 0.0};
+    return v / len;
+}
+
+struct Plane {
+    Vec3 normal;
+    Vec3 point; // any point on plane
+};
+
+// Temperature over an emitter's surface, so one polygon can stand in for a stack of
+// slices. "grid": width x height samples spanning the polygon in its (u, v) frame
+// (u along the first edge, v across it, both scaled to the polygon's extent; the
+// samples include the corners), bilinear in between. "vertical": samples at world
+// heights (Y), linear in between and held beyond the ends. Each sample gets its own
+// view-factor matrix column, so editing sample values never re-traces.
+struct TemperatureField {
+	enum class Kind { Grid, Vertical };
+	Kind kind {Kind::Grid};
+	size_t width {1};
+	size_t height {1};
+	std::vector<double> heights;    // vertical only, strictly increasing
+	std::vector<double> values;     // grid: row-major, rows along v; vertical: one per height
+
+	// Grid frame, set from the polygon's vertices
+	Vec3 origin, uDir, vDir;
+	double uMin {0.0}, uSpan {1.0}, vMin {0.0}, vSpan {1.0};
+
+	size_t size() const { return values.size(); }
+
+	bool setFrame(const std::vector<Vec3>& verts) {
+		if (verts.size() < 3) return false;
+		Vec3 n = cross(verts[1] - verts[0], verts[2] - verts[0]);
+		uDir = normalize(verts[1] - verts[0]);
+		vDir = normalize(cross(normalize(n), uDir));
+		if (length(uDir) == 0.0 || length(vDir) == 0.0) return false;
+		origin = verts[0];
+		double uMax = -std::numeric_limits<double>::infinity(), vMax = uMax;
+		uMin = vMin = std::numeric_limits<double>::infinity();
+		for (const auto& v : verts) {
+			double u = dot(v - origin, uDir), w = dot(v - origin, vDir);
+			uMin = std::min(uMin, u); uMax = std::max(uMax, u);
+			vMin = std::min(vMin, w); vMax = std::max(vMax, w);
+		}
+		uSpan = uMax - uMin;
+		vSpan = vMax - vMin;
+		return uSpan > 0.0 && vSpan > 0.0;
+	}
+
+	// Interpolation weights at a point on the polygon: add(sample, weight), weights sum to 1
+	template <typename Add>
+	void weights(const Vec3& p, Add&& add) const {
+		if (kind == Kind::Vertical) {
+			if (p.y <= heights.front()) { add(0, 1.0); return; }
+			if (p.y >= heights.back()) { add(heights.size() - 1, 1.0); return; }
+			size_t k = static_cast<size_t>(std::upper_bound(heights.begin(), heights.end(), p.y) - heights.begin());
+			double w = (p.y - heights[k - 1]) / (heights[k] - heights[k - 1]);
+			add(k - 1, 1.0 - w);
+			add(k, w);
+			return;
+		}
+		double x = std::clamp((dot(p - origin, uDir) - uMin) / uSpan, 0.0, 1.0) * static_cast<double>(width - 1);
+		double y = std::clamp((dot(p - origin, vDir) - vMin) / vSpan, 0.0, 1.0) * static_cast<double>(height - 1);
+		size_t i0 = static_cast<size_t>(x), j0 = static_cast<size_t>(y);
+		size_t i1 = std::min(i0 + 1, width - 1), j1 = std::min(j0 + 1, height - 1);
+		double fx = x - static_cast<double>(i0), fy = y - static_cast<double>(j0);
+		add(j0 * width + i0, (1.0 - fx) * (1.0 - fy));
+		add(j0 * width + i1, fx * (1.0 - fy));
+		add(j1 * width + i0, (1.0 - fx) * fy);
+		add(j1 * width + i1, fx * fy);
+	}
+
+	double valueAt(const Vec3& p) const {
+		double value = 0.0;
+		weights(p, [&](size_t k, double w) { value += w * values[k]; });
+		return value;
+	}
+};
+
+struct PolygonWithTemp {
+	std::vector<Vec3> vertices;
+	double temperature;
+	std::shared_ptr<const TemperatureField> field;    // optional; overrides temperature
+};
+
+struct ReceiverPoint {
+	Vec3 origin;
+	Vec3 normal;
+};
+
+struct PlaneData {
+	size_t width;
+	size_t height;
+	size_t numPoints;
+	size_t firstPoint; // offset of this plane's points in the global point list
+};
+
+// Compact receiver-plane description: a width x height grid spanning origin + u_axis
+// (columns) and origin + v_axis (rows), all sharing one normal
+struct ReceiverGridSpec {
+	Vec3 origin;
+	Vec3 uAxis;
+	Vec3 vAxis;
+	Vec3 normal;
+	bool haveOrigin {false};
+	bool haveUAxis {false};
+	bool haveVAxis {false};
+	bool haveNormal {false};
+
+	bool complete() const { return haveOrigin && haveUAxis && haveVAxis && haveNormal; }
+};
+
+// Point (col, row) of a width x height grid
+inline ReceiverPoint receiverGridPoint(const ReceiverGridSpec& spec, size_t width, size_t height, size_t col, size_t row) {
+	double fu = width > 1 ? static_cast<double>(col) / static_cast<double>(width - 1) : 0.0;
+	double fv = height > 1 ? static_cast<double>(row) / static_cast<double>(height - 1) : 0.0;
+	return {spec.origin + spec.uAxis * fu + spec.vAxis * fv, spec.normal};
+}
+
+// Row-major, rows outermost: same ordering as the frontend's generatePointsOnPlane
+void generateReceiverGrid(const ReceiverGridSpec& spec, size_t width, size_t height, std::vector<ReceiverPoint>& points);
+
+// Compute plane from polygon vertices (assumes first 3 non-collinear define plane)
+inline std::optional<Plane> getPolygonPlane(const std::vector<Vec3>& verts) {
+    if (verts.size() < 3) return std::nullopt;
+    Vec3 v1 = verts[1] - verts[0];
+    Vec3 v2 = verts[2] - verts[0];
+    Vec3 n = cross(v1, v2);
+    double nmag = length(n);
+    if (nmag < 1e-9) return std::nullopt;
+    n = n / nmag;
+    return Plane{n, verts[0]};
+}
+
+// Ray-plane intersection: returns intersection point and t, or nullopt/inf if no forward hit
+inline std::pair<std::optional<Vec3>, double> rayPlaneIntersect(
+    const Vec3& rayOrigin,
+    const Vec3& rayDir,
+    const Vec3& planeNormal,
+    const Vec3& pointOnPlane
+) {
+    double ndotu = dot(planeNormal, rayDir);
+    if (std::fabs(ndotu) < 1e-9) {
+        return {std::nullopt, std::numeric_limits<double>::infinity()};
+    }
+    Vec3 w = rayOrigin - pointOnPlane;
+    double t = -dot(planeNormal, w) / ndotu;
+    if (t < 1e-7) {
+        return {std::nullopt, std::numeric_limits<double>::infinity()};
+    }
+    Vec3 p = rayOrigin + rayDir * t;
+    return {p, t};
+}
+
+// Project 3D polygon and point onto the dominant plane and do 2D point-in-polygon test (winding/non-zero)
+inline bool isPointInPolygon2D(const std::vector<std::array<double,2>>& poly, double x, double y) {
+    // Ray casting even-odd rule
+    bool inside = false;
+    size_t n = poly.size();
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        const auto& pi = poly[i];
+        const auto& pj = poly[j];
+        bool intersect = ((pi[1] > y) != (pj[1] > y)) &&
+                         (x < (pj[0] - pi[0]) * (y - pi[1]) / ((pj[1] - pi[1]) + 1e-30) + pi[0]);
+        if (intersect) inside = !inside;
+    }
+    return inside;
+}
+
+inline bool isPointInPolygon3D(const Vec3& p, const std::vector<Vec3>& polygon, const Vec3& polygonNormal) {
+    Vec3 absn { std::fabs(polygonNormal.x), std::fabs(polygonNormal.y), std::fabs(polygonNormal.z) };
+    int a = 0, b = 1; // indices to keep
+    if (absn.x >= absn.y && absn.x >= absn.z) { a = 1; b = 2; }
+    else if (absn.y >= absn.x && absn.y >= absn.z) { a = 0; b = 2; }
+    else { a = 0; b = 1; }
+
+    std::vector<std::array<double,2>> poly2d;
+    poly2d.reserve(polygon.size());
+    for (const auto& v : polygon) {
+        double coords[3] = {v.x, v.y, v.z};
+        poly2d.push_back({coords[a], coords[b]});
+    }
+    double pc[3] = {p.x, p.y, p.z};
+    return isPointInPolygon2D(poly2d, pc[a], pc[b]);
+}
+
+// Cosine-weighted hemisphere directions around a given normal (using provided RNG)
+std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng);
+
+// Attenuating volumes between surfaces (e.g. smoke). A ray reaching a surface at
+// distance t is weighted by the Beer-Lambert transmittance exp(-tau), where tau
+// is the extinction coefficient integrated over the path.
+struct AttenuatingVolume {
+	enum class Kind { Box, Slab };
+	Kind kind {Kind::Box};
+	Vec3 min, max;              // box (axis-aligned)
+	Vec3 point, normal;         // slab: 0 <= dot(p - point, normal) <= thickness, normal unit length
+	double thickness {0.0};
+	double extinction {0.0};    // per unit length
+};
+
+struct ParticipatingMedia {
+	double extinction {0.0};    // uniform medium filling the scene
+	std::vector<AttenuatingVolume> volumes;
+
+	bool empty() const { return extinction <= 0.0 && volumes.empty(); }
+
+	// Optical depth of origin + s*dir, s in [0, t], for a unit-length dir
+	double opticalDepth(const Vec3& origin, const Vec3& dir, double t) const {
+		double tau = extinction * t;
+		for (const auto& v : volumes) {
+			double lo = 0.0, hi = t;
+			if (v.kind == AttenuatingVolume::Kind::Box) {
+				const double o[3] = {origin.x, origin.y, origin.z}, d[3] = {dir.x, dir.y, dir.z};
+				const double mn[3] = {v.min.x, v.min.y, v.min.z}, mx[3] = {v.max.x, v.max.y, v.max.z};
+				for (int a = 0; a < 3 && lo < hi; ++a) {
+					if (std::fabs(d[a]) < 1e-12) {
+						if (o[a] < mn[a] || o[a] > mx[a]) hi = lo;
+						continue;
+					}
+					double t1 = (mn[a] - o[a]) / d[a], t2 = (mx[a] - o[a]) / d[a];
+					lo = std::max(lo, std::min(t1, t2));
+					hi = std::min(hi, std::max(t1, t2));
+				}
+			} else {
+				double s0 = dot(origin - v.point, v.normal), ds = dot(dir, v.normal);
+				if (std::fabs(ds) < 1e-12) {
+					if (s0 < 0.0 || s0 > v.thickness) hi = lo;
+				} else {
+					double t1 = -s0 / ds, t2 = (v.thickness - s0) / ds;
+					lo = std::max(lo, std::min(t1, t2));
+					hi = std::min(hi, std::max(t1, t2));
+				}
+			}
+			if (hi > lo) tau += v.extinction * (hi - lo);
+		}
+		return tau;
+	}
+};
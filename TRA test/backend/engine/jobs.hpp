@@ -0,0 +1,29 @@
+#pragma once
+
+// Request entry points. Each takes the raw request body and returns the response
+// body; on failure ok is false, the body is an error object and job.status holds
+// the HTTP status.
+
+#include <string>
+#include <string_view>
+
+#include "admission.hpp"
+#include "wire.hpp"
+
+// Negotiate request/response encodings from Content-Type and Accept.
+// "Accept: application/x-tra-binary; scalar=f64" selects float64 results.
+WireFormat negotiateWireFormat(const std::string& contentType, const std::string& accept);
+
+// /calculate
+std::string runCalculation(std::string_view input, WireFormat& wire, JobReport& job, bool& ok);
+
+// /calculate/batch: one base scene plus variations (temperature sets, disabled
+// emitters, swapped blockers). The base geometry is compiled once; temperature-only
+// variations are a mat-vec and blocker swaps reuse every unaffected row.
+std::string runBatchCalculation(std::string_view input, JobReport& job, bool& ok);
+
+// /calculate/transient
+std::string runTransientCalculation(std::string_view input, JobReport& job, bool& ok);
+
+// /solve/separation
+std::string runSeparationSearch(std::string_view input, JobReport& job, bool& ok);
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "geometry.hpp"
+
+// ===== JSON input =====
+// Single-pass reader over a string_view. Each key is read once and dispatched
+// straight into the destination arrays; no substrings are allocated for keys and
+// nothing is rewound. Errors carry the line/column where parsing stopped.
+class JsonReader {
+public:
+	explicit JsonReader(std::string_view text) : s_(text) {}
+
+	size_t position() const { return i_; }
+	bool atEnd() { skipSpaces(); return i_ >= s_.size(); }
+
+	bool fail(const std::string& what) {
+		if (error_.empty()) {
+			errorPos_ = i_;
+			error_ = what;
+		}
+		return false;
+	}
+
+	std::string errorMessage() const {
+		size_t line = 1, col = 1;
+		for (size_t k = 0; k < errorPos_ && k < s_.size(); ++k) {
+			if (s_[k] == '\n') { ++line; col = 1; } else { ++col; }
+		}
+		return error_ + " at line " + std::to_string(line) + ", column " + std::to_string(col) + " (offset " + std::to_string(errorPos_) + ")";
+	}
+
+	void skipSpaces() {
+		while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\n' || s_[i_] == '\r' || s_[i_] == '\t')) ++i_;
+	}
+
+	bool peek(char c) {
+		skipSpaces();
+		return i_ < s_.size() && s_[i_] == c;
+	}
+
+	bool expect(char c) {
+		skipSpaces();
+		if (i_ < s_.size() && s_[i_] == c) { ++i_; return true; }
+		if (c == '"') return fail("Expected string");
+		return fail(std::string("Expected '") + c + "'");
+	}
+
+	// Raw string contents (escapes left in place); see decodeString for names
+	bool readRawString(std::string_view& out) {
+		if (!expect('"')) return false;
+		size_t start = i_;
+		while (i_ < s_.size() && s_[i_] != '"') {
+			if (s_[i_] == '\\') ++i_;
+			++i_;
+		}
+		if (i_ >= s_.size()) return fail("Unterminated string");
+		out = s_.substr(start, i_ - start);
+		++i_;
+		return true;
+	}
+
+	bool readString(std::string& out) {
+		std::string_view raw;
+		return readRawString(raw) && decodeString(raw, out);
+	}
+
+	// Resolve escapes in a raw string (object keys are returned raw by readObject)
+	bool decodeString(std::string_view raw, std::string& out) {
+		out.clear();
+		out.reserve(raw.size());
+		for (size_t k = 0; k < raw.size(); ++k) {
+			char c = raw[k];
+			if (c != '\\' || k + 1 >= raw.size()) { out.push_back(c); continue; }
+			char e = raw[++k];
+			switch (e) {
+				case 'n': out.push_back('\n'); break;
+				case 't': out.push_back('\t'); break;
+				case 'r': out.push_back('\r'); break;
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'u': {
+					if (k + 4 >= raw.size()) return fail("Invalid \\u escape");
+					char hex[5] = {raw[k + 1], raw[k + 2], raw[k + 3], raw[k + 4], '\0'};
+					unsigned cp = static_cast<unsigned>(std::strtoul(hex, nullptr, 16));
+					k += 4;
+					if (cp < 0x80) { out.push_back(static_cast<char>(cp)); }
+					else if (cp < 0x800) { out.push_back(static_cast<char>(0xC0 | (cp >> 6))); out.push_back(static_cast<char>(0x80 | (cp & 0x3F))); }
+					else { out.push_back(static_cast<char>(0xE0 | (cp >> 12))); out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F))); out.push_back(static_cast<char>(0x80 | (cp & 0x3F))); }
+					break;
+				}
+				default: out.push_back(e); break;
+			}
+		}
+		return true;
+	}
+
+	// from_chars: locale-independent and no NUL-terminated copy of the token needed
+	bool readNumber(double& out) {
+		skipSpaces();
+		const char* first = s_.data() + i_;
+		const char* last = s_.data() + s_.size();
+		auto [ptr, ec] = std::from_chars(first, last, out);
+		if (ec != std::errc() || ptr == first) return fail("Expected number");
+		// from_chars also takes "inf" and "nan", which JSON has no place for
+		if (!std::isfinite(out)) return fail("Expected a finite number");
+		i_ += static_cast<size_t>(ptr - first);
+		return true;
+	}
+
+	bool readUInt64(std::uint64_t& out) {
+		skipSpaces();
+		const char* first = s_.data() + i_;
+		const char* last = s_.data() + s_.size();
+		auto [ptr, ec] = std::from_chars(first, last, out);
+		if (ec != std::errc() || ptr == first) return fail("Expected unsigned integer");
+		i_ += static_cast<size_t>(ptr - first);
+		return true;
+	}
+
+	bool readVec3(Vec3& v) {
+		return expect('[') && readNumber(v.x) && expect(',') && readNumber(v.y) && expect(',') && readNumber(v.z) && expect(']');
+	}
+
+	bool readBool(bool& out) {
+		skipSpaces();
+		std::string_view rest = s_.substr(i_);
+		if (rest.substr(0, 4) == "true") { out = true; i_ += 4; return true; }
+		if (rest.substr(0, 5) == "false") { out = false; i_ += 5; return true; }
+		return fail("Expected true or false");
+	}
+
+	// Calls onKey(key) for each member; the callback must consume the value
+	template <class F>
+	bool readObject(F&& onKey) {
+		if (!expect('{')) return false;
+		if (peek('}')) { ++i_; return true; }
+		while (true) {
+			std::string_view key;
+			if (!readRawString(key) || !expect(':')) return false;
+			if (!onKey(key)) return false;
+			skipSpaces();
+			if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+			return expect('}');
+		}
+	}
+
+	// Calls onElement() for each element; the callback must consume it
+	template <class F>
+	bool readArray(F&& onElement) {
+		if (!expect('[')) return false;
+		if (peek(']')) { ++i_; return true; }
+		while (true) {
+			if (!onElement()) return false;
+			skipSpaces();
+			if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+			return expect(']');
+		}
+	}
+
+	// Skip any value (used for unknown keys)
+	bool skipValue() {
+		skipSpaces();
+		if (i_ >= s_.size()) return fail("Unexpected end of input");
+		char c = s_[i_];
+		if (c == '{') return readObject([this](std::string_view) { return skipValue(); });
+		if (c == '[') return readArray([this]() { return skipValue(); });
+		if (c == '"') { std::string_view tmp; return readRawString(tmp); }
+		size_t start = i_;
+		while (i_ < s_.size() && (isNumberChar(s_[i_]) || (s_[i_] >= 'a' && s_[i_] <= 'z'))) ++i_;
+		if (i_ == start) return fail("Unexpected character");
+		return true;
+	}
+
+private:
+	static bool isNumberChar(char c) {
+		return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+	}
+
+	std::string_view s_;
+	size_t i_ {0};
+	std::string error_;
+	size_t errorPos_ {0};
+};
+
+// ===== JSON output =====
+// Appends into one preallocated string; numbers go through to_chars, either
+// shortest round-trip (precision 0) or a fixed number of significant digits.
+class JsonWriter {
+public:
+	JsonWriter(size_t reserveBytes, int precision) : precision_(precision) { out_.reserve(reserveBytes); }
+
+	JsonWriter& raw(std::string_view text) { out_.append(text.data(), text.size()); return *this; }
+	JsonWriter& raw(char c) { out_.push_back(c); return *this; }
+
+	JsonWriter& string(std::string_view text) {
+		out_.push_back('"');
+		for (char c : text) {
+			switch (c) {
+				case '"': out_ += "\\\""; break;
+				case '\\': out_ += "\\\\"; break;
+				case '\n': out_ += "\\n"; break;
+				case '\r': out_ += "\\r"; break;
+				case '\t': out_ += "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char buf[8];
+						std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+						out_ += buf;
+					} else {
+						out_.push_back(c);
+					}
+			}
+		}
+		out_.push_back('"');
+		return *this;
+	}
+
+	JsonWriter& number(double v) {
+		if (!std::isfinite(v)) return raw("null");
+		char buf[32];
+		std::to_chars_result res = precision_ > 0
+			? std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, precision_)
+			: std::to_chars(buf, buf + sizeof(buf), v);
+		out_.append(buf, static_cast<size_t>(res.ptr - buf));
+		return *this;
+	}
+
+	JsonWriter& integer(std::uint64_t v) {
+		char buf[24];
+		auto res = std::to_chars(buf, buf + sizeof(buf), v);
+		out_.append(buf, static_cast<size_t>(res.ptr - buf));
+		return *this;
+	}
+
+	// Worst-case characters per value, used to size the buffer up front
+	static size_t maxNumberChars(int precision) { return precision > 0 ? static_cast<size_t>(precision) + 8 : 25; }
+
+	std::string take() { return std::move(out_); }
+
+private:
+	std::string out_;
+	int precision_;
+};
+
+inline std::string errorJson(const std::string& message) {
+	JsonWriter out(message.size() + 16, 6);
+	out.raw("{\"error\": ").string(message).raw('}');
+	return out.take();
+}
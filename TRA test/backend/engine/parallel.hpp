@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "telemetry.hpp"
+
+// ===== Job control =====
+// Progress and cancellation for an embedded solve. The caller installs a
+// JobControl in t_job (parallelFor hands it to the workers); with none installed
+// every check is one thread-local load. A cancelled job stops taking new indices
+// and leaves the rest default-initialised, so its results must not be cached.
+
+class JobControl {
+public:
+	using Progress = std::function<void(double fraction)>;
+
+	// total: receiver points; progress rises by whole percents, one call at a time
+	JobControl(size_t total, Progress progress, const std::atomic<bool>* cancel)
+		: total_(std::max<size_t>(total, 1)), progress_(std::move(progress)), cancel_(cancel) {}
+
+	bool cancelled() const { return cancel_ && cancel_->load(std::memory_order_relaxed); }
+
+	// units more receiver points are done
+	void advance(size_t units) {
+		if (!progress_) return;
+		const size_t done = done_.fetch_add(units, std::memory_order_relaxed) + units;
+		const size_t percent = std::min<size_t>(done * 100 / total_, 100);
+		if (percent <= reported_.load(std::memory_order_relaxed)) return;
+		report(percent);
+	}
+
+	// Everything done, including work that skipped tracing (cache hits)
+	void finish() {
+		if (progress_) report(100);
+	}
+
+private:
+	void report(size_t percent) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (percent <= reported_.load(std::memory_order_relaxed)) return;
+		reported_.store(percent, std::memory_order_relaxed);
+		progress_(static_cast<double>(percent) / 100.0);
+	}
+
+	const size_t total_;
+	Progress progress_;
+	const std::atomic<bool>* cancel_;
+	std::atomic<size_t> done_ {0};
+	std::atomic<size_t> reported_ {0};
+	std::mutex mutex_;
+};
+
+inline thread_local JobControl* t_job = nullptr;
+
+class ActiveJob {
+public:
+	explicit ActiveJob(JobControl* job) : previous_(t_job) { t_job = job; }
+	~ActiveJob() { t_job = previous_; }
+	ActiveJob(const ActiveJob&) = delete;
+	ActiveJob& operator=(const ActiveJob&) = delete;
+private:
+	JobControl* previous_;
+};
+
+inline bool jobCancelled() { return t_job && t_job->cancelled(); }
+inline void jobAdvance(size_t units) { if (t_job) t_job->advance(units); }
+
+// ===== Worker pool =====
+// One process-wide set of hardware_concurrency() - 1 threads shared by every
+// parallel loop, so concurrent requests and batch jobs do not multiply threads.
+// The caller always works too and only waits for helpers that actually started,
+// which keeps nested and concurrent loops free of deadlocks.
+
+class WorkerPool {
+public:
+	explicit WorkerPool(size_t threads) {
+		threads_.reserve(threads);
+		for (size_t t = 0; t < threads; ++t) threads_.emplace_back([this]() { serve(); });
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		ready_.notify_all();
+		for (auto& t : threads_) t.join();
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t size() const { return threads_.size(); }
+
+	// work() on the caller and on up to `helpers` pool threads; returns when all
+	// of them are done and rethrows the first exception any of them raised
+	void run(size_t helpers, const std::function<void()>& work) {
+		Batch batch {&work, 0, nullptr};
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (size_t h = 0; h < helpers; ++h) queue_.push_back(&batch);
+		}
+		for (size_t h = 0; h < helpers; ++h) ready_.notify_one();
+		try {
+			work();
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!batch.error) batch.error = std::current_exception();
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		queue_.erase(std::remove(queue_.begin(), queue_.end(), &batch), queue_.end());
+		done_.wait(lock, [&]() { return batch.running == 0; });
+		if (batch.error) std::rethrow_exception(batch.error);
+	}
+
+private:
+	struct Batch {
+		const std::function<void()>* work;
+		size_t running {0};
+		std::exception_ptr error;
+	};
+
+	void serve() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			ready_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+			if (stopping_) return;
+			Batch* batch = queue_.front();
+			queue_.pop_front();
+			++batch->running;
+			lock.unlock();
+			std::exception_ptr error;
+			try {
+				(*batch->work)();
+			} catch (...) {
+				error = std::current_exception();
+			}
+			lock.lock();
+			if (error && !batch->error) batch->error = error;
+			if (--batch->running == 0) done_.notify_all();
+		}
+	}
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::condition_variable done_;
+	std::deque<Batch*> queue_;
+	bool stopping_ {false};
+};
+
+// Never destroyed, so loops still running at process exit keep their workers
+inline WorkerPool& workerPool() {
+	static WorkerPool* pool = new WorkerPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return *pool;
+}
+
+// ===== Parallel loops =====
+
+// body(i) for every i in [0, n) on the caller and the shared worker pool. Indices
+// are handed out in chunks from a shared counter; body may only write per-index
+// state. Once the installed job is cancelled no further indices are started.
+template <typename Body>
+void parallelFor(size_t n, Body&& body) {
+	const size_t numThreads = std::min<size_t>(workerPool().size() + 1, n);
+	auto chunkArgs = [](size_t begin, size_t end) {
+		return "{\"first\":" + std::to_string(begin) + ",\"last\":" + std::to_string(end - 1) + "}";
+	};
+	if (numThreads <= 1) {
+		TraceSpan span("parallel", "points (serial)");
+		if (span.active() && n > 0) span.setArgs(chunkArgs(0, n));
+		for (size_t i = 0; i < n && !jobCancelled(); ++i) body(i);
+		return;
+	}
+	const size_t chunk = std::max<size_t>(1, n / (numThreads * 8));
+	std::atomic<size_t> next {0};
+	RequestProfile* profile = t_profile;
+	JobTrace* trace = t_trace;
+	JobControl* job = t_job;
+	const std::function<void()> worker = [&]() {
+		ActiveProfile activeProfile(profile);
+		ActiveTrace activeTrace(trace);
+		ActiveJob activeJob(job);
+		TraceSpan workerSpan("parallel", "worker");
+		for (;;) {
+			size_t begin = next.fetch_add(chunk);
+			if (begin >= n || jobCancelled()) return;
+			size_t end = std::min(n, begin + chunk);
+			TraceSpan chunkSpan("parallel", "points");
+			if (chunkSpan.active()) chunkSpan.setArgs(chunkArgs(begin, end));
+			for (size_t i = begin; i < end; ++i) body(i);
+		}
+	};
+	workerPool().run(numThreads - 1, worker);
+}
@@ -0,0 +1,486 @@
+#include "queries.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "parallel.hpp"
+#include "telemetry.hpp"
+#include "view_factors.hpp"
+
+// ===== Peak search ("query": "max") =====
+// Finds the maximum incident value on each receiver plane without the full grid:
+// a coarse scan of the plane's (s, t) parameter square, then Nelder-Mead from the
+// best few cells in stages whose ray count grows 4x each time. All evaluations on
+// a plane share one seed, so the objective is a fixed (if noisy) surface.
+
+// Continuous parameterisation of a plane's grid: p(s, t) = origin + s*u + t*v,
+// recovered from the grid corners (identical for compact and explicit planes)
+static std::optional<ReceiverGridSpec> planeFrame(const JsonInput& in, const PlaneData& pd) {
+	if (pd.width < 1 || pd.height < 1 || pd.numPoints != pd.width * pd.height) return std::nullopt;
+	const ReceiverPoint& first = in.receiverPoints[pd.firstPoint];
+	ReceiverGridSpec frame;
+	frame.origin = first.origin;
+	frame.normal = first.normal;
+	frame.uAxis = in.receiverPoints[pd.firstPoint + pd.width - 1].origin - first.origin;
+	frame.vAxis = in.receiverPoints[pd.firstPoint + (pd.height - 1) * pd.width].origin - first.origin;
+	frame.haveOrigin = frame.haveUAxis = frame.haveVAxis = frame.haveNormal = true;
+	return frame;
+}
+
+struct PlaneSampler {
+	const JsonInput& in;
+	ReceiverGridSpec frame;
+	std::uint64_t seed;
+	size_t evaluations {0};
+	size_t raysTraced {0};
+
+	PointEstimate operator()(double s, double t, size_t rays) {
+		s = std::clamp(s, 0.0, 1.0);
+		t = std::clamp(t, 0.0, 1.0);
+		++evaluations;
+		raysTraced += rays;
+		ReceiverPoint rp {frame.origin + frame.uAxis * s + frame.vAxis * t, frame.normal};
+		return estimatePointValue(in, rp, seed, rays);
+	}
+};
+
+struct PeakResult {
+	std::string name;
+	double peak {0.0};
+	double stdError {0.0};
+	double s {0.0};
+	double t {0.0};
+	Vec3 location;
+	size_t evaluations {0};
+	size_t raysTraced {0};
+	size_t fullGridRays {0};
+};
+
+// Maximise over the unit square; simplex vertices are clamped into it
+static std::array<double, 3> nelderMeadMax(PlaneSampler& f, double s0, double t0, double size, double tol, size_t rays, int maxIter) {
+	std::array<std::array<double, 3>, 3> simplex = {{
+		{s0, t0, 0.0},
+		{std::clamp(s0 + size, 0.0, 1.0) == s0 ? s0 - size : s0 + size, t0, 0.0},
+		{s0, std::clamp(t0 + size, 0.0, 1.0) == t0 ? t0 - size : t0 + size, 0.0}
+	}};
+	for (auto& v : simplex) {
+		v[0] = std::clamp(v[0], 0.0, 1.0);
+		v[1] = std::clamp(v[1], 0.0, 1.0);
+		v[2] = f(v[0], v[1], rays).value;
+	}
+	auto eval = [&](double s, double t) {
+		s = std::clamp(s, 0.0, 1.0);
+		t = std::clamp(t, 0.0, 1.0);
+		return std::array<double, 3>{s, t, f(s, t, rays).value};
+	};
+	for (int iter = 0; iter < maxIter; ++iter) {
+		std::sort(simplex.begin(), simplex.end(), [](const auto& a, const auto& b) { return a[2] > b[2]; });
+		double spread = std::max(std::fabs(simplex[0][0] - simplex[2][0]), std::fabs(simplex[0][1] - simplex[2][1]));
+		if (spread < tol) break;
+		double cs = 0.5 * (simplex[0][0] + simplex[1][0]);
+		double ct = 0.5 * (simplex[0][1] + simplex[1][1]);
+		auto reflected = eval(cs + (cs - simplex[2][0]), ct + (ct - simplex[2][1]));
+		if (reflected[2] > simplex[0][2]) {
+			auto expanded = eval(cs + 2.0 * (cs - simplex[2][0]), ct + 2.0 * (ct - simplex[2][1]));
+			simplex[2] = expanded[2] > reflected[2] ? expanded : reflected;
+		} else if (reflected[2] > simplex[1][2]) {
+			simplex[2] = reflected;
+		} else {
+			auto contracted = eval(cs + 0.5 * (simplex[2][0] - cs), ct + 0.5 * (simplex[2][1] - ct));
+			if (contracted[2] > simplex[2][2]) {
+				simplex[2] = contracted;
+			} else {
+				for (int k = 1; k < 3; ++k) {
+					simplex[k] = eval(simplex[0][0] + 0.5 * (simplex[k][0] - simplex[0][0]), simplex[0][1] + 0.5 * (simplex[k][1] - simplex[0][1]));
+				}
+			}
+		}
+	}
+	std::sort(simplex.begin(), simplex.end(), [](const auto& a, const auto& b) { return a[2] > b[2]; });
+	return simplex[0];
+}
+
+static PeakResult findPlanePeak(const JsonInput& in, const std::string& name, const PlaneData& pd, std::uint64_t seed) {
+	PeakResult result;
+	result.name = name;
+	result.fullGridRays = pd.numPoints * in.numRays;
+	auto frame = planeFrame(in, pd);
+	const size_t fullRays = std::max<size_t>(in.numRays, 1);
+	if (!frame) {
+		// Not a regular grid: fall back to scanning the given points
+		size_t bestIdx = pd.firstPoint;
+		result.peak = -std::numeric_limits<double>::infinity();
+		for (size_t k = 0; k < pd.numPoints; ++k) {
+			size_t idx = pd.firstPoint + k;
+			PointEstimate est = estimatePointValue(in, in.receiverPoints[idx], pointSeedFor(seed, idx), fullRays);
+			if (est.value > result.peak) {
+				result.peak = est.value;
+				result.stdError = est.stdError;
+				bestIdx = idx;
+			}
+		}
+		result.location = in.receiverPoints[bestIdx].origin;
+		result.evaluations = pd.numPoints;
+		result.raysTraced = pd.numPoints * fullRays;
+		return result;
+	}
+
+	PlaneSampler f {in, *frame, seed};
+	const size_t coarseRays = std::max<size_t>(std::min<size_t>(fullRays, 500), fullRays / 32);
+	const size_t nu = std::min<size_t>(std::max<size_t>(pd.width, 2), 6);
+	const size_t nv = std::min<size_t>(std::max<size_t>(pd.height, 2), 6);
+
+	// Coarse scan
+	std::vector<std::array<double, 3>> scan;
+	for (size_t j = 0; j < nv; ++j) {
+		for (size_t i = 0; i < nu; ++i) {
+			double s = static_cast<double>(i) / static_cast<double>(nu - 1);
+			double t = static_cast<double>(j) / static_cast<double>(nv - 1);
+			scan.push_back({s, t, f(s, t, coarseRays).value});
+		}
+	}
+	std::sort(scan.begin(), scan.end(), [](const auto& a, const auto& b) { return a[2] > b[2]; });
+
+	// Local refinement: every candidate at the coarse ray count, then only the
+	// best one as the ray count grows. Resolution beyond a quarter grid cell is
+	// not worth the rays.
+	const double cell = 1.0 / static_cast<double>(std::max<size_t>(std::max(pd.width, pd.height), 2) - 1);
+	const double tol = 0.25 * cell;
+	double size = 1.0 / static_cast<double>(std::max(nu, nv) - 1);
+	std::array<double, 3> best = scan.front();
+	best[2] = -std::numeric_limits<double>::infinity();
+	const size_t numStarts = std::min<size_t>(3, scan.size());
+	for (size_t c = 0; c < numStarts; ++c) {
+		std::array<double, 3> cur = nelderMeadMax(f, scan[c][0], scan[c][1], size, tol, coarseRays, 20);
+		if (cur[2] > best[2]) best = cur;
+	}
+	for (size_t rays = std::min(fullRays, coarseRays * 4); rays > coarseRays; rays = std::min(fullRays, rays * 4)) {
+		size = std::max(0.5 * size, 2.0 * tol);
+		best = nelderMeadMax(f, best[0], best[1], size, tol, rays, 10);
+		if (rays >= fullRays) break;
+	}
+
+	// Report the winner at the full ray count
+	PointEstimate final = f(best[0], best[1], fullRays);
+	result.peak = final.value;
+	result.stdError = final.stdError;
+	result.s = best[0];
+	result.t = best[1];
+	result.location = frame->origin + frame->uAxis * best[0] + frame->vAxis * best[1];
+	result.evaluations = f.evaluations;
+	result.raysTraced = f.raysTraced;
+	return result;
+}
+
+std::string runPeakQuery(const JsonInput& in) {
+	StageTimer timer(Stage::Trace);
+	const std::uint64_t seed = resolveSeed(in);
+	std::vector<PeakResult> peaks;
+	for (const auto& planePair : in.planeDataMap) {
+		TraceSpan span("plane", planePair.first);
+		peaks.push_back(findPlanePeak(in, planePair.first, planePair.second, seed));
+		const PeakResult& p = peaks.back();
+		LogRecord(LogLevel::Info, "Peak found").field("plane", p.name).field("peak", p.peak).field("std_error", p.stdError)
+			.field("evaluations", p.evaluations).field("rays", p.raysTraced).field("full_grid_rays", p.fullGridRays);
+	}
+
+	JsonWriter out(128 + peaks.size() * 256, in.precision);
+	out.raw("{\"success\":true,\"query\":\"max\",\"planes\":[");
+	for (size_t k = 0; k < peaks.size(); ++k) {
+		const PeakResult& p = peaks[k];
+		if (k > 0) out.raw(',');
+		out.raw("{\"name\":").string(p.name);
+		out.raw(",\"peak\":").number(p.peak);
+		out.raw(",\"std_error\":").number(p.stdError);
+		out.raw(",\"location\":[").number(p.location.x).raw(',').number(p.location.y).raw(',').number(p.location.z).raw(']');
+		out.raw(",\"s\":").number(p.s).raw(",\"t\":").number(p.t);
+		out.raw(",\"evaluations\":").integer(p.evaluations);
+		out.raw(",\"rays_traced\":").integer(p.raysTraced);
+		out.raw(",\"full_grid_rays\":").integer(p.fullGridRays).raw('}');
+	}
+	out.raw("]}");
+	return out.take();
+}
+
+// ===== Threshold exceedance ("query": "exceedance") =====
+// Area of each plane where the value exceeds "threshold", plus the region
+// outline. The plane's grid is the target resolution, but only cells whose
+// corners straddle the threshold are subdivided; uniform blocks are filled in
+// without tracing. Marching squares then places each crossing on a cell edge by
+// bisection. Features smaller than the initial block (8 cells) whose corners all
+// lie on one side can be missed.
+
+struct ExceedanceResult {
+	std::string name;
+	double area {0.0};
+	double planeArea {0.0};
+	std::vector<std::vector<Vec3>> regions;
+	size_t evaluations {0};
+	size_t raysTraced {0};
+	size_t fullGridRays {0};
+};
+
+class ExceedanceTracer {
+public:
+	ExceedanceTracer(const JsonInput& in, const PlaneData& pd, const ReceiverGridSpec& frame, double threshold, std::uint64_t seed)
+		: w_(pd.width), h_(pd.height), threshold_(threshold), rays_(std::max<size_t>(in.numRays, 1)), f_ {in, frame, seed},
+		  values_(w_ * h_, 0.0), state_(w_ * h_, kUnknown) {}
+
+	void run(ExceedanceResult& result) {
+		const size_t block = 8;
+		for (size_t j0 = 0; j0 + 1 < h_; j0 += block) {
+			for (size_t i0 = 0; i0 + 1 < w_; i0 += block) {
+				refine(i0, std::min(i0 + block, w_ - 1), j0, std::min(j0 + block, h_ - 1));
+			}
+		}
+		for (const auto& cell : uniform_) fill(cell);
+		traceSegments();
+		joinLoops(result);
+		result.evaluations = f_.evaluations;
+		result.raysTraced = f_.raysTraced;
+	}
+
+private:
+	enum : std::uint8_t { kUnknown, kEvaluated, kInferred };
+	struct Block { size_t i0, i1, j0, j1; };
+	struct St { double s, t; };
+
+	// Keys for contour vertices: lattice nodes and crossings on horizontal/vertical edges
+	std::uint64_t nodeKey(size_t i, size_t j) const { return (std::uint64_t(0) << 62) | (j * w_ + i); }
+	std::uint64_t hEdgeKey(size_t i, size_t j) const { return (std::uint64_t(1) << 62) | (j * w_ + i); }
+	std::uint64_t vEdgeKey(size_t i, size_t j) const { return (std::uint64_t(2) << 62) | (j * w_ + i); }
+
+	St nodeSt(size_t i, size_t j) const {
+		return {static_cast<double>(i) / static_cast<double>(w_ - 1), static_cast<double>(j) / static_cast<double>(h_ - 1)};
+	}
+
+	double node(size_t i, size_t j) {
+		size_t idx = j * w_ + i;
+		if (state_[idx] != kEvaluated) {
+			St p = nodeSt(i, j);
+			values_[idx] = f_(p.s, p.t, rays_).value;
+			state_[idx] = kEvaluated;
+		}
+		return values_[idx];
+	}
+
+	bool above(size_t i, size_t j) const { return values_[j * w_ + i] > threshold_; }
+
+	void refine(size_t i0, size_t i1, size_t j0, size_t j1) {
+		bool a = node(i0, j0) > threshold_, b = node(i1, j0) > threshold_;
+		bool c = node(i1, j1) > threshold_, d = node(i0, j1) > threshold_;
+		if (i1 - i0 <= 1 && j1 - j0 <= 1) return;
+		if (a == b && b == c && c == d) {
+			uniform_.push_back({i0, i1, j0, j1});
+			return;
+		}
+		size_t im = (i0 + i1) / 2, jm = (j0 + j1) / 2;
+		if (i1 - i0 <= 1) {
+			refine(i0, i1, j0, jm);
+			refine(i0, i1, jm, j1);
+		} else if (j1 - j0 <= 1) {
+			refine(i0, im, j0, j1);
+			refine(im, i1, j0, j1);
+		} else {
+			refine(i0, im, j0, jm);
+			refine(im, i1, j0, jm);
+			refine(i0, im, jm, j1);
+			refine(im, i1, jm, j1);
+		}
+	}
+
+	void fill(const Block& b) {
+		double v = 0.25 * (values_[b.j0 * w_ + b.i0] + values_[b.j0 * w_ + b.i1] + values_[b.j1 * w_ + b.i1] + values_[b.j1 * w_ + b.i0]);
+		for (size_t j = b.j0; j <= b.j1; ++j) {
+			for (size_t i = b.i0; i <= b.i1; ++i) {
+				if (state_[j * w_ + i] == kUnknown) {
+					values_[j * w_ + i] = v;
+					state_[j * w_ + i] = kInferred;
+				}
+			}
+		}
+	}
+
+	// Threshold crossing between two adjacent nodes of opposite sign
+	std::uint64_t crossing(size_t ia, size_t ja, size_t ib, size_t jb) {
+		std::uint64_t key = ja == jb ? hEdgeKey(std::min(ia, ib), ja) : vEdgeKey(ia, std::min(ja, jb));
+		if (points_.count(key)) return key;
+		St lo = nodeSt(ia, ja), hi = nodeSt(ib, jb);
+		bool loAbove = above(ia, ja);
+		for (int step = 0; step < kBisectionSteps; ++step) {
+			St mid {0.5 * (lo.s + hi.s), 0.5 * (lo.t + hi.t)};
+			if ((f_(mid.s, mid.t, rays_).value > threshold_) == loAbove) lo = mid; else hi = mid;
+		}
+		points_[key] = {0.5 * (lo.s + hi.s), 0.5 * (lo.t + hi.t)};
+		return key;
+	}
+
+	std::uint64_t vertex(size_t i, size_t j) {
+		std::uint64_t key = nodeKey(i, j);
+		points_[key] = nodeSt(i, j);
+		return key;
+	}
+
+	// Oriented segments with the exceedance region on the left (CCW in s, t)
+	void traceSegments() {
+		for (size_t j = 0; j + 1 < h_; ++j) {
+			for (size_t i = 0; i + 1 < w_; ++i) {
+				// Corners in CCW order and the crossing on the edge leaving each
+				const std::array<std::pair<size_t, size_t>, 4> corner = {{{i, j}, {i + 1, j}, {i + 1, j + 1}, {i, j + 1}}};
+				std::array<bool, 4> in;
+				for (int k = 0; k < 4; ++k) in[k] = above(corner[k].first, corner[k].second);
+				std::vector<std::uint64_t> exits, entries;
+				std::array<int, 4> edgeOf {};
+				for (int k = 0; k < 4; ++k) {
+					const auto& a = corner[k];
+					const auto& b = corner[(k + 1) % 4];
+					if (in[k] == in[(k + 1) % 4]) continue;
+					std::uint64_t key = crossing(a.first, a.second, b.first, b.second);
+					(in[k] ? exits : entries).push_back(key);
+					edgeOf[k] = 1;
+				}
+				if (exits.size() == 1) {
+					segments_.push_back({exits[0], entries[0]});
+				} else if (exits.size() == 2) {
+					// Saddle: the centre estimate decides whether the two high corners connect
+					double centre = 0.0;
+					for (const auto& c : corner) centre += values_[c.second * w_ + c.first];
+					bool connected = centre * 0.25 > threshold_;
+					// Crossings alternate exit/entry going CCW; pair each exit with the next
+					// entry when connected, otherwise with the previous one
+					bool exitFirst = in[0];
+					if (connected == exitFirst) {
+						segments_.push_back({exits[0], entries[0]});
+						segments_.push_back({exits[1], entries[1]});
+					} else {
+						segments_.push_back({exits[0], entries[1]});
+						segments_.push_back({exits[1], entries[0]});
+					}
+				}
+			}
+		}
+
+		// Close regions along the plane border, walking it CCW
+		std::vector<std::pair<size_t, size_t>> border;
+		for (size_t i = 0; i + 1 < w_; ++i) border.push_back({i, 0});
+		for (size_t j = 0; j + 1 < h_; ++j) border.push_back({w_ - 1, j});
+		for (size_t i = w_ - 1; i > 0; --i) border.push_back({i, h_ - 1});
+		for (size_t j = h_ - 1; j > 0; --j) border.push_back({0, j});
+		for (size_t k = 0; k < border.size(); ++k) {
+			auto a = border[k], b = border[(k + 1) % border.size()];
+			bool inA = above(a.first, a.second), inB = above(b.first, b.second);
+			if (inA && inB) segments_.push_back({vertex(a.first, a.second), vertex(b.first, b.second)});
+			else if (inA) segments_.push_back({vertex(a.first, a.second), crossing(a.first, a.second, b.first, b.second)});
+			else if (inB) segments_.push_back({crossing(a.first, a.second, b.first, b.second), vertex(b.first, b.second)});
+		}
+	}
+
+	void joinLoops(ExceedanceResult& result) {
+		std::map<std::uint64_t, size_t> outgoing;
+		for (size_t k = 0; k < segments_.size(); ++k) outgoing[segments_[k].first] = k;
+		std::vector<bool> used(segments_.size(), false);
+		const ReceiverGridSpec& frame = f_.frame;
+		double signedArea = 0.0;
+		for (size_t start = 0; start < segments_.size(); ++start) {
+			if (used[start]) continue;
+			std::vector<St> loop;
+			for (size_t k = start; !used[k];) {
+				used[k] = true;
+				loop.push_back(points_[segments_[k].first]);
+				auto next = outgoing.find(segments_[k].second);
+				if (next == outgoing.end()) break;
+				k = next->second;
+			}
+			double loopArea = 0.0;
+			std::vector<Vec3> outline;
+			for (size_t k = 0; k < loop.size(); ++k) {
+				const St& p = loop[k];
+				const St& q = loop[(k + 1) % loop.size()];
+				loopArea += p.s * q.t - q.s * p.t;
+				outline.push_back(frame.origin + frame.uAxis * p.s + frame.vAxis * p.t);
+			}
+			signedArea += 0.5 * loopArea;
+			result.regions.push_back(std::move(outline));
+		}
+		result.planeArea = length(cross(frame.uAxis, frame.vAxis));
+		result.area = std::max(0.0, signedArea) * result.planeArea;
+	}
+
+	static constexpr int kBisectionSteps = 4;
+
+	size_t w_, h_;
+	double threshold_;
+	size_t rays_;
+	PlaneSampler f_;
+	std::vector<double> values_;
+	std::vector<std::uint8_t> state_;
+	std::vector<Block> uniform_;
+	std::map<std::uint64_t, St> points_;
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> segments_;
+};
+
+std::string runExceedanceQuery(const JsonInput& in, bool& ok) {
+	StageTimer timer(Stage::Trace);
+	if (!in.threshold) {
+		ok = false;
+		return errorJson("Exceedance query requires 'threshold'");
+	}
+	const std::uint64_t seed = resolveSeed(in);
+	std::vector<ExceedanceResult> results;
+	for (const auto& planePair : in.planeDataMap) {
+		TraceSpan span("plane", planePair.first);
+		const PlaneData& pd = planePair.second;
+		auto frame = planeFrame(in, pd);
+		if (!frame || pd.width < 2 || pd.height < 2) {
+			ok = false;
+			return errorJson("Exceedance query needs a regular grid of at least 2x2 on plane '" + planePair.first + "'");
+		}
+		ExceedanceResult result;
+		result.name = planePair.first;
+		result.fullGridRays = pd.numPoints * in.numRays;
+		ExceedanceTracer(in, pd, *frame, *in.threshold, seed).run(result);
+		LogRecord(LogLevel::Info, "Exceedance traced").field("plane", result.name).field("area", result.area)
+			.field("plane_area", result.planeArea).field("evaluations", result.evaluations).field("rays", result.raysTraced)
+			.field("full_grid_rays", result.fullGridRays);
+		results.push_back(std::move(result));
+	}
+
+	size_t vertices = 0;
+	for (const auto& r : results) for (const auto& loop : r.regions) vertices += loop.size();
+	JsonWriter out(256 + results.size() * 256 + vertices * 3 * static_cast<size_t>(JsonWriter::maxNumberChars(in.precision) + 1), in.precision);
+	out.raw("{\"success\":true,\"query\":\"exceedance\",\"threshold\":").number(*in.threshold).raw(",\"planes\":[");
+	for (size_t k = 0; k < results.size(); ++k) {
+		const ExceedanceResult& r = results[k];
+		if (k > 0) out.raw(',');
+		out.raw("{\"name\":").string(r.name);
+		out.raw(",\"area\":").number(r.area);
+		out.raw(",\"plane_area\":").number(r.planeArea);
+		out.raw(",\"fraction\":").number(r.planeArea > 0.0 ? r.area / r.planeArea : 0.0);
+		out.raw(",\"regions\":[");
+		for (size_t l = 0; l < r.regions.size(); ++l) {
+			if (l > 0) out.raw(',');
+			out.raw('[');
+			for (size_t v = 0; v < r.regions[l].size(); ++v) {
+				const Vec3& p = r.regions[l][v];
+				if (v > 0) out.raw(',');
+				out.raw('[').number(p.x).raw(',').number(p.y).raw(',').number(p.z).raw(']');
+			}
+			out.raw(']');
+		}
+		out.raw("],\"evaluations\":").integer(r.evaluations);
+		out.raw(",\"rays_traced\":").integer(r.raysTraced);
+		out.raw(",\"full_grid_rays\":").integer(r.fullGridRays).raw('}');
+	}
+	out.raw("]}");
+	ok = true;
+	return out.take();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Reduced /calculate queries: the peak value per plane ("max") and the area above
+// a threshold ("exceedance"). Both return the response body.
+
+#include <string>
+
+#include "scene.hpp"
+
+std::string runPeakQuery(const JsonInput& in);
+std::string runExceedanceQuery(const JsonInput& in, bool& ok);
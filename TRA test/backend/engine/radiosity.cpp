@@ -0,0 +1,337 @@
+#include "radiosity.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+
+#include "parallel.hpp"
+#include "telemetry.hpp"
+#include "view_factors.hpp"
+
+bool reflectionsActive(const JsonInput& in) {
+	if (!in.reflections) return false;
+	for (double rho : in.inertReflectivity) if (rho > 0.0) return true;
+	return false;
+}
+
+static size_t triangleDivisions(const Vec3& a, const Vec3& b, const Vec3& c, double patchSize) {
+	double longest = std::max({length(b - a), length(c - b), length(a - c)});
+	return static_cast<size_t>(std::clamp(std::ceil(longest / patchSize), 1.0, 256.0));
+}
+
+static bool isReflective(const JsonInput& in, size_t p) {
+	return p < in.inertReflectivity.size() && in.inertReflectivity[p] > 0.0;
+}
+
+size_t reflectiveTriangleCount(const JsonInput& in) {
+	size_t count = 0;
+	for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+		const auto& verts = in.inertPolygons[p];
+		if (isReflective(in, p) && getPolygonPlane(verts)) count += verts.size() - 2;
+	}
+	return count;
+}
+
+RadiosityScene buildRadiosityScene(const JsonInput& in, const ReflectionSettings& settings) {
+	StageTimer timer(Stage::Scene);
+	// Every triangle needs at least one patch, so stop growing once they all have one
+	const size_t triangles = reflectiveTriangleCount(in);
+	double patchSize = settings.patchSize;
+	for (;;) {
+		size_t count = 0;
+		for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+			const auto& verts = in.inertPolygons[p];
+			if (!isReflective(in, p) || !getPolygonPlane(verts)) continue;
+			for (size_t k = 1; k + 1 < verts.size(); ++k) {
+				size_t n = triangleDivisions(verts[0], verts[k], verts[k + 1], patchSize);
+				count += n * n;
+			}
+		}
+		if (count <= settings.maxPatches || count <= triangles) break;
+		patchSize *= 1.25;
+	}
+
+	RadiosityScene scene;
+	scene.media = in.media;
+	scene.emitterPolygons = in.polygons;
+	scene.columnStart = emitterColumnStart(in.polygons);
+	auto surfaceOf = [](const std::vector<Vec3>& verts, std::vector<RadiosityScene::Surface>& list) {
+		auto plane = getPolygonPlane(verts);
+		if (plane) list.push_back({verts, plane->normal, plane->point});
+		return plane.has_value();
+	};
+	for (const auto& poly : in.polygons) {
+		// Keep emitter indices aligned even for degenerate polygons
+		if (!surfaceOf(poly.vertices, scene.emitters)) scene.emitters.push_back({{}, {0, 0, 0}, {0, 0, 0}});
+	}
+	for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+		const auto& verts = in.inertPolygons[p];
+		if (!isReflective(in, p)) {
+			surfaceOf(verts, scene.blockers);
+			continue;
+		}
+		if (!surfaceOf(verts, scene.reflectors)) continue;
+		const Vec3 normal = scene.reflectors.back().normal;
+		std::vector<PatchedTriangle> fan;
+		for (size_t k = 1; k + 1 < verts.size(); ++k) {
+			PatchedTriangle tri;
+			tri.a = verts[0];
+			tri.e1 = verts[k] - verts[0];
+			tri.e2 = verts[k + 1] - verts[0];
+			const size_t n = triangleDivisions(verts[0], verts[k], verts[k + 1], patchSize);
+			tri.divisions = n;
+			tri.up.assign(n * n, 0);
+			tri.down.assign(n * n, 0);
+			Vec3 du = tri.e1 / static_cast<double>(n), dv = tri.e2 / static_cast<double>(n);
+			auto at = [&](size_t i, size_t j) { return tri.a + du * static_cast<double>(i) + dv * static_cast<double>(j); };
+			for (size_t j = 0; j < n; ++j) {
+				for (size_t i = 0; i + j < n; ++i) {
+					tri.up[j * n + i] = static_cast<std::uint32_t>(scene.patches.size());
+					scene.patches.push_back({{at(i, j), at(i + 1, j), at(i, j + 1)}, normal, in.inertReflectivity[p]});
+					if (i + j + 1 < n) {
+						tri.down[j * n + i] = static_cast<std::uint32_t>(scene.patches.size());
+						scene.patches.push_back({{at(i + 1, j), at(i + 1, j + 1), at(i, j + 1)}, normal, in.inertReflectivity[p]});
+					}
+				}
+			}
+			fan.push_back(std::move(tri));
+		}
+		scene.triangles.push_back(std::move(fan));
+	}
+	return scene;
+}
+
+// Patch containing a point on the reflector's plane, if any
+static std::optional<size_t> locatePatch(const std::vector<PatchedTriangle>& fan, const Vec3& hit) {
+	for (const auto& tri : fan) {
+		Vec3 d = hit - tri.a;
+		double d11 = dot(tri.e1, tri.e1), d12 = dot(tri.e1, tri.e2), d22 = dot(tri.e2, tri.e2);
+		double denom = d11 * d22 - d12 * d12;
+		if (std::fabs(denom) < 1e-18) continue;
+		double p1 = dot(d, tri.e1), p2 = dot(d, tri.e2);
+		double u = (d22 * p1 - d12 * p2) / denom;
+		double v = (d11 * p2 - d12 * p1) / denom;
+		if (u < -1e-9 || v < -1e-9 || u + v > 1.0 + 1e-9) continue;
+		const size_t n = tri.divisions;
+		double un = std::clamp(u, 0.0, 1.0) * static_cast<double>(n), vn = std::clamp(v, 0.0, 1.0) * static_cast<double>(n);
+		size_t i = std::min(static_cast<size_t>(un), n - 1), j = std::min(static_cast<size_t>(vn), n - 1);
+		if (i + j >= n) {
+			// Rounding on the hypotenuse: step back into the last row of cells
+			if (i > 0) --i; else --j;
+		}
+		bool upper = (un - static_cast<double>(i)) + (vn - static_cast<double>(j)) > 1.0 && i + j + 1 < n;
+		return upper ? tri.down[j * n + i] : tri.up[j * n + i];
+	}
+	return std::nullopt;
+}
+
+// Casts rays from one origin and adds weight/numRays per first hit (times the
+// transmittance) into row. Columns: emitters, then patch sides (the side facing the origin).
+template <typename Attenuation>
+static void traceRadiosityRowWith(
+	const RadiosityScene& scene, const Vec3& origin, const Vec3& normal, size_t numRays, std::mt19937_64& rng,
+	double weight, std::vector<double>& row, const Attenuation& attenuate
+) {
+	const size_t numEmitters = scene.emitters.size();
+	const double w = weight / static_cast<double>(std::max<size_t>(numRays, 1));
+	ProfileLap lap;
+	std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, normal, rng);
+	lap.mark(ProfileStage::RayGeneration);
+	const size_t numSurfaces = scene.blockers.size() + numEmitters + scene.reflectors.size();
+	countTraced(numRays, numSurfaces);
+	size_t insideTests = 0, hits = 0;
+	for (const Vec3& dir : rays) {
+		double closest = std::numeric_limits<double>::infinity();
+		long column = -1;    // -1 nothing, otherwise emitter index or numEmitters + reflector index
+		Vec3 closestHit;
+		auto test = [&](const RadiosityScene::Surface& surf, long id) {
+			if (surf.verts.empty()) return;
+			auto [hit, t] = rayPlaneIntersect(origin, dir, surf.normal, surf.point);
+			if (!hit || t >= closest) return;
+			++insideTests;
+			if (!isPointInPolygon3D(*hit, surf.verts, surf.normal)) return;
+			closest = t;
+			column = id;
+			closestHit = *hit;
+		};
+		for (const auto& surf : scene.blockers) test(surf, -1);
+		for (size_t e = 0; e < numEmitters; ++e) test(scene.emitters[e], static_cast<long>(e));
+		for (size_t r = 0; r < scene.reflectors.size(); ++r) test(scene.reflectors[r], static_cast<long>(numEmitters + r));
+		if (column < 0) continue;
+		++hits;
+		const double hitWeight = w * attenuate(origin, dir, closest);
+		if (static_cast<size_t>(column) < numEmitters) {
+			const size_t e = static_cast<size_t>(column);
+			addEmitterHit(scene.emitterPolygons[e], scene.columnStart[e], closestHit, hitWeight, row);
+			continue;
+		}
+		size_t r = static_cast<size_t>(column) - numEmitters;
+		if (auto patch = locatePatch(scene.triangles[r], closestHit)) {
+			size_t side = dot(origin - closestHit, scene.reflectors[r].normal) >= 0.0 ? 0 : 1;
+			row[scene.patchColumn(2 * *patch + side)] += hitWeight;
+		}
+	}
+	lap.mark(ProfileStage::Intersection);
+	profileCounts(numRays, numRays * numSurfaces, insideTests, hits);
+}
+
+static void traceRadiosityRow(
+	const RadiosityScene& scene, const Vec3& origin, const Vec3& normal, size_t numRays, std::mt19937_64& rng,
+	double weight, std::vector<double>& row
+) {
+	if (scene.media.empty()) traceRadiosityRowWith(scene, origin, normal, numRays, rng, weight, row, NoAttenuation{});
+	else traceRadiosityRowWith(scene, origin, normal, numRays, rng, weight, row, MediumAttenuation{scene.media});
+}
+
+static std::shared_ptr<ViewFactorMatrix> packRows(std::vector<SparseRow>& rows, size_t numColumns, std::uint64_t seed) {
+	auto m = std::make_shared<ViewFactorMatrix>();
+	m->numPoints = rows.size();
+	m->numEmitters = numColumns;
+	m->seed = seed;
+	m->rowStart.push_back(0);
+	appendSparseRows(*m, rows);
+	return m;
+}
+
+// Rows: patch sides; columns: emitters, then patch sides
+static std::shared_ptr<ViewFactorMatrix> buildPatchTransferMatrix(const RadiosityScene& scene, const ReflectionSettings& settings, std::uint64_t seed) {
+	StageTimer timer(Stage::Trace);
+	const size_t numColumns = scene.patchColumn(2 * scene.patches.size());
+	const size_t samples = 8;
+	const size_t raysPerSample = std::max<size_t>(1, settings.raysPerPatch / samples);
+	std::vector<SparseRow> rows(2 * scene.patches.size());
+	parallelFor(rows.size(), [&](size_t unknown) {
+		const ReflectivePatch& patch = scene.patches[unknown / 2];
+		const Vec3 normal = unknown % 2 == 0 ? patch.normal : patch.normal * -1.0;
+		std::mt19937_64 rng(pointSeedFor(seed ^ 0x9e3779b97f4a7c15ull, unknown));
+		std::uniform_real_distribution<double> dist(0.0, 1.0);
+		std::vector<double> row(numColumns, 0.0);
+		for (size_t s = 0; s < samples; ++s) {
+			// Uniform point in the triangle, nudged off the surface
+			double r1 = std::sqrt(dist(rng)), r2 = dist(rng);
+			Vec3 point = patch.vertices[0] * (1.0 - r1) + patch.vertices[1] * (r1 * (1.0 - r2)) + patch.vertices[2] * (r1 * r2);
+			traceRadiosityRow(scene, point + normal * 1e-6, normal, raysPerSample, rng, 1.0 / static_cast<double>(samples), row);
+		}
+		rows[unknown] = sparsifyRow(row);
+	});
+	return packRows(rows, numColumns, seed);
+}
+
+// Rows: receiver points (same per-point streams as the direct matrix)
+static std::shared_ptr<ViewFactorMatrix> buildReceiverTransferMatrix(const JsonInput& in, const RadiosityScene& scene, std::uint64_t seed) {
+	StageTimer timer(Stage::Trace);
+	const size_t numColumns = scene.patchColumn(2 * scene.patches.size());
+	std::vector<SparseRow> rows(in.receiverPoints.size());
+	parallelFor(rows.size(), [&](size_t pointIdx) {
+		std::mt19937_64 rng(pointSeedFor(seed, pointIdx));
+		std::vector<double> row(numColumns, 0.0);
+		traceRadiosityRow(scene, in.receiverPoints[pointIdx].origin, in.receiverPoints[pointIdx].normal, in.numRays, rng, 1.0, row);
+		rows[pointIdx] = sparsifyRow(row);
+		jobAdvance(1);
+	});
+	return packRows(rows, numColumns, seed);
+}
+
+// Cache keys for the two radiosity matrices; reflectivity only decides which
+// polygons are patched, its value enters at solve time
+static GeometryKey hashRadiosityScene(const JsonInput& in, const RadiosityScene& scene, const ReflectionSettings& settings, bool receivers) {
+	GeometryHasher h;
+	h.add(static_cast<std::uint64_t>(receivers ? 0x7265636569766572ull : 0x7061746368657321ull));
+	if (receivers) {
+		for (const auto& rp : in.receiverPoints) { h.add(rp.origin); h.add(rp.normal); }
+		h.add(static_cast<std::uint64_t>(in.numRays));
+	} else {
+		h.add(static_cast<std::uint64_t>(settings.raysPerPatch));
+	}
+	for (const auto& poly : in.polygons) h.add(poly);
+	for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+		h.add(in.inertPolygons[p]);
+		h.add(isReflective(in, p) ? 1.0 : 0.0);
+	}
+	h.add(static_cast<std::uint64_t>(scene.patches.size()));
+	h.add(in.media);
+	h.add(static_cast<std::uint64_t>(in.seed.has_value() ? 1 : 0));
+	h.add(static_cast<std::uint64_t>(in.seed.value_or(0)));
+	return h.key();
+}
+
+// Gauss-Seidel on J = b + diag(rho) F J; stops when a sweep changes no unknown by
+// more than tolerance relative to the largest radiosity
+static std::vector<double> solveRadiosity(
+	const ViewFactorMatrix& transfer, const RadiosityScene& scene, const std::vector<double>& emitterColumns,
+	const ReflectionSettings& settings, RadiosityStats& stats
+) {
+	StageTimer timer(Stage::Solve);
+	const size_t numEmitters = emitterColumns.size();
+	const size_t numUnknowns = transfer.numPoints;
+	std::vector<double> source(numUnknowns, 0.0);
+	for (size_t i = 0; i < numUnknowns; ++i) {
+		for (size_t k = transfer.rowStart[i]; k < transfer.rowStart[i + 1]; ++k) {
+			if (transfer.emitterIdx[k] < numEmitters) source[i] += transfer.factors[k] * emitterColumns[transfer.emitterIdx[k]];
+		}
+		source[i] *= scene.patches[i / 2].reflectivity;
+	}
+
+	std::vector<double> radiosity = source;
+	stats.patches = scene.patches.size();
+	stats.iterations = 0;
+	while (stats.iterations < settings.maxIterations) {
+		++stats.iterations;
+		double maxChange = 0.0, maxValue = 0.0;
+		for (size_t i = 0; i < numUnknowns; ++i) {
+			double incident = 0.0;
+			for (size_t k = transfer.rowStart[i]; k < transfer.rowStart[i + 1]; ++k) {
+				if (transfer.emitterIdx[k] >= numEmitters) incident += transfer.factors[k] * radiosity[transfer.emitterIdx[k] - numEmitters];
+			}
+			double updated = source[i] + scene.patches[i / 2].reflectivity * incident;
+			maxChange = std::max(maxChange, std::fabs(updated - radiosity[i]));
+			maxValue = std::max(maxValue, std::fabs(updated));
+			radiosity[i] = updated;
+		}
+		stats.residual = maxValue > 0.0 ? maxChange / maxValue : 0.0;
+		if (stats.residual <= settings.tolerance) {
+			stats.converged = true;
+			break;
+		}
+	}
+	return radiosity;
+}
+
+static std::shared_ptr<const ViewFactorMatrix> cachedOrBuilt(const GeometryKey& key, const std::function<std::shared_ptr<ViewFactorMatrix>()>& build) {
+	if (auto cached = g_viewFactorCache.find(key)) return cached;
+	std::shared_ptr<const ViewFactorMatrix> matrix = build();
+	if (!jobCancelled()) g_viewFactorCache.insert(key, matrix);
+	return matrix;
+}
+
+std::vector<double> computeWithReflections(const JsonInput& in, RadiosityStats& stats) {
+	const ReflectionSettings& settings = *in.reflections;
+	const RadiosityScene scene = buildRadiosityScene(in, settings);
+	const std::uint64_t seed = resolveSeed(in);
+
+	auto start = std::chrono::steady_clock::now();
+	auto transfer = cachedOrBuilt(hashRadiosityScene(in, scene, settings, false), [&]() { return buildPatchTransferMatrix(scene, settings, seed); });
+	double assemblyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::vector<double> columnValues = emitterColumnValues(in.polygons, scene.columnStart);
+	std::vector<double> radiosity = solveRadiosity(*transfer, scene, columnValues, settings, stats);
+	LogRecord(stats.converged ? LogLevel::Info : LogLevel::Warn, "Reflections solved").field("patches", scene.patches.size())
+		.field("couplings", transfer->factors.size()).field("assembly_ms", assemblyMs).field("sweeps", stats.iterations)
+		.field("residual", stats.residual).field("converged", stats.converged);
+
+	auto matrix = cachedOrBuilt(hashRadiosityScene(in, scene, settings, true), [&]() { return buildReceiverTransferMatrix(in, scene, seed); });
+	columnValues.insert(columnValues.end(), radiosity.begin(), radiosity.end());
+
+	StageTimer timer(Stage::Solve);
+	std::vector<double> values(matrix->numPoints, 0.0);
+	for (size_t r = 0; r < matrix->numPoints; ++r) {
+		double total = 0.0;
+		for (size_t k = matrix->rowStart[r]; k < matrix->rowStart[r + 1]; ++k) total += matrix->factors[k] * columnValues[matrix->emitterIdx[k]];
+		values[r] = total;
+	}
+	return values;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "scene.hpp"
+
+// ===== Inter-reflections (radiosity) =====
+// Reflective inert polygons are split into triangular patches, each with a front
+// and a back side (unknown 2k for the side the polygon normal points to, 2k + 1
+// for the other). With emitters as fixed sources, each side's radiosity is
+//   J_i = rho_i * (sum_e F_ie T_e + sum_j F_ij J_j)
+// with F estimated by cosine-weighted rays from sample points on the patch. A ray
+// is intersected with each reflective polygon once and the patch it lands on is
+// found from its barycentric coordinates, so tracing cost does not grow with the
+// patch count. Patch rows are assembled in parallel and the system is solved by
+// Gauss-Seidel; receivers then see emitters directly plus every patch side.
+// Reflective polygons are assumed convex (fan triangulation).
+
+struct ReflectivePatch {
+	std::array<Vec3, 3> vertices;
+	Vec3 normal;
+	double reflectivity {0.0};
+};
+
+struct RadiosityStats {
+	size_t patches {0};
+	size_t iterations {0};
+	double residual {0.0};
+	bool converged {false};
+};
+
+// One fan triangle of a reflective polygon, split into n^2 patches
+struct PatchedTriangle {
+	Vec3 a, e1, e2;                    // a + u*e1 + v*e2
+	size_t divisions {1};
+	std::vector<std::uint32_t> up;     // patch index of cell (i, j), lower-left half
+	std::vector<std::uint32_t> down;   // upper-right half (unused on the diagonal)
+};
+
+struct RadiosityScene {
+	struct Surface { std::vector<Vec3> verts; Vec3 normal; Vec3 point; };
+	std::vector<Surface> emitters;
+	std::vector<Surface> blockers;
+	std::vector<Surface> reflectors;
+	std::vector<std::vector<PatchedTriangle>> triangles;    // per reflector
+	std::vector<ReflectivePatch> patches;
+	ParticipatingMedia media;
+	std::vector<PolygonWithTemp> emitterPolygons;    // for temperature-field columns
+	std::vector<size_t> columnStart;                 // emitter columns; patch sides follow
+	size_t patchColumn(size_t unknown) const { return columnStart.back() + unknown; }
+};
+
+// Reflections requested and at least one inert polygon reflects
+bool reflectionsActive(const JsonInput& in);
+
+// Fan triangles of the reflective polygons: the fewest patches a scene can have
+size_t reflectiveTriangleCount(const JsonInput& in);
+
+// Fan-triangulate each reflective polygon and split every triangle into n^2 similar
+// triangles; the patch size grows until the total fits under maxPatches, or until
+// every triangle is a single patch
+RadiosityScene buildRadiosityScene(const JsonInput& in, const ReflectionSettings& settings);
+
+// Receiver values including reflected contributions
+std::vector<double> computeWithReflections(const JsonInput& in, RadiosityStats& stats);
@@ -0,0 +1,188 @@
+#pragma once
+
+// A parsed request: receivers, emitters, blockers and the per-endpoint options
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+
+// Emitter value over time (same units as "temperature"); linear between samples,
+// held constant before the first and after the last
+struct TimeSeries {
+	std::vector<double> time;
+	std::vector<double> value;
+
+	bool empty() const { return time.empty(); }
+	double at(double t) const {
+		if (t <= time.front()) return value.front();
+		if (t >= time.back()) return value.back();
+		size_t k = static_cast<size_t>(std::upper_bound(time.begin(), time.end(), t) - time.begin());
+		double w = (t - time[k - 1]) / (time[k] - time[k - 1]);
+		return value[k - 1] + w * (value[k] - value[k - 1]);
+	}
+};
+
+// Multi-bounce mode: inert polygons with reflectivity > 0 are split into patches
+// and their radiosity is solved before the receivers are evaluated
+struct ReflectionSettings {
+	double patchSize {0.5};          // target patch edge length
+	size_t raysPerPatch {4096};      // per patch side
+	size_t maxPatches {2000};        // patch size grows until the count fits
+	double tolerance {1e-6};         // relative change between sweeps
+	size_t maxIterations {500};
+};
+
+// Variance-driven ray allocation: a pilot pass, then the rest of the
+// num_rays x points budget in phases aimed at the worst (or mean) standard error
+struct RayAllocation {
+	enum class Objective { MinMax, Mean };
+	Objective objective {Objective::MinMax};
+	size_t pilotRays {0};            // 0 = a tenth of num_rays, at least 16
+	size_t phases {2};
+};
+
+// One scenario of a batch request, applied on top of the base scene
+struct ScenarioVariation {
+	std::string name;
+	std::optional<std::vector<double>> temperatures;                // per emitter, replaces base values
+	std::vector<size_t> disabledEmitters;                           // contribute nothing (still opaque)
+	std::optional<std::vector<std::vector<Vec3>>> inertPolygons;    // replaces the base blockers
+};
+
+// Inverse problem (/solve/separation): translate a group of emitters or receiver
+// planes along a direction until the peak incident value drops to the threshold
+struct SeparationSearch {
+	std::vector<size_t> emitters;
+	std::vector<std::string> receiverPlanes;
+	Vec3 direction {1.0, 0.0, 0.0};
+	double threshold {0.0};
+	double minDistance {0.0};
+	double maxDistance {100.0};
+	double initialStep {1.0};
+	double tolerance {0.01};
+	bool haveThreshold {false};
+};
+
+// A compact grid plane kept as its spec until the job is admitted
+struct PendingGrid {
+	ReceiverGridSpec spec;
+	size_t width {0};
+	size_t height {0};
+	size_t explicitBefore {0};    // explicit receiver points that precede it
+};
+
+struct JsonInput {
+	// Explicit points; grid planes join them in request order once expanded
+	std::vector<ReceiverPoint> receiverPoints;
+	std::vector<PendingGrid> pendingGrids;
+	size_t pendingPoints {0};
+	std::vector<PolygonWithTemp> polygons;
+	std::vector<std::vector<Vec3>> inertPolygons;
+	std::vector<double> inertReflectivity;    // parallel to inertPolygons; 0 = black blocker
+	ParticipatingMedia media;
+	std::size_t numRays {100000};
+	std::optional<std::uint64_t> seed;
+	
+	// Map of plane name -> plane metadata
+	std::map<std::string, PlaneData> planeDataMap;
+
+	// Optional client session; geometry is diffed against the session's previous request
+	std::optional<std::string> sessionId;
+
+	// Significant digits for output values; 0 selects shortest round-trip formatting
+	int precision {6};
+
+	// Reduced query modes for /calculate: "" (full grid), "max" or "exceedance"
+	std::string query;
+	std::optional<double> threshold;
+
+	// Inter-reflections between reflective inert polygons; off unless present
+	std::optional<ReflectionSettings> reflections;
+
+	// Full-grid /calculate only: finish within this many ms (0 = off); num_rays
+	// becomes a per-point cap (with allocation, a cap on the mean) and the ray
+	// budget is fitted to the time limit
+	double deadlineMs {0.0};
+
+	// Full-grid /calculate only: spread num_rays x points by per-point variance
+	std::optional<RayAllocation> allocation;
+
+	// Full-grid /calculate only: add per-stage timings and counters to the response
+	bool profile {false};
+
+	// Batch requests only (/calculate/batch)
+	std::vector<ScenarioVariation> variations;
+
+	// Transient requests only (/calculate/transient): one series per emitter (empty
+	// for constant emitters) and the output times; default is every series sample
+	std::vector<TimeSeries> emitterSeries;
+	std::vector<double> timeSteps;
+
+	// Separation search requests only (/solve/separation)
+	std::optional<SeparationSearch> separation;
+};
+
+// Upper bound on receiver points per request, explicit or generated from grid
+// specs; the parsers refuse larger requests before allocating anything for them
+inline constexpr std::size_t kMaxReceiverPoints = std::size_t(1) << 24;
+
+// Points of a width x height grid, or 0 if it is empty or above kMaxReceiverPoints
+inline std::size_t boundedGridPoints(std::uint64_t width, std::uint64_t height) {
+	if (width == 0 || height == 0 || width > kMaxReceiverPoints || height > kMaxReceiverPoints / width) return 0;
+	return static_cast<std::size_t>(width * height);
+}
+
+// deadline_ms or allocation was given; only full-grid /calculate honours them and
+// every other endpoint refuses them before admission
+inline bool budgetRequested(const JsonInput& in) { return in.deadlineMs > 0.0 || in.allocation.has_value(); }
+
+// Receiver points of the request, whether or not its grids are expanded yet
+inline size_t receiverPointCount(const JsonInput& in) { return in.receiverPoints.size() + in.pendingPoints; }
+
+// Records a grid plane; the parsers have already bounded its size
+inline void addPendingGrid(JsonInput& in, const ReceiverGridSpec& spec, size_t width, size_t height) {
+	in.pendingGrids.push_back({spec, width, height, in.receiverPoints.size()});
+	in.pendingPoints += width * height;
+}
+
+// Every receiver point in order, generating pending grid points on the fly
+template <class F>
+void forEachReceiverPoint(const JsonInput& in, F&& f) {
+	size_t next = 0;
+	for (const PendingGrid& g : in.pendingGrids) {
+		for (; next < g.explicitBefore; ++next) f(in.receiverPoints[next]);
+		for (size_t row = 0; row < g.height; ++row) {
+			for (size_t col = 0; col < g.width; ++col) f(receiverGridPoint(g.spec, g.width, g.height, col, row));
+		}
+	}
+	for (; next < in.receiverPoints.size(); ++next) f(in.receiverPoints[next]);
+}
+
+// Generates the pending grids into receiverPoints. Admission does this for server
+// jobs, so a refused request never allocates its grid.
+inline void expandReceiverGrids(JsonInput& in) {
+	if (in.pendingGrids.empty()) return;
+	std::vector<ReceiverPoint> points;
+	points.reserve(receiverPointCount(in));
+	size_t next = 0;
+	for (const PendingGrid& g : in.pendingGrids) {
+		points.insert(points.end(), in.receiverPoints.begin() + next, in.receiverPoints.begin() + g.explicitBefore);
+		next = g.explicitBefore;
+		generateReceiverGrid(g.spec, g.width, g.height, points);
+	}
+	points.insert(points.end(), in.receiverPoints.begin() + next, in.receiverPoints.end());
+	in.receiverPoints = std::move(points);
+	in.pendingGrids.clear();
+	in.pendingPoints = 0;
+}
+
+// Request parsers; on failure error says why and out is partially filled.
+// Grid planes are left pending (see expandReceiverGrids).
+bool parseInputJson(std::string_view json, JsonInput& out, std::string& error);
+bool parseInputBinary(std::string_view data, JsonInput& out, std::string& error);
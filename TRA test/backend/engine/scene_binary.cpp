@@ -0,0 +1,117 @@
+#include "scene.hpp"
+
+#include <cstring>
+
+#include "telemetry.hpp"
+#include "wire.hpp"
+
+bool parseInputBinary(std::string_view data, JsonInput& out, std::string& error) {
+	StageTimer timer(Stage::Parse);
+	BinaryReader r(data);
+	char magic[4];
+	std::uint16_t version = 0;
+	std::uint8_t scalarBytes = 0, flags = 0;
+	std::uint32_t numRays = 0, numPlanes = 0, numEmitters = 0, numInert = 0;
+	std::uint64_t seed = 0;
+	bool ok = r.bytes(magic, 4) && r.value(version) && r.value(scalarBytes) && r.value(flags) &&
+	          r.value(numRays) && r.value(numPlanes) && r.value(numEmitters) && r.value(numInert) && r.value(seed);
+	if (ok && std::memcmp(magic, "TRAQ", 4) != 0) ok = r.fail("Bad magic");
+	if (ok && version != kBinaryVersion) ok = r.fail("Unsupported binary version " + std::to_string(version));
+	if (ok && scalarBytes != 4 && scalarBytes != 8) ok = r.fail("Scalar size must be 4 or 8");
+
+	const size_t vertexBytes = 3 * static_cast<size_t>(scalarBytes);
+	// Smallest encodings: a plane header, an emitter with a triangle, an empty blocker
+	ok = ok && r.fits(numPlanes, 24, "Plane") && r.fits(numEmitters, 8 + scalarBytes + 3 * vertexBytes, "Emitter") &&
+	     r.fits(numInert, 8, "Inert polygon");
+
+	out.numRays = numRays;
+	if (flags & 1) out.seed = seed;
+	if (ok && (flags & 2)) {
+		std::uint32_t len = 0;
+		std::string_view id;
+		ok = r.value(len) && r.view(id, len) && r.align8();
+		out.sessionId = std::string(id);
+	}
+
+	for (std::uint32_t p = 0; ok && p < numPlanes; ++p) {
+		std::uint32_t nameLen = 0, kind = 0, width = 0, height = 0, count = 0, reserved = 0;
+		std::string_view name;
+		ok = r.value(nameLen) && r.value(kind) && r.value(width) && r.value(height) && r.value(count) &&
+		     r.value(reserved) && r.view(name, nameLen) && r.align8();
+		if (!ok) break;
+
+		PlaneData pd;
+		pd.width = width;
+		pd.height = height;
+		pd.firstPoint = receiverPointCount(out);
+		if (kind == 0) {
+			ok = r.fits(count, 2 * vertexBytes, "Point");
+			if (ok && receiverPointCount(out) + count > kMaxReceiverPoints) {
+				ok = r.fail("More than " + std::to_string(kMaxReceiverPoints) + " receiver points");
+			}
+			if (!ok) break;
+			out.receiverPoints.reserve(out.receiverPoints.size() + count);
+			for (std::uint32_t k = 0; ok && k < count; ++k) {
+				ReceiverPoint rp;
+				ok = r.vec3(rp.origin, scalarBytes) && r.vec3(rp.normal, scalarBytes);
+				out.receiverPoints.push_back(rp);
+			}
+		} else if (kind == 1) {
+			ReceiverGridSpec grid;
+			ok = r.vec3(grid.origin, scalarBytes) && r.vec3(grid.uAxis, scalarBytes) &&
+			     r.vec3(grid.vAxis, scalarBytes) && r.vec3(grid.normal, scalarBytes);
+			const size_t gridPoints = boundedGridPoints(width, height);
+			if (ok && (gridPoints == 0 || receiverPointCount(out) + gridPoints > kMaxReceiverPoints)) {
+				ok = r.fail("Grid " + std::to_string(width) + " x " + std::to_string(height) + " is empty or exceeds " +
+				            std::to_string(kMaxReceiverPoints) + " receiver points");
+			}
+			if (ok) addPendingGrid(out, grid, width, height);
+		} else {
+			ok = r.fail("Unknown plane kind " + std::to_string(kind));
+		}
+		ok = ok && r.align8();
+		pd.numPoints = receiverPointCount(out) - pd.firstPoint;
+		out.planeDataMap[std::string(name)] = pd;
+	}
+
+	if (ok) out.polygons.reserve(numEmitters);
+	for (std::uint32_t e = 0; ok && e < numEmitters; ++e) {
+		std::uint32_t count = 0, reserved = 0;
+		PolygonWithTemp poly;
+		ok = r.value(count) && r.value(reserved) && r.scalar(poly.temperature, scalarBytes);
+		if (ok && count < 3) ok = r.fail("Emitter needs at least 3 vertices");
+		ok = ok && r.fits(count, vertexBytes, "Vertex");
+		if (ok) poly.vertices.reserve(count);
+		for (std::uint32_t k = 0; ok && k < count; ++k) {
+			Vec3 v;
+			ok = r.vec3(v, scalarBytes);
+			poly.vertices.push_back(v);
+		}
+		ok = ok && r.align8();
+		out.polygons.push_back(std::move(poly));
+	}
+
+	if (ok) out.inertPolygons.reserve(numInert);
+	for (std::uint32_t b = 0; ok && b < numInert; ++b) {
+		std::uint32_t count = 0, reserved = 0;
+		std::vector<Vec3> poly;
+		ok = r.value(count) && r.value(reserved) && r.fits(count, vertexBytes, "Vertex");
+		if (ok) poly.reserve(count);
+		for (std::uint32_t k = 0; ok && k < count; ++k) {
+			Vec3 v;
+			ok = r.vec3(v, scalarBytes);
+			poly.push_back(v);
+		}
+		ok = ok && r.align8();
+		out.inertPolygons.push_back(std::move(poly));
+	}
+
+	if (ok && !r.atEnd()) ok = r.fail("Unexpected trailing bytes");
+	if (!ok) {
+		error = "Invalid binary request: " + r.error();
+		return false;
+	}
+	if (receiverPointCount(out) == 0) { error = "receiver_planes is empty"; return false; }
+	if (out.polygons.empty()) { error = "Missing polygons"; return false; }
+	return true;
+}
@@ -0,0 +1,479 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "json.hpp"
+#include "telemetry.hpp"
+
+static bool readPolygonVertices(JsonReader& r, std::vector<Vec3>& vertices) {
+	return r.readArray([&]() {
+		Vec3 v;
+		if (!r.readVec3(v)) return false;
+		vertices.push_back(v);
+		return true;
+	});
+}
+
+static bool readReceiverPoint(JsonReader& r, std::vector<ReceiverPoint>& points) {
+	ReceiverPoint rp;
+	bool haveOrigin = false, haveNormal = false;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "origin") { haveOrigin = true; return r.readVec3(rp.origin); }
+		if (key == "normal") { haveNormal = true; return r.readVec3(rp.normal); }
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (!haveOrigin || !haveNormal) return r.fail("Receiver point needs 'origin' and 'normal'");
+	points.push_back(rp);
+	return true;
+}
+
+// Plane dimensions are point counts: whole numbers, bounded before anything is sized by them
+static bool readPlaneDimension(JsonReader& r, const char* name, size_t& out) {
+	double v;
+	if (!r.readNumber(v)) return false;
+	if (!(v >= 0.0) || v != std::floor(v) || v > static_cast<double>(kMaxReceiverPoints)) {
+		return r.fail(std::string("'") + name + "' must be a whole number of points up to " + std::to_string(kMaxReceiverPoints));
+	}
+	out = static_cast<size_t>(v);
+	return true;
+}
+
+// One receiver plane: explicit points, or the compact grid spec (origin + u_axis/v_axis
+// or four corners, plus one normal). Explicit points are appended straight to the
+// global list; a grid is only counted until admission expands it.
+static bool readReceiverPlane(JsonReader& r, const std::string& planeName, JsonInput& out) {
+	size_t width = 0, height = 0;
+	const size_t firstExplicit = out.receiverPoints.size();
+	const size_t firstPoint = receiverPointCount(out);
+	ReceiverGridSpec grid;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "width") return readPlaneDimension(r, "width", width);
+		if (key == "height") return readPlaneDimension(r, "height", height);
+		if (key == "points") {
+			return r.readArray([&]() {
+				if (receiverPointCount(out) >= kMaxReceiverPoints) return r.fail("More than " + std::to_string(kMaxReceiverPoints) + " receiver points");
+				return readReceiverPoint(r, out.receiverPoints);
+			});
+		}
+		if (key == "origin") { grid.haveOrigin = true; return r.readVec3(grid.origin); }
+		if (key == "u_axis") { grid.haveUAxis = true; return r.readVec3(grid.uAxis); }
+		if (key == "v_axis") { grid.haveVAxis = true; return r.readVec3(grid.vAxis); }
+		if (key == "normal") { grid.haveNormal = true; return r.readVec3(grid.normal); }
+		if (key == "corners") {
+			std::vector<Vec3> corners;
+			if (!readPolygonVertices(r, corners)) return false;
+			if (corners.size() != 4) return r.fail("'corners' needs exactly 4 vertices");
+			grid.origin = corners[0];
+			grid.uAxis = corners[1] - corners[0];
+			grid.vAxis = corners[3] - corners[0];
+			grid.haveOrigin = grid.haveUAxis = grid.haveVAxis = true;
+			return true;
+		}
+		return r.skipValue();
+	});
+	if (!ok) return false;
+
+	// Without explicit points the plane is a grid and every part of the spec is required
+	if (out.receiverPoints.size() == firstExplicit) {
+		if (!grid.complete()) {
+			return r.fail("Receiver plane '" + planeName + "' needs 'points', or 'origin', 'u_axis', 'v_axis' and 'normal' (or 'corners' and 'normal')");
+		}
+		const size_t gridPoints = boundedGridPoints(width, height);
+		if (gridPoints == 0 || receiverPointCount(out) + gridPoints > kMaxReceiverPoints) {
+			return r.fail("Receiver plane '" + planeName + "' needs a width x height grid of 1 to " + std::to_string(kMaxReceiverPoints) + " points in total");
+		}
+		addPendingGrid(out, grid, width, height);
+	}
+
+	PlaneData pd;
+	pd.width = width;
+	pd.height = height;
+	pd.numPoints = receiverPointCount(out) - firstPoint;
+	pd.firstPoint = firstPoint;
+	out.planeDataMap[planeName] = pd;
+	return true;
+}
+
+static bool readNumberArray(JsonReader& r, std::vector<double>& values) {
+	return r.readArray([&]() {
+		double v;
+		if (!r.readNumber(v)) return false;
+		values.push_back(v);
+		return true;
+	});
+}
+
+static bool readVariation(JsonReader& r, std::vector<ScenarioVariation>& variations) {
+	ScenarioVariation v;
+	v.name = "variation " + std::to_string(variations.size());
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "name") return r.readString(v.name);
+		if (key == "temperatures") {
+			v.temperatures.emplace();
+			return readNumberArray(r, *v.temperatures);
+		}
+		if (key == "disabled_emitters") {
+			return r.readArray([&]() {
+				std::uint64_t idx;
+				if (!r.readUInt64(idx)) return false;
+				v.disabledEmitters.push_back(static_cast<size_t>(idx));
+				return true;
+			});
+		}
+		if (key == "inert_polygons") {
+			v.inertPolygons.emplace();
+			return r.readArray([&]() {
+				v.inertPolygons->emplace_back();
+				return readPolygonVertices(r, v.inertPolygons->back());
+			});
+		}
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	variations.push_back(std::move(v));
+	return true;
+}
+
+static bool readSeparationSearch(JsonReader& r, SeparationSearch& search) {
+	return r.readObject([&](std::string_view key) {
+		if (key == "move") {
+			return r.readObject([&](std::string_view group) {
+				if (group == "emitters") {
+					return r.readArray([&]() {
+						std::uint64_t idx;
+						if (!r.readUInt64(idx)) return false;
+						search.emitters.push_back(static_cast<size_t>(idx));
+						return true;
+					});
+				}
+				if (group == "receiver_planes") {
+					return r.readArray([&]() {
+						search.receiverPlanes.emplace_back();
+						return r.readString(search.receiverPlanes.back());
+					});
+				}
+				return r.skipValue();
+			});
+		}
+		if (key == "direction") return r.readVec3(search.direction);
+		if (key == "threshold") { search.haveThreshold = true; return r.readNumber(search.threshold); }
+		if (key == "min_distance") return r.readNumber(search.minDistance);
+		if (key == "max_distance") return r.readNumber(search.maxDistance);
+		if (key == "initial_step") return r.readNumber(search.initialStep);
+		if (key == "tolerance") return r.readNumber(search.tolerance);
+		return r.skipValue();
+	});
+}
+
+static bool readTimeSeries(JsonReader& r, TimeSeries& series) {
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "time") return readNumberArray(r, series.time);
+		if (key == "value") return readNumberArray(r, series.value);
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (series.time.empty() || series.time.size() != series.value.size()) {
+		return r.fail("Series needs matching non-empty 'time' and 'value' arrays");
+	}
+	for (size_t k = 1; k < series.time.size(); ++k) {
+		if (!(series.time[k] > series.time[k - 1])) return r.fail("Series 'time' must be strictly increasing");
+	}
+	return true;
+}
+
+// "temperature_field": {"grid": {"width": W, "height": H, "values": [...]}}
+//                   or {"vertical": {"heights": [...], "values": [...]}}
+static bool readTemperatureField(JsonReader& r, TemperatureField& field) {
+	bool haveKind = false;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "grid") {
+			haveKind = true;
+			field.kind = TemperatureField::Kind::Grid;
+			size_t width = 0, height = 0;
+			bool okGrid = r.readObject([&](std::string_view gridKey) {
+				if (gridKey == "width") return readPlaneDimension(r, "width", width);
+				if (gridKey == "height") return readPlaneDimension(r, "height", height);
+				if (gridKey == "values") return readNumberArray(r, field.values);
+				return r.skipValue();
+			});
+			if (!okGrid) return false;
+			const size_t samples = boundedGridPoints(width, height);
+			if (samples == 0) {
+				return r.fail("Temperature grid needs 'width' and 'height' of at least 1 and at most " + std::to_string(kMaxReceiverPoints) + " samples");
+			}
+			field.width = width;
+			field.height = height;
+			if (field.values.size() != samples) return r.fail("Temperature grid needs width * height 'values'");
+			return true;
+		}
+		if (key == "vertical") {
+			haveKind = true;
+			field.kind = TemperatureField::Kind::Vertical;
+			bool okVertical = r.readObject([&](std::string_view verticalKey) {
+				if (verticalKey == "heights") return readNumberArray(r, field.heights);
+				if (verticalKey == "values") return readNumberArray(r, field.values);
+				return r.skipValue();
+			});
+			if (!okVertical) return false;
+			if (field.heights.empty() || field.heights.size() != field.values.size()) {
+				return r.fail("Vertical temperature profile needs matching non-empty 'heights' and 'values'");
+			}
+			for (size_t k = 1; k < field.heights.size(); ++k) {
+				if (!(field.heights[k] > field.heights[k - 1])) return r.fail("Profile 'heights' must be strictly increasing");
+			}
+			field.width = field.heights.size();
+			return true;
+		}
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (!haveKind) return r.fail("Temperature field needs 'grid' or 'vertical'");
+	return true;
+}
+
+// Emitters: {"polygon": [...], "temperature": T}, or a bare vertex array (legacy, T = 0).
+// A "series" ({"time": [...], "value": [...]}) may replace or accompany "temperature";
+// steady-state requests use the temperature, or the series' first value. A
+// "temperature_field" replaces the single temperature in steady-state requests.
+static bool readEmitter(JsonReader& r, std::vector<PolygonWithTemp>& polygons, std::vector<TimeSeries>& series) {
+	PolygonWithTemp poly;
+	poly.temperature = 0.0;
+	TimeSeries emitterSeries;
+	if (r.peek('[')) {
+		if (!readPolygonVertices(r, poly.vertices)) return false;
+		polygons.push_back(std::move(poly));
+		series.emplace_back();
+		return true;
+	}
+	bool havePolygon = false, haveTemperature = false;
+	std::shared_ptr<TemperatureField> field;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "polygon") { havePolygon = true; return readPolygonVertices(r, poly.vertices); }
+		if (key == "temperature") { haveTemperature = true; return r.readNumber(poly.temperature); }
+		if (key == "series") return readTimeSeries(r, emitterSeries);
+		if (key == "temperature_field") {
+			field = std::make_shared<TemperatureField>();
+			return readTemperatureField(r, *field);
+		}
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (!havePolygon || (!haveTemperature && emitterSeries.empty() && !field)) {
+		return r.fail("Emitter needs 'polygon' and 'temperature', 'series' or 'temperature_field'");
+	}
+	if (field) {
+		if (field->kind == TemperatureField::Kind::Grid && !field->setFrame(poly.vertices)) {
+			return r.fail("Temperature grid needs a non-degenerate emitter polygon");
+		}
+		// Plain temperature (logs, transient fallback): the field's mean sample
+		if (!haveTemperature) poly.temperature = std::accumulate(field->values.begin(), field->values.end(), 0.0) / static_cast<double>(field->size());
+		poly.field = std::move(field);
+	}
+	if (!haveTemperature && !poly.field) poly.temperature = emitterSeries.value.front();
+	polygons.push_back(std::move(poly));
+	series.push_back(std::move(emitterSeries));
+	return true;
+}
+
+// Inert polygons: a bare vertex array, or {"polygon": [...], "reflectivity": rho}
+static bool readInertPolygon(JsonReader& r, JsonInput& out) {
+	out.inertPolygons.emplace_back();
+	if (r.peek('[')) {
+		out.inertReflectivity.push_back(0.0);
+		return readPolygonVertices(r, out.inertPolygons.back());
+	}
+	double reflectivity = 0.0;
+	bool havePolygon = false;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "polygon") { havePolygon = true; return readPolygonVertices(r, out.inertPolygons.back()); }
+		if (key == "reflectivity") return r.readNumber(reflectivity);
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (!havePolygon) return r.fail("Inert polygon needs 'polygon'");
+	if (reflectivity < 0.0 || reflectivity >= 1.0) return r.fail("'reflectivity' must be in [0, 1)");
+	out.inertReflectivity.push_back(reflectivity);
+	return true;
+}
+
+// "media": {"extinction": k, "volumes": [{"type": "box", "min": [...], "max": [...], "extinction": k},
+//                                        {"type": "slab", "point": [...], "normal": [...], "thickness": d, "extinction": k}]}
+static bool readAttenuatingVolume(JsonReader& r, std::vector<AttenuatingVolume>& volumes) {
+	AttenuatingVolume v;
+	std::string type;
+	bool haveMin = false, haveMax = false, havePoint = false, haveNormal = false;
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "type") return r.readString(type);
+		if (key == "min") { haveMin = true; return r.readVec3(v.min); }
+		if (key == "max") { haveMax = true; return r.readVec3(v.max); }
+		if (key == "point") { havePoint = true; return r.readVec3(v.point); }
+		if (key == "normal") { haveNormal = true; return r.readVec3(v.normal); }
+		if (key == "thickness") return r.readNumber(v.thickness);
+		if (key == "extinction") return r.readNumber(v.extinction);
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (v.extinction < 0.0) return r.fail("Volume 'extinction' must be non-negative");
+	if (type == "box") {
+		if (!haveMin || !haveMax) return r.fail("Box volume needs 'min' and 'max'");
+		v.kind = AttenuatingVolume::Kind::Box;
+	} else if (type == "slab") {
+		if (!havePoint || !haveNormal || !(v.thickness > 0.0)) return r.fail("Slab volume needs 'point', 'normal' and a positive 'thickness'");
+		v.normal = normalize(v.normal);
+		if (length(v.normal) == 0.0) return r.fail("Slab 'normal' must be non-zero");
+		v.kind = AttenuatingVolume::Kind::Slab;
+	} else {
+		return r.fail("Volume 'type' must be \"box\" or \"slab\"");
+	}
+	if (v.extinction > 0.0) volumes.push_back(v);
+	return true;
+}
+
+static bool readMedia(JsonReader& r, ParticipatingMedia& media) {
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "extinction") return r.readNumber(media.extinction);
+		if (key == "volumes") return r.readArray([&]() { return readAttenuatingVolume(r, media.volumes); });
+		return r.skipValue();
+	});
+	if (ok && media.extinction < 0.0) return r.fail("Medium 'extinction' must be non-negative");
+	return ok;
+}
+
+static bool readReflectionSettings(JsonReader& r, ReflectionSettings& settings) {
+	double rays = static_cast<double>(settings.raysPerPatch);
+	double maxPatches = static_cast<double>(settings.maxPatches);
+	double maxIterations = static_cast<double>(settings.maxIterations);
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "patch_size") return r.readNumber(settings.patchSize);
+		if (key == "rays_per_patch") return r.readNumber(rays);
+		if (key == "max_patches") return r.readNumber(maxPatches);
+		if (key == "tolerance") return r.readNumber(settings.tolerance);
+		if (key == "max_iterations") return r.readNumber(maxIterations);
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (!(settings.patchSize > 0.0)) return r.fail("'patch_size' must be positive");
+	settings.raysPerPatch = static_cast<size_t>(std::max(rays, 1.0));
+	settings.maxPatches = static_cast<size_t>(std::max(maxPatches, 1.0));
+	settings.maxIterations = static_cast<size_t>(std::max(maxIterations, 1.0));
+	return true;
+}
+
+static bool readRayAllocation(JsonReader& r, RayAllocation& allocation) {
+	std::string objective = "minmax";
+	double pilot = 0.0, phases = static_cast<double>(allocation.phases);
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "objective") return r.readString(objective);
+		if (key == "pilot_rays") return r.readNumber(pilot);
+		if (key == "phases") return r.readNumber(phases);
+		return r.skipValue();
+	});
+	if (!ok) return false;
+	if (objective == "minmax") allocation.objective = RayAllocation::Objective::MinMax;
+	else if (objective == "mean") allocation.objective = RayAllocation::Objective::Mean;
+	else return r.fail("'objective' must be \"minmax\" or \"mean\"");
+	allocation.pilotRays = static_cast<size_t>(std::max(pilot, 0.0));
+	allocation.phases = static_cast<size_t>(std::clamp(phases, 1.0, 16.0));
+	return true;
+}
+
+bool parseInputJson(std::string_view json, JsonInput& out, std::string& error) {
+	StageTimer timer(Stage::Parse);
+	JsonReader r(json);
+	bool haveReceiverPlanes = false, havePolygons = false;
+
+	bool ok = r.readObject([&](std::string_view key) {
+		if (key == "receiver_planes") {
+			haveReceiverPlanes = true;
+			std::string planeName;
+			return r.readObject([&](std::string_view rawName) {
+				return r.decodeString(rawName, planeName) && readReceiverPlane(r, planeName, out);
+			});
+		}
+		if (key == "polygons") {
+			havePolygons = true;
+			return r.readArray([&]() { return readEmitter(r, out.polygons, out.emitterSeries); });
+		}
+		if (key == "inert_polygons") {
+			return r.readArray([&]() { return readInertPolygon(r, out); });
+		}
+		if (key == "media") return readMedia(r, out.media);
+		if (key == "reflections") {
+			out.reflections.emplace();
+			return readReflectionSettings(r, *out.reflections);
+		}
+		if (key == "num_rays") {
+			double n;
+			if (!r.readNumber(n)) return false;
+			if (n < 0) n = 0;
+			out.numRays = static_cast<std::size_t>(n);
+			return true;
+		}
+		if (key == "deadline_ms") {
+			double ms;
+			if (!r.readNumber(ms)) return false;
+			out.deadlineMs = std::max(0.0, ms);
+			return true;
+		}
+		if (key == "profile") return r.readBool(out.profile);
+		if (key == "allocation") {
+			out.allocation.emplace();
+			return readRayAllocation(r, *out.allocation);
+		}
+		if (key == "seed") {
+			std::uint64_t s;
+			if (!r.readUInt64(s)) return false;
+			out.seed = s;
+			return true;
+		}
+		if (key == "precision") {
+			double p;
+			if (!r.readNumber(p)) return false;
+			out.precision = static_cast<int>(std::clamp(p, 0.0, 17.0));
+			return true;
+		}
+		if (key == "query") return r.readString(out.query);
+		if (key == "threshold") {
+			double t;
+			if (!r.readNumber(t)) return false;
+			out.threshold = t;
+			return true;
+		}
+		if (key == "search") {
+			out.separation.emplace();
+			return readSeparationSearch(r, *out.separation);
+		}
+		if (key == "time_steps") return readNumberArray(r, out.timeSteps);
+		if (key == "variations") {
+			return r.readArray([&]() { return readVariation(r, out.variations); });
+		}
+		if (key == "session_id") {
+			std::string id;
+			if (!r.readString(id)) return false;
+			out.sessionId = std::move(id);
+			return true;
+		}
+		return r.skipValue();
+	});
+	if (ok && !r.atEnd()) ok = r.fail("Unexpected trailing characters");
+	if (!ok) {
+		error = "Invalid JSON: " + r.errorMessage();
+		return false;
+	}
+
+	if (!haveReceiverPlanes) {
+		error = "Must provide 'receiver_planes' field";
+		return false;
+	}
+	
+	if (receiverPointCount(out) == 0) {
+		error = "receiver_planes is empty";
+		return false;
+	}
+	
+	if (!havePolygons) { error = "Missing polygons"; return false; }
+	return true;
+}
@@ -0,0 +1,238 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "admission.hpp"
+#include "calculation.hpp"
+#include "json.hpp"
+#include "parallel.hpp"
+#include "radiosity.hpp"
+#include "telemetry.hpp"
+#include "view_factors.hpp"
+
+// ===== Inverse search: critical separation distance =====
+// Bracketing + bisection on d, where the peak incident value over all receiver
+// points with the group moved by d * direction equals the threshold. Every
+// evaluation uses the same per-point seeds (common random numbers), so noise does
+// not flip the comparison between nearby distances. Bracketing runs with a
+// reduced ray count, bisection doubles it each step and only revisits points that
+// were near the peak on the last full-grid pass.
+
+static constexpr int kMaxBisections = 64;
+
+struct PeakEvaluation {
+	double distance {0.0};
+	double peak {0.0};
+	double stdError {0.0};
+	size_t pointIdx {0};
+	size_t rays {0};
+	size_t pointsEvaluated {0};
+};
+
+static JsonInput translatedScene(const JsonInput& base, const SeparationSearch& search, const std::vector<bool>& movedPoints, const Vec3& offset) {
+	JsonInput scene;
+	scene.receiverPoints = base.receiverPoints;
+	scene.polygons = base.polygons;
+	scene.inertPolygons = base.inertPolygons;
+	scene.media = base.media;
+	for (size_t e : search.emitters) {
+		for (auto& v : scene.polygons[e].vertices) v += offset;
+	}
+	for (size_t k = 0; k < scene.receiverPoints.size(); ++k) {
+		if (movedPoints[k]) scene.receiverPoints[k].origin += offset;
+	}
+	return scene;
+}
+
+// Points are traced in parallel and reduced in order, so ties go to the lowest index
+static PeakEvaluation evaluatePeak(const JsonInput& scene, const std::vector<size_t>& points, std::uint64_t seed, size_t rays, std::vector<double>* values) {
+	PeakEvaluation ev;
+	ev.peak = -std::numeric_limits<double>::infinity();
+	ev.rays = rays;
+	ev.pointsEvaluated = points.size();
+	std::vector<PointEstimate> estimates(points.size());
+	parallelFor(points.size(), [&](size_t k) {
+		estimates[k] = estimatePointValue(scene, scene.receiverPoints[points[k]], pointSeedFor(seed, points[k]), rays);
+	});
+	if (values) values->assign(scene.receiverPoints.size(), 0.0);
+	for (size_t k = 0; k < points.size(); ++k) {
+		const PointEstimate& est = estimates[k];
+		if (values) (*values)[points[k]] = est.value;
+		if (est.value > ev.peak) {
+			ev.peak = est.value;
+			ev.stdError = est.stdError;
+			ev.pointIdx = points[k];
+		}
+	}
+	return ev;
+}
+
+// Bracketing runs at this many rays per point
+static size_t coarseRaysFor(size_t fullRays) {
+	return std::max<size_t>(std::min<size_t>(fullRays, 2000), fullRays / 16);
+}
+
+double separationSearchRays(const JsonInput& in) {
+	const SeparationSearch& search = *in.separation;
+	const double points = static_cast<double>(receiverPointCount(in));
+	const size_t fullRays = std::max<size_t>(in.numRays, 1);
+	const size_t coarseRays = coarseRaysFor(fullRays);
+	const double range = search.maxDistance - search.minDistance;
+	if (!(range > 0.0) || !(search.initialStep > 0.0) || !(search.tolerance > 0.0)) return 0.0;
+	// The step doubles from initial_step, so k passes reach initial_step * (2^k - 1)
+	const double bracketPasses = 1.0 + std::ceil(std::log2(range / search.initialStep + 1.0));
+	double traced = bracketPasses * points * static_cast<double>(coarseRays);
+	const int bisections = static_cast<int>(std::min<double>(kMaxBisections, std::ceil(std::log2(std::max(range / search.tolerance, 1.0)))));
+	size_t rays = coarseRays;
+	for (int step = 0; step < bisections; ++step) {
+		rays = std::min(fullRays, rays * 2);
+		traced += points * static_cast<double>(rays);
+	}
+	return traced + 3.0 * points * static_cast<double>(fullRays);
+}
+
+// Points within half the peak on a full pass stay candidates for the next passes
+static void collectPeakCandidates(const std::vector<double>& values, double peak, std::vector<size_t>& candidates) {
+	for (size_t k = 0; k < values.size(); ++k) {
+		if (values[k] >= 0.5 * peak) candidates.push_back(k);
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
+// A cancelled pass leaves points untraced, so its peak means nothing
+static std::string cancelledSearch(JobReport& job) {
+	job.status = 503;
+	return errorJson("Separation search cancelled");
+}
+
+std::string runSeparationSearch(std::string_view input, JobReport& job, bool& ok) {
+	JsonInput in;
+	std::string err;
+	ok = false;
+	if (!parseInputJson(input, in, err)) return errorJson(err);
+	if (!in.separation) return errorJson("Separation request needs a 'search' object");
+	if (budgetRequested(in)) return errorJson("'deadline_ms' and 'allocation' are only supported by /calculate");
+	if (reflectionsActive(in)) return errorJson("Reflections are only supported by /calculate");
+	const SeparationSearch& search = *in.separation;
+	if (!search.haveThreshold) return errorJson("search.threshold is required");
+	if (search.emitters.empty() && search.receiverPlanes.empty()) return errorJson("search.move must name emitters or receiver_planes");
+	if (length(search.direction) < 1e-12) return errorJson("search.direction must be non-zero");
+	if (!(search.maxDistance > search.minDistance)) return errorJson("search.max_distance must exceed min_distance");
+	if (!(search.tolerance > 0.0) || !(search.initialStep > 0.0)) return errorJson("search.tolerance and initial_step must be positive");
+	for (size_t e : search.emitters) {
+		if (e >= in.polygons.size()) return errorJson("search.move.emitters index out of range");
+	}
+	std::vector<bool> movedPoints(receiverPointCount(in), false);
+	for (const auto& name : search.receiverPlanes) {
+		auto it = in.planeDataMap.find(name);
+		if (it == in.planeDataMap.end()) return errorJson("Unknown receiver plane '" + name + "' in search.move");
+		for (size_t k = 0; k < it->second.numPoints; ++k) movedPoints[it->second.firstPoint + k] = true;
+	}
+
+	std::string refusal;
+	if (!admitJob(in, job, refusal)) {
+		return refusal;
+	}
+
+	StageTimer timer(Stage::Trace);
+	const Vec3 dir = normalize(search.direction);
+	const std::uint64_t seed = resolveSeed(in);
+	const size_t fullRays = std::max<size_t>(in.numRays, 1);
+	const size_t coarseRays = coarseRaysFor(fullRays);
+	std::vector<size_t> allPoints(in.receiverPoints.size());
+	std::iota(allPoints.begin(), allPoints.end(), 0);
+
+	std::vector<PeakEvaluation> history;
+	std::vector<size_t> candidates;
+	std::vector<double> values;
+	auto evaluate = [&](double d, const std::vector<size_t>& points, size_t rays, std::vector<double>* out) {
+		JsonInput scene = translatedScene(in, search, movedPoints, dir * d);
+		PeakEvaluation ev = evaluatePeak(scene, points, seed, rays, out);
+		ev.distance = d;
+		history.push_back(ev);
+		return ev;
+	};
+
+	LogRecord(LogLevel::Info, "Separation search").field("threshold", search.threshold).field("emitters", search.emitters.size())
+		.field("planes_moving", search.receiverPlanes.size());
+
+	// Bracket: lo stays above the threshold, hi falls below it
+	double lo = search.minDistance;
+	PeakEvaluation atLo = evaluate(lo, allPoints, coarseRays, &values);
+	if (jobCancelled()) return cancelledSearch(job);
+	collectPeakCandidates(values, atLo.peak, candidates);
+	if (atLo.peak < search.threshold) {
+		return errorJson("Peak is already below the threshold at min_distance (" + std::to_string(search.minDistance) + ")");
+	}
+	double hi = lo;
+	bool bracketed = false;
+	double step = search.initialStep;
+	while (true) {
+		hi = std::min(lo + step, search.maxDistance);
+		PeakEvaluation atHi = evaluate(hi, allPoints, coarseRays, &values);
+		if (jobCancelled()) return cancelledSearch(job);
+		collectPeakCandidates(values, atHi.peak, candidates);
+		if (atHi.peak < search.threshold) { bracketed = true; break; }
+		if (hi >= search.maxDistance) break;
+		lo = hi;
+		step *= 2.0;
+	}
+	if (!bracketed) {
+		return errorJson("Peak stays above the threshold up to max_distance (" + std::to_string(search.maxDistance) + ")");
+	}
+
+	// Bisection with a growing ray budget. A tolerance below a few ULPs of the
+	// distance could never be met, so it is widened to that, and the step count capped
+	size_t rays = coarseRays;
+	const double tolerance = std::max(search.tolerance, 4.0 * std::numeric_limits<double>::epsilon() * std::max(std::fabs(lo), std::fabs(hi)));
+	for (int step = 0; step < kMaxBisections && hi - lo > tolerance; ++step) {
+		double mid = 0.5 * (lo + hi);
+		rays = std::min(fullRays, rays * 2);
+		PeakEvaluation atMid = evaluate(mid, candidates, rays, nullptr);
+		if (jobCancelled()) return cancelledSearch(job);
+		if (atMid.peak >= search.threshold) lo = mid; else hi = mid;
+	}
+	double distance = 0.5 * (lo + hi);
+
+	// Full-resolution confirmation, and a central difference for the local slope
+	PeakEvaluation final = evaluate(distance, allPoints, fullRays, nullptr);
+	double delta = std::max(5.0 * tolerance, 0.02 * search.initialStep);
+	PeakEvaluation before = evaluate(std::max(search.minDistance, distance - delta), candidates, fullRays, nullptr);
+	PeakEvaluation after = evaluate(distance + delta, candidates, fullRays, nullptr);
+	if (jobCancelled()) return cancelledSearch(job);
+	double slope = (before.peak - after.peak) / (after.distance - before.distance);
+	double mcUncertainty = slope > 1e-12 ? final.stdError / slope : std::numeric_limits<double>::infinity();
+	double halfBracket = 0.5 * (hi - lo);
+	double uncertainty = std::sqrt(mcUncertainty * mcUncertainty + halfBracket * halfBracket);
+
+	LogRecord(LogLevel::Info, "Separation found").field("distance", distance).field("uncertainty", uncertainty)
+		.field("evaluations", history.size());
+
+	const ReceiverPoint& peakPoint = in.receiverPoints[final.pointIdx];
+	Vec3 peakLocation = peakPoint.origin + (movedPoints[final.pointIdx] ? dir * distance : Vec3{});
+	JsonWriter out(512 + history.size() * 96, 0);
+	out.raw("{\"success\":true,\"distance\":").number(distance);
+	out.raw(",\"uncertainty\":").number(uncertainty);
+	out.raw(",\"threshold\":").number(search.threshold);
+	out.raw(",\"peak\":").number(final.peak);
+	out.raw(",\"peak_std_error\":").number(final.stdError);
+	out.raw(",\"peak_location\":[").number(peakLocation.x).raw(',').number(peakLocation.y).raw(',').number(peakLocation.z).raw(']');
+	out.raw(",\"slope\":").number(slope);
+	out.raw(",\"bracket\":[").number(lo).raw(',').number(hi).raw(']');
+	out.raw(",\"evaluations\":[");
+	for (size_t k = 0; k < history.size(); ++k) {
+		if (k > 0) out.raw(',');
+		out.raw("{\"distance\":").number(history[k].distance);
+		out.raw(",\"peak\":").number(history[k].peak);
+		out.raw(",\"rays\":").integer(history[k].rays);
+		out.raw(",\"points\":").integer(history[k].pointsEvaluated).raw('}');
+	}
+	out.raw("]}");
+	ok = true;
+	return out.take();
+}
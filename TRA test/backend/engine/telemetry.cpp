@@ -0,0 +1,137 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+EngineCounters g_engineCounters;
+StageTotals g_stageTotals[static_cast<size_t>(Stage::Count)];
+Logger g_logger(4096);
+
+std::uint64_t threadCpuNanos() {
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+	auto ticks = [](const FILETIME& ft) { return (static_cast<std::uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+	return (ticks(kernel) + ticks(user)) * 100;
+#else
+	timespec ts {};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+#endif
+}
+
+bool g_traceAll = false;
+bool g_traceRequests = false;
+TraceWriter g_traceWriter;
+
+std::string JobTrace::json() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	JsonWriter out(128 + events_.size() * 128, 0);
+	out.raw("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	out.raw("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":").string("job " + std::to_string(id_)).raw("}}");
+	for (std::uint32_t tid : threads_) {
+		out.raw(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":").integer(tid);
+		out.raw(",\"args\":{\"name\":").string("thread " + std::to_string(tid)).raw("}}");
+	}
+	for (const Event& e : events_) {
+		out.raw(",{\"name\":").string(e.name).raw(",\"cat\":\"").raw(e.category).raw("\",\"ph\":\"X\",\"ts\":").number(e.ts);
+		out.raw(",\"dur\":").number(e.dur).raw(",\"pid\":1,\"tid\":").integer(e.tid);
+		if (!e.args.empty()) out.raw(",\"args\":").raw(e.args);
+		out.raw('}');
+	}
+	out.raw("]}");
+	return out.take();
+}
+
+static constexpr size_t kMaxQueuedTraces = 64;
+
+void TraceWriter::start(std::string dir, size_t keep) {
+	if (writer_.joinable()) return;
+	namespace fs = std::filesystem;
+	dir_ = std::move(dir);
+	keep_ = std::max<size_t>(keep, 1);
+	runTag_ = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	std::error_code ec;
+	fs::create_directories(dir_, ec);
+	std::vector<std::pair<fs::file_time_type, std::string>> existing;
+	for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+		const std::string name = it->path().filename().string();
+		if (name.rfind("trace-", 0) != 0 || it->path().extension() != ".json") continue;
+		std::error_code timeEc;
+		existing.emplace_back(it->last_write_time(timeEc), it->path().string());
+	}
+	std::sort(existing.begin(), existing.end());
+	for (auto& file : existing) files_.push_back(std::move(file.second));
+	prune();
+	stopping_ = false;
+	writer_ = std::thread([this]() { run(); });
+}
+
+void TraceWriter::stop() {
+	if (!writer_.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	ready_.notify_one();
+	writer_.join();
+}
+
+std::string TraceWriter::submit(std::unique_ptr<JobTrace> trace) {
+	if (!writer_.joinable() || !trace) return {};
+	std::string name = "trace-" + runTag_ + "-" + std::to_string(trace->id()) + ".json";
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (queue_.size() >= kMaxQueuedTraces) name.clear();
+		else queue_.emplace_back(name, std::move(trace));
+	}
+	if (name.empty()) {
+		LogRecord(LogLevel::Warn, "Trace dropped, writer behind").field("queued", kMaxQueuedTraces);
+		return {};
+	}
+	ready_.notify_one();
+	return name;
+}
+
+void TraceWriter::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+		if (queue_.empty()) return;
+		auto [name, trace] = std::move(queue_.front());
+		queue_.pop_front();
+		lock.unlock();
+		const std::string path = (std::filesystem::path(dir_) / name).string();
+		const std::string json = trace->json();
+		std::ofstream file(path, std::ios::binary);
+		if (file && file.write(json.data(), static_cast<std::streamsize>(json.size()))) {
+			files_.push_back(path);
+			prune();
+		} else {
+			LogRecord(LogLevel::Error, "Could not write trace").field("file", name);
+		}
+		lock.lock();
+	}
+}
+
+void TraceWriter::prune() {
+	while (files_.size() > keep_) {
+		std::error_code ec;
+		std::filesystem::remove(files_.front(), ec);
+		files_.pop_front();
+	}
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+// Engine telemetry: /metrics counters, per-request profiles, job traces and the
+// structured logger
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "geometry.hpp"
+#include "json.hpp"
+
+// ===== Engine counters =====
+// Process-wide totals for /metrics. The kernels add once per call; each stage is
+// timed by the outermost StageTimer on its thread, so nested stages count once.
+
+struct EngineCounters {
+	std::atomic<std::uint64_t> raysTraced {0};
+	std::atomic<std::uint64_t> polygonTests {0};     // ray-plane tests against valid polygons
+};
+extern EngineCounters g_engineCounters;
+
+inline void countTraced(size_t rays, size_t polygons) {
+	g_engineCounters.raysTraced.fetch_add(rays, std::memory_order_relaxed);
+	g_engineCounters.polygonTests.fetch_add(static_cast<std::uint64_t>(rays) * polygons, std::memory_order_relaxed);
+}
+
+enum class Stage { Parse, Scene, Trace, Solve, Serialise, Count };
+inline constexpr const char* kStageNames[] = {"parse", "scene", "trace", "solve", "serialise"};
+
+struct StageTotals {
+	std::atomic<std::uint64_t> nanos {0};
+	std::atomic<std::uint64_t> count {0};
+};
+extern StageTotals g_stageTotals[static_cast<size_t>(Stage::Count)];
+
+// Per-request breakdown for "profile": true. The request thread installs its
+// RequestProfile in t_profile (parallelFor hands it to the workers); with none
+// installed every ProfileLap is a no-op. Times are summed over the threads that
+// did the work, so parallel stages can exceed the elapsed time.
+
+enum class ProfileStage { Parse, Scene, RayGeneration, Intersection, Reduction, Serialise, Count };
+inline constexpr const char* kProfileStageNames[] = {"parse", "scene", "ray_generation", "intersection", "reduction", "serialise"};
+
+std::uint64_t threadCpuNanos();
+
+struct ProfileTimestamp {
+	std::chrono::steady_clock::time_point wall;
+	std::uint64_t cpuNs;
+	static ProfileTimestamp now() { return {std::chrono::steady_clock::now(), threadCpuNanos()}; }
+};
+
+struct RequestProfile {
+	ProfileTimestamp started {ProfileTimestamp::now()};
+	std::atomic<std::uint64_t> wallNs[static_cast<size_t>(ProfileStage::Count)] {};
+	std::atomic<std::uint64_t> cpuNs[static_cast<size_t>(ProfileStage::Count)] {};
+	std::atomic<std::uint64_t> rays {0};
+	std::atomic<std::uint64_t> polygonTests {0};
+	std::atomic<std::uint64_t> pointInPolygonTests {0};
+	std::atomic<std::uint64_t> hits {0};
+
+	// Adds the time from since to now and returns now
+	ProfileTimestamp add(ProfileStage stage, const ProfileTimestamp& since) {
+		ProfileTimestamp t = ProfileTimestamp::now();
+		auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(t.wall - since.wall).count();
+		wallNs[static_cast<size_t>(stage)].fetch_add(static_cast<std::uint64_t>(wall), std::memory_order_relaxed);
+		cpuNs[static_cast<size_t>(stage)].fetch_add(t.cpuNs - since.cpuNs, std::memory_order_relaxed);
+		return t;
+	}
+};
+
+inline thread_local RequestProfile* t_profile = nullptr;
+
+// Installs a profile on this thread for the lifetime of the object
+class ActiveProfile {
+public:
+	explicit ActiveProfile(RequestProfile* profile) : previous_(t_profile) { t_profile = profile; }
+	~ActiveProfile() { t_profile = previous_; }
+	ActiveProfile(const ActiveProfile&) = delete;
+	ActiveProfile& operator=(const ActiveProfile&) = delete;
+private:
+	RequestProfile* previous_;
+};
+
+// Splits consecutive work into stages: mark(stage) charges the time since the last mark
+class ProfileLap {
+public:
+	ProfileLap() : profile_(t_profile) {
+		if (profile_) last_ = ProfileTimestamp::now();
+	}
+	void mark(ProfileStage stage) {
+		if (profile_) last_ = profile_->add(stage, last_);
+	}
+	RequestProfile* profile() const { return profile_; }
+private:
+	RequestProfile* profile_;
+	ProfileTimestamp last_ {};
+};
+
+inline void profileCounts(size_t rays, size_t polygonTests, size_t pointInPolygonTests, size_t hits) {
+	RequestProfile* profile = t_profile;
+	if (!profile) return;
+	profile->rays.fetch_add(rays, std::memory_order_relaxed);
+	profile->polygonTests.fetch_add(polygonTests, std::memory_order_relaxed);
+	profile->pointInPolygonTests.fetch_add(pointInPolygonTests, std::memory_order_relaxed);
+	profile->hits.fetch_add(hits, std::memory_order_relaxed);
+}
+
+// Timeline of one job as Chrome trace events (chrome://tracing, Perfetto). The
+// request thread installs a JobTrace in t_trace (parallelFor hands it on); with
+// none installed a TraceSpan is one thread-local load.
+
+inline std::uint32_t traceThreadId() {
+	static std::atomic<std::uint32_t> next {1};
+	static thread_local std::uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+	return id;
+}
+
+class JobTrace {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit JobTrace(std::uint64_t id) : id_(id), origin_(Clock::now()) {}
+
+	std::uint64_t id() const { return id_; }
+
+	// args: a JSON object, or empty
+	void complete(std::string name, const char* category, Clock::time_point begin, Clock::time_point end, std::string args = {}) {
+		Event e {std::move(name), category, micros(begin), micros(end) - micros(begin), traceThreadId(), std::move(args)};
+		std::lock_guard<std::mutex> lock(mutex_);
+		threads_.insert(e.tid);
+		events_.push_back(std::move(e));
+	}
+
+	std::string json();
+
+private:
+	struct Event {
+		std::string name;
+		const char* category;
+		double ts, dur;          // microseconds since the job started
+		std::uint32_t tid;
+		std::string args;
+	};
+
+	double micros(Clock::time_point t) const { return std::chrono::duration<double, std::micro>(t - origin_).count(); }
+
+	std::uint64_t id_;
+	Clock::time_point origin_;
+	std::mutex mutex_;
+	std::vector<Event> events_;
+	std::set<std::uint32_t> threads_;
+};
+
+inline thread_local JobTrace* t_trace = nullptr;
+
+class ActiveTrace {
+public:
+	explicit ActiveTrace(JobTrace* trace) : previous_(t_trace) { t_trace = trace; }
+	~ActiveTrace() { t_trace = previous_; }
+	ActiveTrace(const ActiveTrace&) = delete;
+	ActiveTrace& operator=(const ActiveTrace&) = delete;
+private:
+	JobTrace* previous_;
+};
+
+// Records [construction, destruction) on the installed trace, if any
+class TraceSpan {
+public:
+	TraceSpan(const char* category, std::string_view name) : trace_(t_trace) {
+		if (!trace_) return;
+		category_ = category;
+		name_ = name;
+		begin_ = JobTrace::Clock::now();
+	}
+	~TraceSpan() {
+		if (trace_) trace_->complete(std::move(name_), category_, begin_, JobTrace::Clock::now(), std::move(args_));
+	}
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+	bool active() const { return trace_ != nullptr; }
+	void setArgs(std::string args) { if (trace_) args_ = std::move(args); }
+
+private:
+	JobTrace* trace_;
+	const char* category_ {""};
+	std::string name_;
+	std::string args_;
+	JobTrace::Clock::time_point begin_ {};
+};
+
+// Times one stage for /metrics and, when a profile is installed, for the request
+class StageTimer {
+public:
+	explicit StageTimer(Stage stage) : stage_(stage), active_(!inStage_) {
+		if (!active_) return;
+		inStage_ = true;
+		start_ = std::chrono::steady_clock::now();
+		if (stage_ != Stage::Trace) lap_.emplace();
+		if (t_trace) span_.emplace("stage", kStageNames[static_cast<size_t>(stage_)]);
+	}
+	~StageTimer() {
+		if (!active_) return;
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+		StageTotals& totals = g_stageTotals[static_cast<size_t>(stage_)];
+		totals.nanos.fetch_add(static_cast<std::uint64_t>(ns), std::memory_order_relaxed);
+		totals.count.fetch_add(1, std::memory_order_relaxed);
+		inStage_ = false;
+		// Tracing is split inside the kernels; the other stages map one to one
+		if (lap_) lap_->mark(stage_ == Stage::Parse ? ProfileStage::Parse : stage_ == Stage::Scene ? ProfileStage::Scene
+		                     : stage_ == Stage::Solve ? ProfileStage::Reduction : ProfileStage::Serialise);
+	}
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	static inline thread_local bool inStage_ {false};
+	Stage stage_;
+	bool active_;
+	std::chrono::steady_clock::time_point start_;
+	std::optional<ProfileLap> lap_;
+	std::optional<TraceSpan> span_;
+};
+
+// ===== Logging =====
+// Levelled JSON-lines records. Request threads format a line and push it onto a
+// bounded lock-free ring (multi-producer, single consumer); one writer thread
+// drains it to stdout in batches. A full ring drops the line rather than block.
+
+enum class LogLevel { Debug, Info, Warn, Error };
+
+inline const char* logLevelName(LogLevel level) {
+	switch (level) {
+		case LogLevel::Debug: return "debug";
+		case LogLevel::Info: return "info";
+		case LogLevel::Warn: return "warn";
+		case LogLevel::Error: return "error";
+	}
+	return "info";
+}
+
+// Bounded MPSC queue after Vyukov: each cell's sequence says whose turn it is
+class LogRing {
+public:
+	explicit LogRing(size_t capacityPow2) : cells_(new Cell[capacityPow2]), mask_(capacityPow2 - 1) {
+		for (size_t i = 0; i < capacityPow2; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	bool push(std::string&& line) {
+		size_t pos = tail_.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells_[pos & mask_];
+			size_t seq = cell.seq.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+			if (diff == 0) {
+				if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.line = std::move(line);
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Consumer thread only
+	bool pop(std::string& line) {
+		Cell& cell = cells_[head_ & mask_];
+		if (cell.seq.load(std::memory_order_acquire) != head_ + 1) return false;
+		line = std::move(cell.line);
+		cell.line.clear();
+		cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+		++head_;
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq {0};
+		std::string line;
+	};
+	std::unique_ptr<Cell[]> cells_;
+	const size_t mask_;
+	std::atomic<size_t> tail_ {0};
+	size_t head_ {0};
+};
+
+class Logger {
+public:
+	explicit Logger(size_t capacityPow2) : ring_(capacityPow2) {}
+	~Logger() { stop(); }
+
+	// Until start() only warnings and errors are recorded, written straight to
+	// stderr, so embedders that never start the writer (calcus, bench, libtra)
+	// still see them and pay one relaxed load per debug or info record
+	void start() {
+		if (writer_.joinable()) return;
+		writer_ = std::thread([this]() { run(); });
+		running_.store(true, std::memory_order_relaxed);
+	}
+
+	void stop() {
+		if (!writer_.joinable()) return;
+		running_.store(false, std::memory_order_relaxed);
+		stopping_.store(true, std::memory_order_release);
+		writer_.join();
+	}
+
+	void submit(std::string&& line) {
+		if (!running_.load(std::memory_order_relaxed)) {
+			line += '\n';
+			std::fwrite(line.data(), 1, line.size(), stderr);
+			return;
+		}
+		if (!ring_.push(std::move(line))) dropped_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool enabled(LogLevel level) const {
+		if (static_cast<int>(level) < level_.load(std::memory_order_relaxed)) return false;
+		return level >= LogLevel::Warn || running_.load(std::memory_order_relaxed);
+	}
+	void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+	std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+	void run() {
+		std::string batch, line;
+		for (;;) {
+			const bool stopping = stopping_.load(std::memory_order_acquire);
+			while (batch.size() < (1u << 16) && ring_.pop(line)) {
+				batch += line;
+				batch += '\n';
+			}
+			if (!batch.empty()) {
+				std::fwrite(batch.data(), 1, batch.size(), stdout);
+				std::fflush(stdout);
+				batch.clear();
+			} else if (stopping) {
+				return;
+			} else {
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		}
+	}
+
+	LogRing ring_;
+	std::thread writer_;
+	std::atomic<bool> running_ {false};
+	std::atomic<bool> stopping_ {false};
+	std::atomic<int> level_ {static_cast<int>(LogLevel::Info)};
+	std::atomic<std::uint64_t> dropped_ {0};
+};
+
+extern Logger g_logger;
+
+// Set per request thread so concurrent requests' lines can be told apart
+inline thread_local std::uint64_t t_requestId = 0;
+
+// One record: LogRecord(LogLevel::Info, "message").field("key", value)...;
+// formatted only when the level is enabled, submitted when it goes out of scope
+class LogRecord {
+public:
+	LogRecord(LogLevel level, std::string_view message) : enabled_(g_logger.enabled(level)), out_(enabled_ ? 192 : 0, 0) {
+		if (!enabled_) return;
+		double ts = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+		out_.raw("{\"ts\":").number(std::round(ts * 1000.0) / 1000.0);
+		out_.raw(",\"level\":\"").raw(logLevelName(level)).raw("\",\"msg\":").string(message);
+		if (t_requestId) out_.raw(",\"req\":").integer(t_requestId);
+	}
+	~LogRecord() {
+		if (!enabled_) return;
+		out_.raw('}');
+		g_logger.submit(out_.take());
+	}
+	LogRecord(const LogRecord&) = delete;
+	LogRecord& operator=(const LogRecord&) = delete;
+
+	template <typename T>
+	LogRecord& field(std::string_view key, const T& value) {
+		if (!enabled_) return *this;
+		out_.raw(',').string(key).raw(':');
+		if constexpr (std::is_same_v<T, bool>) out_.raw(value ? "true" : "false");
+		else if constexpr (std::is_integral_v<T> && std::is_unsigned_v<T>) out_.integer(value);
+		else if constexpr (std::is_arithmetic_v<T>) out_.number(static_cast<double>(value));
+		else if constexpr (std::is_same_v<T, Vec3>) {
+			out_.raw('[').number(value.x).raw(',').number(value.y).raw(',').number(value.z).raw(']');
+		} else out_.string(std::string_view(value));
+		return *this;
+	}
+
+private:
+	bool enabled_;
+	JsonWriter out_;
+};
+
+inline bool logEnabled(LogLevel level) { return g_logger.enabled(level); }
+
+// ===== Trace export =====
+// Off by default. With --trace-requests a request carrying "X-Trace: 1" is traced,
+// with --trace-all every compute request is. Traces are written off the request
+// thread to --trace-dir as trace-<run>-<request>.json, where <run> is the server's
+// start time, and the oldest files beyond --trace-keep are deleted.
+
+extern bool g_traceAll;
+extern bool g_traceRequests;
+
+class TraceWriter {
+public:
+	~TraceWriter() { stop(); }
+
+	// Existing trace files in dir count towards keep
+	void start(std::string dir, size_t keep);
+	void stop();
+
+	// File name the trace will be written under, or empty if the writer is not
+	// running or too far behind (the job itself still succeeds)
+	std::string submit(std::unique_ptr<JobTrace> trace);
+
+private:
+	void run();
+	void prune();
+
+	std::string dir_;
+	size_t keep_ {0};
+	std::string runTag_;
+	std::thread writer_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::deque<std::pair<std::string, std::unique_ptr<JobTrace>>> queue_;
+	std::deque<std::string> files_;    // oldest first; writer thread only
+	bool stopping_ {false};
+};
+
+extern TraceWriter g_traceWriter;
@@ -0,0 +1,112 @@
+#pragma once
+
+// Public C++ API of the radiation engine. The server, calcus and bench all go
+// through the same library; this header is the part that is meant to stay put
+// while the internals move. Build a Scene (from request JSON or piece by piece),
+// solve it and read back one value grid per receiver plane.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+
+struct JsonInput;
+
+namespace tra {
+
+using ::Vec3;
+using ::ReceiverPoint;
+
+// Values of one receiver plane, row-major (width x height for grids)
+struct PlaneResult {
+	std::string name;
+	size_t width {0};
+	size_t height {0};
+	std::vector<double> values;
+};
+
+struct Results {
+	std::vector<PlaneResult> planes;    // by plane name
+};
+
+struct SolveOptions;
+
+class Scene {
+public:
+	Scene();
+	~Scene();
+	Scene(const Scene& other);
+	Scene& operator=(const Scene& other);
+	Scene(Scene&&) noexcept;
+	Scene& operator=(Scene&&) noexcept;
+
+	// The /calculate request schema. Fields only other endpoints use (query,
+	// variations, series, search) are read but have no effect on solve().
+	static std::optional<Scene> fromJson(std::string_view json, std::string& error);
+
+	void addEmitter(std::vector<Vec3> polygon, double temperature);
+	// reflectivity > 0 only matters with setReflections(true)
+	void addBlocker(std::vector<Vec3> polygon, double reflectivity = 0.0);
+	// Planes are reported by name, points row by row; false (and nothing added) if the
+	// name is taken, there are not width x height points, or the scene would pass 2^24
+	bool addReceiverPlane(const std::string& name, size_t width, size_t height, std::vector<ReceiverPoint> points);
+	// width x height points spanning origin + u (columns) and origin + v (rows); also
+	// false for an empty grid or one past the per-scene limit of 2^24 points
+	bool addReceiverGrid(const std::string& name, size_t width, size_t height,
+	                     const Vec3& origin, const Vec3& u, const Vec3& v, const Vec3& normal);
+
+	// New value for an emitter (in addEmitter order); replaces any temperature field.
+	// Geometry is unchanged, so the next solve reuses the cached view factors.
+	void setTemperature(size_t emitter, double temperature);
+
+	void setRays(size_t raysPerPoint);
+	void setSeed(std::uint64_t seed);    // unseeded scenes draw a fresh seed per solve
+	void setReflections(bool enabled);   // default patch settings
+
+	size_t numPoints() const;
+	size_t numEmitters() const;
+	size_t numRays() const;
+	int precision() const;    // the request's "precision", for toJson
+
+	// Same checks as the request parser: at least one receiver point and one emitter
+	bool validate(std::string& error) const;
+
+private:
+	friend std::optional<Results> solve(const Scene& scene, const SolveOptions& options);
+	friend bool solveInto(const Scene& scene, const SolveOptions& options, double* values);
+
+	std::unique_ptr<JsonInput> in_;
+};
+
+struct SolveOptions {
+	// Fraction of receiver points traced, in whole percents; called from engine
+	// threads, one call at a time, and with 1.0 once the solve is complete
+	std::function<void(double fraction)> progress;
+	// Checked between receiver points; once set the solve stops early
+	const std::atomic<bool>* cancel {nullptr};
+};
+
+// Every receiver point at the scene's ray count, or within its deadline/allocation
+// budget (scenes with reflections always use the full count). View-factor
+// matrices are shared through the engine's cache, so re-solving a scene with new
+// temperatures skips tracing. Thread-safe.
+Results solve(const Scene& scene);
+// As above; nothing if options.cancel was set before the solve completed
+std::optional<Results> solve(const Scene& scene, const SolveOptions& options);
+// As above, straight into values[0, numPoints()): each plane's values in turn, in
+// the order the planes were added, with no per-plane copies. false (values
+// unspecified) if options.cancel was set before the solve completed.
+bool solveInto(const Scene& scene, const SolveOptions& options, double* values);
+
+// {"planes":[...]} as in the server's /calculate response; precision 0 selects
+// shortest round-trip formatting
+std::string toJson(const Results& results, int precision = 6);
+
+}  // namespace tra
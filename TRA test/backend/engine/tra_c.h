@@ -0,0 +1,93 @@
+#ifndef TRA_C_H
+#define TRA_C_H
+
+/* C ABI of the radiation engine, for tools that link it in-process instead of
+ * posting to /calculate. Scenes are built from flat arrays (points and vertices
+ * as packed x, y, z doubles) and solved straight into caller-owned buffers.
+ *
+ * Every call returning tra_status leaves a message for tra_last_error() on
+ * failure. Distinct scenes may be used from different threads at once; a single
+ * scene must not be modified while it is being solved. View factors are cached
+ * engine-wide, so re-solving after tra_scene_set_temperatures skips tracing. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(TRA_BUILD_DLL)
+#define TRA_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(TRA_USE_DLL)
+#define TRA_API __declspec(dllimport)
+#elif !defined(_WIN32) && defined(__GNUC__)
+#define TRA_API __attribute__((visibility("default")))
+#else
+#define TRA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum tra_status {
+	TRA_OK = 0,
+	TRA_INVALID_ARGUMENT = 1,    /* null pointer, bad count, duplicate plane name */
+	TRA_INVALID_SCENE = 2,       /* no receiver points or no emitters */
+	TRA_BUFFER_TOO_SMALL = 3,    /* fewer values than tra_scene_num_points */
+	TRA_CANCELLED = 4,
+	TRA_INTERNAL_ERROR = 5
+} tra_status;
+
+typedef struct tra_scene tra_scene;
+
+/* Called with the fraction of receiver points traced (whole percents, then 1.0
+ * on completion), from engine threads but never concurrently. Return non-zero
+ * to cancel the solve. */
+typedef int (*tra_progress_fn)(double fraction, void* user_data);
+
+TRA_API tra_scene* tra_scene_create(void);
+TRA_API void tra_scene_destroy(tra_scene* scene);
+
+/* count polygons; polygon k has vertex_counts[k] vertices, taken in order from
+ * vertices (3 doubles each) */
+TRA_API tra_status tra_scene_add_emitters(tra_scene* scene, size_t count, const size_t* vertex_counts,
+                                          const double* vertices, const double* temperatures);
+/* reflectivities may be NULL (black blockers); values > 0 need tra_scene_set_reflections */
+TRA_API tra_status tra_scene_add_blockers(tra_scene* scene, size_t count, const size_t* vertex_counts,
+                                          const double* vertices, const double* reflectivities);
+
+/* One receiver plane of count = width * height points, row by row; its values
+ * follow the points of the planes added before it in tra_solve's output. Plane
+ * names must be unique, and a scene holds at most 2^24 receiver points. */
+TRA_API tra_status tra_scene_add_receivers(tra_scene* scene, const char* name, size_t width, size_t height,
+                                           size_t count, const double* origins, const double* normals);
+/* width x height points spanning origin + u (columns) and origin + v (rows); a
+ * scene holds at most 2^24 receiver points */
+TRA_API tra_status tra_scene_add_receiver_grid(tra_scene* scene, const char* name, size_t width, size_t height,
+                                               const double origin[3], const double u[3], const double v[3],
+                                               const double normal[3]);
+
+/* New temperatures for the first count emitters */
+TRA_API tra_status tra_scene_set_temperatures(tra_scene* scene, size_t count, const double* temperatures);
+TRA_API void tra_scene_set_rays(tra_scene* scene, size_t rays_per_point);
+TRA_API void tra_scene_set_seed(tra_scene* scene, uint64_t seed);
+TRA_API void tra_scene_set_reflections(tra_scene* scene, int enabled);
+TRA_API size_t tra_scene_num_points(const tra_scene* scene);
+
+/* Solves straight into values[0 .. tra_scene_num_points), in the order receivers
+ * were added. progress may be NULL. On TRA_CANCELLED the buffer contents are
+ * unspecified. */
+TRA_API tra_status tra_solve(tra_scene* scene, double* values, size_t capacity,
+                             tra_progress_fn progress, void* user_data);
+
+/* Stops a running tra_solve on scene; safe from any thread. A cancel issued
+ * before tra_solve starts cancels that solve; the request is cleared when
+ * tra_solve returns. */
+TRA_API void tra_scene_cancel(tra_scene* scene);
+
+/* Message for the last failed call on this thread; never NULL */
+TRA_API const char* tra_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRA_C_H */
@@ -0,0 +1,165 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "admission.hpp"
+#include "json.hpp"
+#include "radiosity.hpp"
+#include "telemetry.hpp"
+#include "view_factors.hpp"
+
+// ===== Transient fire curves =====
+// Emitters follow time series; geometry is fixed, so the view-factor matrix is
+// built (or fetched from the cache) once and each time step is a sparse mat-vec.
+// Dose is the trapezoidal time integral of each point's value.
+
+struct TransientPlaneResult {
+	std::string name;
+	size_t width {0};
+	size_t height {0};
+	std::vector<double> peak;
+	std::vector<double> peakTime;
+	std::vector<double> dose;
+	std::vector<double> history;    // [step][point], points row-major as in "values"
+};
+
+static std::vector<double> transientTimeSteps(const JsonInput& in) {
+	if (!in.timeSteps.empty()) return in.timeSteps;
+	std::vector<double> times;
+	for (const auto& series : in.emitterSeries) times.insert(times.end(), series.time.begin(), series.time.end());
+	std::sort(times.begin(), times.end());
+	times.erase(std::unique(times.begin(), times.end()), times.end());
+	return times;
+}
+
+std::string runTransientCalculation(std::string_view input, JobReport& job, bool& ok) {
+	JsonInput in;
+	std::string err;
+	if (!parseInputJson(input, in, err)) {
+		ok = false;
+		return errorJson(err);
+	}
+	if (budgetRequested(in)) {
+		ok = false;
+		return errorJson("'deadline_ms' and 'allocation' are only supported by /calculate");
+	}
+	if (reflectionsActive(in)) {
+		ok = false;
+		return errorJson("Reflections are only supported by /calculate");
+	}
+	const std::vector<double> times = transientTimeSteps(in);
+	if (times.empty()) {
+		ok = false;
+		return errorJson("Transient request needs 'time_steps' or at least one emitter 'series'");
+	}
+	for (size_t k = 1; k < times.size(); ++k) {
+		if (!(times[k] > times[k - 1])) {
+			ok = false;
+			return errorJson("'time_steps' must be strictly increasing");
+		}
+	}
+	std::string refusal;
+	if (!admitJob(in, job, refusal)) {
+		ok = false;
+		return refusal;
+	}
+
+	const size_t numSteps = times.size();
+	const size_t numEmitters = in.polygons.size();
+	LogRecord(LogLevel::Info, "Transient").field("steps", numSteps).field("points", in.receiverPoints.size()).field("emitters", numEmitters);
+	std::shared_ptr<const ViewFactorMatrix> matrix = acquireViewFactorMatrix(in);
+
+	// Column values per step, stored [column][step] so each matrix entry scales a
+	// contiguous run. A series drives all of an emitter's columns uniformly.
+	const std::vector<double> steadyValues = emitterColumnValues(in.polygons, matrix->columnStart);
+	std::vector<double> emitterValues(matrix->numEmitters * numSteps);
+	for (size_t e = 0; e < numEmitters; ++e) {
+		const bool varying = e < in.emitterSeries.size() && !in.emitterSeries[e].empty();
+		for (size_t c = matrix->columnStart[e]; c < matrix->columnStart[e + 1]; ++c) {
+			for (size_t s = 0; s < numSteps; ++s) {
+				emitterValues[c * numSteps + s] = varying ? in.emitterSeries[e].at(times[s]) : steadyValues[c];
+			}
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<TransientPlaneResult> planes;
+	std::vector<double> row(numSteps);
+	size_t numValues = 0;
+	for (const auto& planePair : in.planeDataMap) {
+		TraceSpan span("plane", planePair.first);
+		const PlaneData& pd = planePair.second;
+		TransientPlaneResult plane;
+		plane.name = planePair.first;
+		plane.width = pd.width;
+		plane.height = pd.height;
+		const size_t n = std::min(pd.numPoints, matrix->numPoints - std::min(pd.firstPoint, matrix->numPoints));
+		plane.peak.resize(n);
+		plane.peakTime.resize(n);
+		plane.dose.resize(n);
+		plane.history.resize(n * numSteps);
+		for (size_t i = 0; i < n; ++i) {
+			const size_t r = pd.firstPoint + i;
+			std::fill(row.begin(), row.end(), 0.0);
+			for (size_t k = matrix->rowStart[r]; k < matrix->rowStart[r + 1]; ++k) {
+				const double f = matrix->factors[k];
+				const double* values = &emitterValues[matrix->emitterIdx[k] * numSteps];
+				for (size_t s = 0; s < numSteps; ++s) row[s] += f * values[s];
+			}
+			size_t peakStep = 0;
+			double dose = 0.0;
+			for (size_t s = 0; s < numSteps; ++s) {
+				plane.history[s * n + i] = row[s];
+				if (row[s] > row[peakStep]) peakStep = s;
+				if (s > 0) dose += 0.5 * (row[s] + row[s - 1]) * (times[s] - times[s - 1]);
+			}
+			plane.peak[i] = row[peakStep];
+			plane.peakTime[i] = times[peakStep];
+			plane.dose[i] = dose;
+		}
+		numValues += n * (numSteps + 3);
+		planes.push_back(std::move(plane));
+	}
+	double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	LogRecord(LogLevel::Info, "Transient evaluated").field("steps", numSteps).field("elapsed_ms", elapsedMs);
+
+	auto writeArray = [](JsonWriter& out, const std::vector<double>& values, size_t begin, size_t count) {
+		out.raw('[');
+		for (size_t i = 0; i < count; ++i) {
+			if (i > 0) out.raw(',');
+			out.number(values[begin + i]);
+		}
+		out.raw(']');
+	};
+
+	StageTimer timer(Stage::Serialise);
+	JsonWriter out(128 + planes.size() * 128 + (numValues + numSteps) * (JsonWriter::maxNumberChars(in.precision) + 1), in.precision);
+	out.raw("{\"success\":true,\"times\":");
+	writeArray(out, times, 0, numSteps);
+	out.raw(",\"planes\":[");
+	for (size_t p = 0; p < planes.size(); ++p) {
+		const TransientPlaneResult& plane = planes[p];
+		const size_t n = plane.peak.size();
+		if (p > 0) out.raw(',');
+		out.raw("{\"name\":").string(plane.name);
+		out.raw(",\"width\":").integer(plane.width);
+		out.raw(",\"height\":").integer(plane.height);
+		out.raw(",\"peak\":");
+		writeArray(out, plane.peak, 0, n);
+		out.raw(",\"peak_time\":");
+		writeArray(out, plane.peakTime, 0, n);
+		out.raw(",\"dose\":");
+		writeArray(out, plane.dose, 0, n);
+		out.raw(",\"history\":[");
+		for (size_t s = 0; s < numSteps; ++s) {
+			if (s > 0) out.raw(',');
+			writeArray(out, plane.history, s * n, n);
+		}
+		out.raw("]}");
+	}
+	out.raw("]}");
+	ok = true;
+	return out.take();
+}
@@ -0,0 +1,590 @@
+#include "view_factors.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <string>
+
+#include "parallel.hpp"
+#include "telemetry.hpp"
+
+template <typename Attenuation>
+static ViewFactorResult traceViewFactors(
+	const Vec3& origin,
+	const Vec3& originNormal,
+	const std::vector<PolygonWithTemp>& emitterPolygons,
+	const std::vector<std::vector<Vec3>>& inertPolygons,
+	size_t numRays,
+	std::mt19937_64& rng,
+	const Attenuation& attenuate
+) {
+	ViewFactorResult res;
+	res.viewFactors.assign(emitterPolygons.size(), 0.0);
+	res.secondMoments.assign(emitterPolygons.size(), 0.0);
+	if (numRays == 0) return res;
+
+	ProfileLap lap;
+	std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, originNormal, rng);
+	res.allRayDirs = rays;
+	lap.mark(ProfileStage::RayGeneration);
+
+	struct PolyData { std::vector<Vec3> verts; Vec3 normal; Vec3 point; bool valid; };
+	std::vector<PolyData> inertScene;
+	inertScene.reserve(inertPolygons.size());
+	for (const auto& poly : inertPolygons) {
+		auto pl = getPolygonPlane(poly);
+		if (!pl) inertScene.push_back({poly, {0,0,0}, {0,0,0}, false});
+		else inertScene.push_back({poly, pl->normal, pl->point, true});
+	}
+
+	std::vector<PolyData> emitScene;
+	emitScene.reserve(emitterPolygons.size());
+	for (const auto& poly : emitterPolygons) {
+		auto pl = getPolygonPlane(poly.vertices);
+		if (!pl) emitScene.push_back({poly.vertices, {0,0,0}, {0,0,0}, false});
+		else emitScene.push_back({poly.vertices, pl->normal, pl->point, true});
+	}
+
+	std::vector<double> hitWeights(emitterPolygons.size(), 0.0);
+	std::vector<double> hitWeightsSq(emitterPolygons.size(), 0.0);
+	size_t validPolygons = 0;
+	for (const auto& pd : inertScene) validPolygons += pd.valid;
+	for (const auto& pd : emitScene) validPolygons += pd.valid;
+	countTraced(numRays, validPolygons);
+	size_t insideTests = 0;
+	lap.mark(ProfileStage::Scene);
+
+	for (size_t i = 0; i < numRays; ++i) {
+		const Vec3& rdir = rays[i];
+		double closestInert = std::numeric_limits<double>::infinity();
+		double closestEmit = std::numeric_limits<double>::infinity();
+		int finalIdx = -1;
+		Vec3 closestPoint;
+
+		// Check inert polygons first (find closest inert hit)
+		for (size_t p = 0; p < inertScene.size(); ++p) {
+			const auto& pd = inertScene[p];
+			if (!pd.valid) continue;
+			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
+			if (hit) {
+				if (t < closestInert) {
+					++insideTests;
+					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
+						closestInert = t;
+					}
+				}
+			}
+		}
+
+		// Then check emitter polygons (find closest emitter hit)
+		for (size_t p = 0; p < emitScene.size(); ++p) {
+			const auto& pd = emitScene[p];
+			if (!pd.valid) continue;
+			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
+			if (hit) {
+				if (t < closestEmit) {
+					++insideTests;
+					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
+						closestEmit = t;
+						finalIdx = static_cast<int>(p);
+						closestPoint = *hit;
+					}
+				}
+			}
+		}
+
+		bool blockedByInert = (closestInert < std::numeric_limits<double>::infinity()) && (closestInert <= closestEmit);
+		if (!blockedByInert && finalIdx != -1) {
+			double w = attenuate(origin, rdir, closestEmit);
+			hitWeights[static_cast<size_t>(finalIdx)] += w;
+			hitWeightsSq[static_cast<size_t>(finalIdx)] += w * w;
+			res.hitPoints.push_back(closestPoint);
+			res.hitEmitters.push_back(static_cast<std::uint32_t>(finalIdx));
+			res.hitWeights.push_back(w);
+			res.hitRayDirs.push_back(rdir);
+		}
+	}
+
+	lap.mark(ProfileStage::Intersection);
+	profileCounts(numRays, numRays * validPolygons, insideTests, res.hitEmitters.size());
+
+	for (size_t p = 0; p < emitterPolygons.size(); ++p) {
+		res.viewFactors[p] = hitWeights[p] / static_cast<double>(numRays);
+		res.secondMoments[p] = hitWeightsSq[p] / static_cast<double>(numRays);
+	}
+	return res;
+}
+
+ViewFactorResult calculateViewFactorsWithBlockage(
+	const Vec3& origin,
+	const Vec3& originNormal,
+	const std::vector<PolygonWithTemp>& emitterPolygons,
+	const std::vector<std::vector<Vec3>>& inertPolygons,
+	size_t numRays,
+	std::mt19937_64& rng,
+	const ParticipatingMedia* media
+) {
+	if (media && !media->empty()) {
+		return traceViewFactors(origin, originNormal, emitterPolygons, inertPolygons, numRays, rng, MediumAttenuation{*media});
+	}
+	return traceViewFactors(origin, originNormal, emitterPolygons, inertPolygons, numRays, rng, NoAttenuation{});
+}
+
+std::vector<size_t> emitterColumnStart(const std::vector<PolygonWithTemp>& polygons) {
+	std::vector<size_t> start;
+	start.reserve(polygons.size() + 1);
+	start.push_back(0);
+	for (const auto& poly : polygons) start.push_back(start.back() + (poly.field ? poly.field->size() : 1));
+	return start;
+}
+
+void addEmitterHit(const PolygonWithTemp& poly, size_t firstColumn, const Vec3& hit, double weight, std::vector<double>& row) {
+	if (!poly.field) {
+		row[firstColumn] += weight;
+		return;
+	}
+	poly.field->weights(hit, [&](size_t k, double w) { row[firstColumn + k] += weight * w; });
+}
+
+SparseRow sparsifyRow(const std::vector<double>& row) {
+	SparseRow sparse;
+	for (size_t c = 0; c < row.size(); ++c) {
+		if (row[c] == 0.0) continue;
+		sparse.columns.push_back(static_cast<std::uint32_t>(c));
+		sparse.values.push_back(row[c]);
+	}
+	return sparse;
+}
+
+void appendSparseRows(ViewFactorMatrix& m, std::vector<SparseRow>& rows) {
+	size_t total = m.factors.size();
+	for (const auto& row : rows) total += row.values.size();
+	m.emitterIdx.reserve(total);
+	m.factors.reserve(total);
+	m.rowStart.reserve(m.rowStart.size() + rows.size());
+	for (auto& row : rows) {
+		m.emitterIdx.insert(m.emitterIdx.end(), row.columns.begin(), row.columns.end());
+		m.factors.insert(m.factors.end(), row.values.begin(), row.values.end());
+		m.rowStart.push_back(m.factors.size());
+		row = SparseRow();
+	}
+}
+
+// One matrix row from a kernel result; field emitters are spread over their samples
+static SparseRow emitterRow(const ViewFactorResult& res, const std::vector<PolygonWithTemp>& polygons, const std::vector<size_t>& columnStart, size_t numRays) {
+	if (columnStart.back() == polygons.size()) return sparsifyRow(res.viewFactors);
+	std::vector<double> row(columnStart.back(), 0.0);
+	for (size_t e = 0; e < polygons.size(); ++e) {
+		if (!polygons[e].field) row[columnStart[e]] = res.viewFactors[e];
+	}
+	for (size_t h = 0; h < res.hitEmitters.size(); ++h) {
+		const size_t e = res.hitEmitters[h];
+		if (polygons[e].field) addEmitterHit(polygons[e], columnStart[e], res.hitPoints[h], res.hitWeights[h] / static_cast<double>(numRays), row);
+	}
+	return sparsifyRow(row);
+}
+
+std::vector<double> emitterColumnValues(const std::vector<PolygonWithTemp>& polygons, const std::vector<size_t>& columnStart) {
+	std::vector<double> values(columnStart.back(), 0.0);
+	for (size_t e = 0; e < polygons.size(); ++e) {
+		const size_t first = columnStart[e], count = columnStart[e + 1] - first;
+		const auto& field = polygons[e].field;
+		for (size_t k = 0; k < count; ++k) values[first + k] = field && field->size() == count ? field->values[k] : polygons[e].temperature;
+	}
+	return values;
+}
+
+GeometryKey hashSceneGeometry(const JsonInput& in) {
+	GeometryHasher h;
+	// Same key before and after the grids are expanded, so admission can check the cache
+	h.add(static_cast<std::uint64_t>(receiverPointCount(in)));
+	forEachReceiverPoint(in, [&](const ReceiverPoint& rp) { h.add(rp.origin); h.add(rp.normal); });
+	h.add(static_cast<std::uint64_t>(in.polygons.size()));
+	for (const auto& poly : in.polygons) h.add(poly);
+	h.add(static_cast<std::uint64_t>(in.inertPolygons.size()));
+	for (const auto& poly : in.inertPolygons) h.add(poly);
+	h.add(in.media);
+	h.add(static_cast<std::uint64_t>(in.numRays));
+	// Unseeded requests share one entry so repeated edits reuse the same sample
+	h.add(static_cast<std::uint64_t>(in.seed.has_value() ? 1 : 0));
+	h.add(static_cast<std::uint64_t>(in.seed.value_or(0)));
+	return h.key();
+}
+
+std::uint64_t resolveSeed(const JsonInput& in) {
+	if (in.seed.has_value()) return in.seed.value();
+	std::random_device rd;
+	return (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+}
+
+static std::shared_ptr<ViewFactorMatrix> buildViewFactorMatrix(const JsonInput& in, std::uint64_t seed) {
+	StageTimer timer(Stage::Trace);
+	auto m = std::make_shared<ViewFactorMatrix>();
+	m->numPoints = in.receiverPoints.size();
+	m->columnStart = emitterColumnStart(in.polygons);
+	m->numEmitters = m->columnStart.back();
+	m->seed = seed;
+	m->rowStart.push_back(0);
+
+	// Rows are traced in parallel (each point has its own stream), kept sparse and packed in order
+	std::vector<SparseRow> rows(m->numPoints);
+	parallelFor(m->numPoints, [&](size_t pointIdx) {
+		const auto& receiverPoint = in.receiverPoints[pointIdx];
+		std::mt19937_64 pointRng(pointSeedFor(seed, pointIdx));
+		auto res = calculateViewFactorsWithBlockage(receiverPoint.origin, receiverPoint.normal, in.polygons, in.inertPolygons, in.numRays, pointRng, &in.media);
+		ProfileLap lap;
+		rows[pointIdx] = emitterRow(res, in.polygons, m->columnStart, in.numRays);
+		lap.mark(ProfileStage::Reduction);
+		jobAdvance(1);
+	});
+	ProfileLap lap;
+	appendSparseRows(*m, rows);
+	lap.mark(ProfileStage::Reduction);
+	return m;
+}
+
+std::vector<double> applyViewFactorMatrix(const ViewFactorMatrix& m, const std::vector<PolygonWithTemp>& polygons) {
+	std::vector<double> values(m.numPoints, 0.0);
+	applyViewFactorMatrix(m, polygons, values.data());
+	return values;
+}
+
+void applyViewFactorMatrix(const ViewFactorMatrix& m, const std::vector<PolygonWithTemp>& polygons, double* values) {
+	StageTimer timer(Stage::Solve);
+	const std::vector<double> columnValues = emitterColumnValues(polygons, m.columnStart);
+	for (size_t r = 0; r < m.numPoints; ++r) {
+		double total = 0.0;
+		for (size_t k = m.rowStart[r]; k < m.rowStart[r + 1]; ++k) {
+			total += m.factors[k] * columnValues[m.emitterIdx[k]];
+		}
+		values[r] = total;
+	}
+}
+
+ViewFactorCache g_viewFactorCache(std::size_t(256) << 20);
+
+// ===== Incremental recomputation within a session =====
+// When only some emitters/blockers move, a receiver row can only change if one of
+// its ray paths can reach the moved polygon's old or new bounding box. Those rows
+// are retraced with the same per-point seed; every other row is copied over.
+
+struct Aabb {
+	Vec3 lo { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
+	Vec3 hi { -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+
+	void expand(const Vec3& p) {
+		lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+		hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+	}
+	void expand(const Aabb& b) { expand(b.lo); expand(b.hi); }
+	bool empty() const { return lo.x > hi.x; }
+	bool overlaps(const Aabb& b, double eps = 1e-6) const {
+		return lo.x <= b.hi.x + eps && b.lo.x <= hi.x + eps &&
+		       lo.y <= b.hi.y + eps && b.lo.y <= hi.y + eps &&
+		       lo.z <= b.hi.z + eps && b.lo.z <= hi.z + eps;
+	}
+	// True if any corner lies strictly on the positive side of the plane (origin, normal)
+	bool inFrontOf(const Vec3& origin, const Vec3& normal) const {
+		for (int c = 0; c < 8; ++c) {
+			Vec3 corner { (c & 1) ? hi.x : lo.x, (c & 2) ? hi.y : lo.y, (c & 4) ? hi.z : lo.z };
+			if (dot(corner - origin, normal) > 1e-9) return true;
+		}
+		return false;
+	}
+};
+
+static Aabb polygonBounds(const std::vector<Vec3>& poly) {
+	Aabb b;
+	for (const auto& v : poly) b.expand(v);
+	return b;
+}
+
+static bool samePolygon(const std::vector<Vec3>& a, const std::vector<Vec3>& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z) return false;
+	}
+	return true;
+}
+
+static bool sameReceivers(const std::vector<ReceiverPoint>& a, const std::vector<ReceiverPoint>& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		const Vec3* pa[2] = {&a[i].origin, &a[i].normal};
+		const Vec3* pb[2] = {&b[i].origin, &b[i].normal};
+		for (int k = 0; k < 2; ++k) {
+			if (pa[k]->x != pb[k]->x || pa[k]->y != pb[k]->y || pa[k]->z != pb[k]->z) return false;
+		}
+	}
+	return true;
+}
+
+struct GeometryDelta {
+	std::vector<Aabb> changedBounds;   // old and new bounds of every moved polygon
+	std::vector<Aabb> emitterReach;    // per emitter: union of old and new bounds
+	size_t changedEmitters {0};
+	size_t changedInert {0};
+};
+
+// Returns nullopt when the previous scene cannot be reused (different receivers,
+// ray count, seed or polygon counts)
+static GeometryKey mediaHash(const ParticipatingMedia& media) {
+	GeometryHasher h;
+	h.add(media);
+	return h.key();
+}
+
+static std::optional<GeometryDelta> diffSceneGeometry(const JsonInput& prev, const JsonInput& cur) {
+	if (prev.numRays != cur.numRays || prev.seed != cur.seed) return std::nullopt;
+	if (prev.polygons.size() != cur.polygons.size()) return std::nullopt;
+	if (prev.inertPolygons.size() != cur.inertPolygons.size()) return std::nullopt;
+	if (mediaHash(prev.media) != mediaHash(cur.media)) return std::nullopt;
+	if (!sameReceivers(prev.receiverPoints, cur.receiverPoints)) return std::nullopt;
+
+	for (size_t e = 0; e < cur.polygons.size(); ++e) {
+		// A changed sample layout changes the columns
+		GeometryHasher a, b;
+		a.add(prev.polygons[e].field.get());
+		b.add(cur.polygons[e].field.get());
+		if (a.key() != b.key()) return std::nullopt;
+	}
+
+	GeometryDelta delta;
+	for (size_t e = 0; e < cur.polygons.size(); ++e) {
+		Aabb reach = polygonBounds(cur.polygons[e].vertices);
+		if (!samePolygon(prev.polygons[e].vertices, cur.polygons[e].vertices)) {
+			Aabb old = polygonBounds(prev.polygons[e].vertices);
+			delta.changedBounds.push_back(old);
+			delta.changedBounds.push_back(reach);
+			reach.expand(old);
+			++delta.changedEmitters;
+		}
+		delta.emitterReach.push_back(reach);
+	}
+	for (size_t p = 0; p < cur.inertPolygons.size(); ++p) {
+		if (!samePolygon(prev.inertPolygons[p], cur.inertPolygons[p])) {
+			delta.changedBounds.push_back(polygonBounds(prev.inertPolygons[p]));
+			delta.changedBounds.push_back(polygonBounds(cur.inertPolygons[p]));
+			++delta.changedInert;
+		}
+	}
+	return delta;
+}
+
+// Conservative: the rays from a point to emitter e stay inside the box spanned by
+// the point and e's (old or new) bounds, so only boxes overlapping that can matter
+static bool isReceiverAffected(const ReceiverPoint& rp, const GeometryDelta& delta) {
+	for (const auto& changed : delta.changedBounds) {
+		if (changed.empty() || !changed.inFrontOf(rp.origin, rp.normal)) continue;
+		for (const auto& reach : delta.emitterReach) {
+			if (reach.empty() || !reach.inFrontOf(rp.origin, rp.normal)) continue;
+			Aabb path = reach;
+			path.expand(rp.origin);
+			if (path.overlaps(changed)) return true;
+		}
+	}
+	return false;
+}
+
+static std::shared_ptr<ViewFactorMatrix> updateViewFactorMatrix(
+	const ViewFactorMatrix& prev,
+	const JsonInput& in,
+	const GeometryDelta& delta,
+	size_t& recomputedRows
+) {
+	StageTimer timer(Stage::Trace);
+	auto m = std::make_shared<ViewFactorMatrix>();
+	m->numPoints = prev.numPoints;
+	m->numEmitters = prev.numEmitters;
+	m->columnStart = prev.columnStart;
+	m->seed = prev.seed;
+	m->rowStart.reserve(m->numPoints + 1);
+	m->rowStart.push_back(0);
+	m->emitterIdx.reserve(prev.emitterIdx.size());
+	m->factors.reserve(prev.factors.size());
+	// Affected rows are retraced in parallel with their original streams and the rest
+	// copied; a cancelled job leaves rows empty, and its matrix is never cached
+	std::vector<size_t> affected;
+	for (size_t pointIdx = 0; pointIdx < in.receiverPoints.size(); ++pointIdx) {
+		if (isReceiverAffected(in.receiverPoints[pointIdx], delta)) affected.push_back(pointIdx);
+	}
+	std::vector<SparseRow> rows(affected.size());
+	parallelFor(affected.size(), [&](size_t k) {
+		const auto& receiverPoint = in.receiverPoints[affected[k]];
+		std::mt19937_64 pointRng(pointSeedFor(prev.seed, affected[k]));
+		auto res = calculateViewFactorsWithBlockage(receiverPoint.origin, receiverPoint.normal, in.polygons, in.inertPolygons, in.numRays, pointRng, &in.media);
+		rows[k] = emitterRow(res, in.polygons, m->columnStart, in.numRays);
+		jobAdvance(1);
+	});
+	recomputedRows = affected.size();
+
+	ProfileLap lap;
+	size_t next = 0;
+	for (size_t pointIdx = 0; pointIdx < in.receiverPoints.size(); ++pointIdx) {
+		if (next < affected.size() && affected[next] == pointIdx) {
+			const SparseRow& row = rows[next++];
+			m->emitterIdx.insert(m->emitterIdx.end(), row.columns.begin(), row.columns.end());
+			m->factors.insert(m->factors.end(), row.values.begin(), row.values.end());
+		} else {
+			size_t begin = prev.rowStart[pointIdx], end = prev.rowStart[pointIdx + 1];
+			m->emitterIdx.insert(m->emitterIdx.end(), prev.emitterIdx.begin() + begin, prev.emitterIdx.begin() + end);
+			m->factors.insert(m->factors.end(), prev.factors.begin() + begin, prev.factors.begin() + end);
+		}
+		m->rowStart.push_back(m->factors.size());
+	}
+	lap.mark(ProfileStage::Reduction);
+	jobAdvance(in.receiverPoints.size() - affected.size());
+	return m;
+}
+
+// Heap bytes of the geometry a session keeps
+static size_t sessionSceneBytes(const JsonInput& in) {
+	size_t bytes = sizeof(in) + in.receiverPoints.capacity() * sizeof(ReceiverPoint) + in.pendingGrids.capacity() * sizeof(PendingGrid)
+		+ in.polygons.capacity() * sizeof(PolygonWithTemp) + in.inertPolygons.capacity() * sizeof(std::vector<Vec3>)
+		+ in.inertReflectivity.capacity() * sizeof(double);
+	for (const auto& poly : in.polygons) {
+		bytes += poly.vertices.capacity() * sizeof(Vec3);
+		if (poly.field) bytes += sizeof(TemperatureField) + (poly.field->values.capacity() + poly.field->heights.capacity()) * sizeof(double);
+	}
+	for (const auto& poly : in.inertPolygons) bytes += poly.capacity() * sizeof(Vec3);
+	return bytes;
+}
+
+// Last scene and matrix per session id, LRU bounded by the bytes it holds
+class SessionStore {
+public:
+	struct Session {
+		JsonInput scene;
+		std::shared_ptr<const ViewFactorMatrix> matrix;
+	};
+
+	explicit SessionStore(size_t capacityBytes) : capacityBytes_(capacityBytes) {}
+
+	std::optional<Session> find(const std::string& id) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+			if (it->id == id) {
+				sessions_.splice(sessions_.begin(), sessions_, it);
+				return sessions_.front().session;
+			}
+		}
+		return std::nullopt;
+	}
+
+	// Only the geometry is kept; the matrix counts in full even when the cache shares it
+	void store(const std::string& id, const JsonInput& scene, std::shared_ptr<const ViewFactorMatrix> matrix) {
+		Session session {JsonInput(), std::move(matrix)};
+		session.scene.receiverPoints = scene.receiverPoints;
+		session.scene.polygons = scene.polygons;
+		session.scene.inertPolygons = scene.inertPolygons;
+		session.scene.inertReflectivity = scene.inertReflectivity;
+		session.scene.media = scene.media;
+		session.scene.numRays = scene.numRays;
+		session.scene.seed = scene.seed;
+		const size_t bytes = id.capacity() + sessionSceneBytes(session.scene) + session.matrix->bytes();
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+			if (it->id != id) continue;
+			bytes_ -= it->bytes;
+			sessions_.erase(it);
+			break;
+		}
+		if (bytes > capacityBytes_) return;
+		sessions_.push_front({id, std::move(session), bytes});
+		bytes_ += bytes;
+		while (bytes_ > capacityBytes_) {
+			bytes_ -= sessions_.back().bytes;
+			sessions_.pop_back();
+		}
+	}
+
+private:
+	struct Entry {
+		std::string id;
+		Session session;
+		size_t bytes;
+	};
+	std::mutex mutex_;
+	std::list<Entry> sessions_;
+	const size_t capacityBytes_;
+	size_t bytes_ {0};
+};
+
+static SessionStore g_sessions(std::size_t(128) << 20);
+
+std::shared_ptr<const ViewFactorMatrix> acquireViewFactorMatrix(const JsonInput& in) {
+	GeometryKey key;
+	std::shared_ptr<const ViewFactorMatrix> matrix;
+	{
+		StageTimer timer(Stage::Scene);
+		key = hashSceneGeometry(in);
+		matrix = g_viewFactorCache.find(key);
+	}
+	if (matrix) {
+		LogRecord(LogLevel::Info, "View-factor cache hit").field("points", matrix->numPoints).field("columns", matrix->numEmitters);
+	}
+
+	if (!matrix && in.sessionId.has_value()) {
+		if (auto session = g_sessions.find(*in.sessionId)) {
+			if (auto delta = diffSceneGeometry(session->scene, in)) {
+				size_t recomputed = 0;
+				matrix = updateViewFactorMatrix(*session->matrix, in, *delta, recomputed);
+				LogRecord(LogLevel::Info, "Incremental update").field("emitters_moved", delta->changedEmitters)
+					.field("blockers_moved", delta->changedInert).field("retraced", recomputed).field("points", matrix->numPoints);
+				if (!jobCancelled()) g_viewFactorCache.insert(key, matrix);
+			}
+		}
+	}
+
+	if (!matrix) {
+		matrix = buildViewFactorMatrix(in, resolveSeed(in));
+		if (!jobCancelled()) g_viewFactorCache.insert(key, matrix);
+	}
+
+	if (in.sessionId.has_value() && !jobCancelled()) g_sessions.store(*in.sessionId, in, matrix);
+	return matrix;
+}
+
+std::shared_ptr<const ViewFactorMatrix> deriveViewFactorMatrix(
+	const JsonInput& base,
+	const std::shared_ptr<const ViewFactorMatrix>& baseMatrix,
+	const JsonInput& variant
+) {
+	const GeometryKey key = hashSceneGeometry(variant);
+	if (key == hashSceneGeometry(base)) return baseMatrix;
+	if (auto cached = g_viewFactorCache.find(key)) return cached;
+
+	std::shared_ptr<const ViewFactorMatrix> matrix;
+	if (auto delta = diffSceneGeometry(base, variant)) {
+		size_t recomputed = 0;
+		matrix = updateViewFactorMatrix(*baseMatrix, variant, *delta, recomputed);
+	} else {
+		matrix = buildViewFactorMatrix(variant, baseMatrix->seed);
+	}
+	if (!jobCancelled()) g_viewFactorCache.insert(key, matrix);
+	return matrix;
+}
+
+PointEstimate estimatePointValue(const JsonInput& in, const ReceiverPoint& rp, std::uint64_t pointSeed, size_t numRays) {
+	PointEstimate est;
+	if (numRays == 0) return est;
+	std::mt19937_64 pointRng(pointSeed);
+	auto res = calculateViewFactorsWithBlockage(rp.origin, rp.normal, in.polygons, in.inertPolygons, numRays, pointRng, &in.media);
+	double mean = 0.0, meanSq = 0.0;
+	for (size_t p = 0; p < in.polygons.size(); ++p) {
+		if (in.polygons[p].field) continue;
+		double t = in.polygons[p].temperature;
+		mean += res.viewFactors[p] * t;
+		meanSq += res.secondMoments[p] * t * t;
+	}
+	for (size_t h = 0; h < res.hitEmitters.size(); ++h) {
+		const auto& field = in.polygons[res.hitEmitters[h]].field;
+		if (!field) continue;
+		double x = res.hitWeights[h] * field->valueAt(res.hitPoints[h]);
+		mean += x / static_cast<double>(numRays);
+		meanSq += x * x / static_cast<double>(numRays);
+	}
+	est.value = mean;
+	est.stdError = std::sqrt(std::max(0.0, meanSq - mean * mean) / static_cast<double>(numRays));
+	return est;
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+// Monte Carlo view factors: the ray kernel, the cached points x emitters matrix
+// and single-point estimates
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "scene.hpp"
+
+// Per-hit weights for the ray kernel. Scenes without media use NoAttenuation,
+// which the compiler folds back into plain hit counting.
+struct NoAttenuation {
+	double operator()(const Vec3&, const Vec3&, double) const { return 1.0; }
+};
+
+struct MediumAttenuation {
+	const ParticipatingMedia& media;
+	double operator()(const Vec3& origin, const Vec3& dir, double t) const { return std::exp(-media.opticalDepth(origin, dir, t)); }
+};
+
+// Calculate view factors from a point origin to a set of polygon emitters with occlusion between them
+struct ViewFactorResult {
+    std::vector<double> viewFactors; // per polygon (transmittance-weighted with media)
+    std::vector<double> secondMoments; // per polygon: mean of squared hit weights, for error estimates
+    std::vector<Vec3> allRayDirs;
+    std::vector<Vec3> hitPoints;
+    std::vector<Vec3> hitRayDirs; // those rays that hit some polygon
+    std::vector<std::uint32_t> hitEmitters; // per hit: emitter index
+    std::vector<double> hitWeights; // per hit: transmittance (1 without media)
+};
+
+ViewFactorResult calculateViewFactorsWithBlockage(
+	const Vec3& origin,
+	const Vec3& originNormal,
+	const std::vector<PolygonWithTemp>& emitterPolygons,
+	const std::vector<std::vector<Vec3>>& inertPolygons,
+	size_t numRays,
+	std::mt19937_64& rng,
+	const ParticipatingMedia* media = nullptr
+);
+
+// Matrix column layout: one column per plain emitter, one per sample for emitters
+// with a temperature field. start[e] is emitter e's first column; start.back() the total.
+std::vector<size_t> emitterColumnStart(const std::vector<PolygonWithTemp>& polygons);
+
+// Scatter one hit on an emitter into its columns
+void addEmitterHit(const PolygonWithTemp& poly, size_t firstColumn, const Vec3& hit, double weight, std::vector<double>& row);
+
+// Value of every column: field samples, or the emitter's temperature for plain
+// emitters and for field emitters whose field a variation has replaced
+std::vector<double> emitterColumnValues(const std::vector<PolygonWithTemp>& polygons, const std::vector<size_t>& columnStart);
+
+// ===== View-factor matrix cache =====
+// The result at each receiver point is sum_p viewFactor[p] * temperature[p], so the
+// points x emitters view-factor matrix depends only on geometry, ray count and seed.
+// It is stored sparse (CSR) and cached so temperature-only edits skip ray tracing.
+
+struct ViewFactorMatrix {
+	size_t numPoints {0};
+	size_t numEmitters {0};              // columns (see emitterColumnStart)
+	std::vector<size_t> columnStart;     // per emitter, into the columns
+	std::uint64_t seed {0};
+	std::vector<size_t> rowStart;        // numPoints + 1 offsets into emitterIdx/factors
+	std::vector<std::uint32_t> emitterIdx;
+	std::vector<double> factors;
+
+	size_t bytes() const {
+		return sizeof(*this) + columnStart.capacity() * sizeof(size_t) + rowStart.capacity() * sizeof(size_t)
+			+ emitterIdx.capacity() * sizeof(std::uint32_t) + factors.capacity() * sizeof(double);
+	}
+};
+
+// One traced row before packing: its non-zero columns in increasing order
+struct SparseRow {
+	std::vector<std::uint32_t> columns;
+	std::vector<double> values;
+};
+
+SparseRow sparsifyRow(const std::vector<double>& row);
+
+// Appends the rows in order and frees them as they are copied
+void appendSparseRows(ViewFactorMatrix& m, std::vector<SparseRow>& rows);
+
+// Geometry fingerprint: FNV-1a, a second independent hash and the hashed length.
+// Cache lookups compare all three, so a 64-bit collision alone cannot return the
+// matrix of another scene.
+struct GeometryKey {
+	std::uint64_t hash {0};
+	std::uint64_t check {0};
+	std::uint64_t bytes {0};
+
+	bool operator==(const GeometryKey& o) const { return hash == o.hash && check == o.check && bytes == o.bytes; }
+	bool operator!=(const GeometryKey& o) const { return !(*this == o); }
+};
+
+// Hashes the raw bytes of the geometry; temperatures are deliberately excluded
+class GeometryHasher {
+public:
+	void add(const void* data, size_t len) {
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < len; ++i) {
+			h_ ^= p[i];
+			h_ *= 1099511628211ull;
+			check_ = ((check_ << 5) | (check_ >> 59)) ^ p[i];
+			check_ *= 0x9e3779b97f4a7c15ull;
+		}
+		bytes_ += len;
+	}
+	void add(double v) { add(&v, sizeof(v)); }
+	void add(std::uint64_t v) { add(&v, sizeof(v)); }
+	void add(const Vec3& v) { add(v.x); add(v.y); add(v.z); }
+	void add(const std::vector<Vec3>& poly) {
+		add(static_cast<std::uint64_t>(poly.size()));
+		for (const auto& v : poly) add(v);
+	}
+	// Sample layout only; sample values are temperatures and stay out of the key
+	void add(const TemperatureField* field) {
+		if (!field) return;
+		add(static_cast<std::uint64_t>(field->kind));
+		add(static_cast<std::uint64_t>(field->width));
+		add(static_cast<std::uint64_t>(field->height));
+		for (double y : field->heights) add(y);
+	}
+	void add(const PolygonWithTemp& poly) {
+		add(poly.vertices);
+		add(poly.field.get());
+	}
+	void add(const ParticipatingMedia& media) {
+		if (media.empty()) return;
+		add(media.extinction);
+		for (const auto& v : media.volumes) {
+			add(static_cast<std::uint64_t>(v.kind));
+			add(v.min); add(v.max); add(v.point); add(v.normal);
+			add(v.thickness); add(v.extinction);
+		}
+	}
+	GeometryKey key() const { return {h_, check_, bytes_}; }
+private:
+	std::uint64_t h_ {14695981039346656037ull};
+	std::uint64_t check_ {0x243f6a8885a308d3ull};
+	std::uint64_t bytes_ {0};
+};
+
+GeometryKey hashSceneGeometry(const JsonInput& in);
+
+// Every receiver point gets its own stream derived from the request's base seed
+inline std::uint64_t pointSeedFor(std::uint64_t baseSeed, size_t pointIdx) { return baseSeed + pointIdx * 12345; }
+
+// Unseeded requests draw a fresh base seed
+std::uint64_t resolveSeed(const JsonInput& in);
+
+// Sparse matrix-vector product: one value per receiver point
+std::vector<double> applyViewFactorMatrix(const ViewFactorMatrix& m, const std::vector<PolygonWithTemp>& polygons);
+// As above, into values[0, m.numPoints)
+void applyViewFactorMatrix(const ViewFactorMatrix& m, const std::vector<PolygonWithTemp>& polygons, double* values);
+
+// LRU keyed by geometry fingerprint, shared by all request threads and bounded
+// by the bytes its matrices hold; a matrix larger than the whole budget is not kept
+class ViewFactorCache {
+public:
+	explicit ViewFactorCache(size_t capacityBytes) : capacityBytes_(capacityBytes) {}
+
+	std::shared_ptr<const ViewFactorMatrix> find(const GeometryKey& key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+			if (it->key == key) {
+				entries_.splice(entries_.begin(), entries_, it);
+				++hits_;
+				return entries_.front().matrix;
+			}
+		}
+		++misses_;
+		return nullptr;
+	}
+
+	struct Stats { std::uint64_t hits, misses; size_t entries, bytes; };
+	Stats stats() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return {hits_, misses_, entries_.size(), bytes_};
+	}
+
+	// Lookup without touching recency or the hit counters
+	bool contains(const GeometryKey& key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto& e : entries_) if (e.key == key) return true;
+		return false;
+	}
+
+	void insert(const GeometryKey& key, std::shared_ptr<const ViewFactorMatrix> matrix) {
+		const size_t bytes = matrix->bytes();
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+			if (it->key != key) continue;
+			bytes_ -= it->bytes;
+			entries_.erase(it);
+			break;
+		}
+		if (bytes > capacityBytes_) return;
+		entries_.push_front({key, std::move(matrix), bytes});
+		bytes_ += bytes;
+		while (bytes_ > capacityBytes_) {
+			bytes_ -= entries_.back().bytes;
+			entries_.pop_back();
+		}
+	}
+
+private:
+	struct Entry {
+		GeometryKey key;
+		std::shared_ptr<const ViewFactorMatrix> matrix;
+		size_t bytes;
+	};
+	std::mutex mutex_;
+	std::list<Entry> entries_;
+	const size_t capacityBytes_;
+	size_t bytes_ {0};
+	std::uint64_t hits_ {0};
+	std::uint64_t misses_ {0};
+};
+
+extern ViewFactorCache g_viewFactorCache;
+
+// Cached, session-updated or freshly traced matrix for the request's geometry
+std::shared_ptr<const ViewFactorMatrix> acquireViewFactorMatrix(const JsonInput& in);
+
+// Matrix for a variant of an already-compiled scene: shared cache entry if the
+// geometry was seen before, otherwise only the rows affected by the differences
+// are retraced (same seed, so shared rows are identical)
+std::shared_ptr<const ViewFactorMatrix> deriveViewFactorMatrix(
+	const JsonInput& base,
+	const std::shared_ptr<const ViewFactorMatrix>& baseMatrix,
+	const JsonInput& variant
+);
+
+// ===== Point estimates =====
+// Direct Monte Carlo estimate at a single receiver point, with its standard error.
+// Each ray scores the temperature of the emitter it reaches (or 0), so
+// var = (sum VF_e T_e^2 - (sum VF_e T_e)^2) / N.
+struct PointEstimate {
+	double value {0.0};
+	double stdError {0.0};
+};
+
+PointEstimate estimatePointValue(const JsonInput& in, const ReceiverPoint& rp, std::uint64_t pointSeed, size_t numRays);
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "geometry.hpp"
+
+// ===== Binary wire format =====
+// Content-Type / Accept: application/x-tra-binary. Little-endian throughout; every
+// block is padded to 8 bytes so the browser can view arrays in place as
+// Float32Array/Float64Array.
+//
+// Request:
+//   header (32 bytes)  "TRAQ", u16 version, u8 scalar bytes (4|8), u8 flags
+//                      (bit0 seed, bit1 session id), u32 num_rays, u32 planes,
+//                      u32 emitters, u32 inert, u64 seed
+//   [session]          u32 length, bytes                                   (pad 8)
+//   per plane          u32 name length, u32 kind (0 points, 1 grid), u32 width,
+//                      u32 height, u32 point count, u32 reserved, name     (pad 8)
+//                      kind 0: count x {origin xyz, normal xyz}
+//                      kind 1: origin, u_axis, v_axis, normal              (pad 8)
+//   per emitter        u32 vertex count, u32 reserved, temperature, vertices (pad 8)
+//   per inert polygon  u32 vertex count, u32 reserved, vertices            (pad 8)
+//
+// Response:
+//   header (16 bytes)  "TRAR", u16 version, u8 scalar bytes, u8 reserved,
+//                      u32 planes, u32 reserved
+//   per plane          u32 name length, u32 width, u32 height, u32 value count,
+//                      name (pad 8), values (pad 8)
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary wire format assumes a little-endian host");
+#endif
+
+inline constexpr const char* kBinaryContentType = "application/x-tra-binary";
+inline constexpr std::uint16_t kBinaryVersion = 1;
+
+class BinaryReader {
+public:
+	explicit BinaryReader(std::string_view data) : s_(data) {}
+
+	bool fail(const std::string& what) {
+		if (error_.empty()) error_ = what + " at offset " + std::to_string(i_);
+		return false;
+	}
+	const std::string& error() const { return error_; }
+
+	bool bytes(void* dst, size_t n) {
+		if (s_.size() - i_ < n) return fail("Truncated binary payload");
+		std::memcpy(dst, s_.data() + i_, n);
+		i_ += n;
+		return true;
+	}
+	bool view(std::string_view& out, size_t n) {
+		if (s_.size() - i_ < n) return fail("Truncated binary payload");
+		out = s_.substr(i_, n);
+		i_ += n;
+		return true;
+	}
+	template <class T> bool value(T& out) { return bytes(&out, sizeof(T)); }
+
+	// Coordinates and temperatures; NaN and infinities are refused as in JSON
+	bool scalar(double& out, size_t scalarBytes) {
+		if (scalarBytes == 4) {
+			float f;
+			if (!value(f)) return false;
+			out = f;
+		} else if (!value(out)) {
+			return false;
+		}
+		return std::isfinite(out) || fail("Non-finite scalar");
+	}
+	bool vec3(Vec3& v, size_t scalarBytes) {
+		return scalar(v.x, scalarBytes) && scalar(v.y, scalarBytes) && scalar(v.z, scalarBytes);
+	}
+	bool align8() {
+		size_t pad = (8 - (i_ % 8)) % 8;
+		if (s_.size() - i_ < pad) return fail("Truncated binary payload");
+		i_ += pad;
+		return true;
+	}
+	bool atEnd() const { return i_ == s_.size(); }
+	size_t remaining() const { return s_.size() - i_; }
+
+	// Fails unless count elements of at least elementBytes each can still follow;
+	// counts come from the client and are checked before they size anything
+	bool fits(std::uint64_t count, size_t elementBytes, const char* what) {
+		if (count > remaining() / elementBytes) return fail(std::string(what) + " count exceeds the payload");
+		return true;
+	}
+
+private:
+	std::string_view s_;
+	size_t i_ {0};
+	std::string error_;
+};
+
+class BinaryWriter {
+public:
+	explicit BinaryWriter(size_t reserveBytes) { out_.reserve(reserveBytes); }
+
+	void bytes(const void* src, size_t n) { out_.append(static_cast<const char*>(src), n); }
+	template <class T> void value(T v) { bytes(&v, sizeof(T)); }
+	void scalar(double v, size_t scalarBytes) {
+		if (scalarBytes == 4) value(static_cast<float>(v));
+		else value(v);
+	}
+	void align8() { out_.append((8 - (out_.size() % 8)) % 8, '\0'); }
+	std::string take() { return std::move(out_); }
+
+private:
+	std::string out_;
+};
+
+// How the request was encoded and how the response should be
+struct WireFormat {
+	bool binaryRequest {false};
+	bool binaryResponse {false};
+	size_t responseScalarBytes {4};
+};
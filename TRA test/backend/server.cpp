@@ -1,833 +1,347 @@
 #include "include/httplib.h"
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <array>
-#include <cmath>
 #include <cstdint>
 #include <iomanip>
-#include <limits>
-#include <numeric>
-#include <optional>
-#include <random>
-#include <tuple>
-#include <utility>
-#include <vector>
-#include <fstream>
 #include <sstream>
 #include <cstdlib>
 #include <map>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#ifndef _WIN32
+#include <sys/resource.h>
 #endif
 
-// ===== Include all the calculation logic from calcus.cpp =====
-
-// Simple 3D vector struct with basic operations
-struct Vec3 {
-    double x;
-    double y;
-    double z;
+#include "engine/admission.hpp"
+#include "engine/jobs.hpp"
+#include "engine/telemetry.hpp"
+#include "engine/view_factors.hpp"
+#include "engine/wire.hpp"
 
-    Vec3() : x(0.0), y(0.0), z(0.0) {}
-    Vec3(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+// ===== Metrics (GET /metrics, Prometheus text format) =====
 
-    Vec3 operator+(const Vec3& other) const { return {x + other.x, y + other.y, z + other.z}; }
-    Vec3 operator-(const Vec3& other) const { return {x - other.x, y - other.y, z - other.z}; }
-    Vec3 operator*(double s) const { return {x * s, y * s, z * s}; }
-    Vec3 operator/(double s) const { return {x / s, y / s, z / s}; }
-
-    Vec3& operator+=(const Vec3& other) { x += other.x; y += other.y; z += other.z; return *this; }
-    Vec3& operator-=(const Vec3& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
-    Vec3& operator*=(double s) { x *= s; y *= s; z *= s; return *this; }
-    Vec3& operator/=(double s) { x /= s; y /= s; z /= s; return *this; }
-};
-
-static inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-static inline Vec3 cross(const Vec3& a, const Vec3& b) {
-    return {
-        a.y * b.z - a.z * b.y,
-        a.z * b.x - a.x * b.z,
-        a.x * b.y - a.y * b.x
-    };
-}
-static inline double length(const Vec3& v) { return std::sqrt(dot(v, v)); }
-static inline Vec3 normalize(const Vec3& v) {
-    double len = length(v);
-    if (len <= 1e-12) return {0.0, 0.0, 0.0};
-    return v / len;
-}
-
-struct Plane {
-    Vec3 normal;
-    Vec3 point; // any point on plane
-};
-
-struct PolygonWithTemp {
-	std::vector<Vec3> vertices;
-	double temperature;
-};
-
-struct ReceiverPoint {
-	Vec3 origin;
-	Vec3 normal;
-};
+static constexpr double kLatencyBuckets[] = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300};
+static constexpr size_t kNumLatencyBuckets = sizeof(kLatencyBuckets) / sizeof(kLatencyBuckets[0]);
 
-struct PlaneData {
-	size_t width;
-	size_t height;
-	size_t numPoints;
+struct EndpointMetrics {
+	std::map<int, std::uint64_t> responses;                      // by status code
+	std::array<std::uint64_t, kNumLatencyBuckets> buckets {};    // per bucket, not cumulative
+	std::uint64_t count {0};
+	double seconds {0.0};
 };
 
-// Compute plane from polygon vertices (assumes first 3 non-collinear define plane)
-inline std::optional<Plane> getPolygonPlane(const std::vector<Vec3>& verts) {
-    if (verts.size() < 3) return std::nullopt;
-    Vec3 v1 = verts[1] - verts[0];
-    Vec3 v2 = verts[2] - verts[0];
-    Vec3 n = cross(v1, v2);
-    double nmag = length(n);
-    if (nmag < 1e-9) return std::nullopt;
-    n = n / nmag;
-    return Plane{n, verts[0]};
-}
-
-// Ray-plane intersection: returns intersection point and t, or nullopt/inf if no forward hit
-inline std::pair<std::optional<Vec3>, double> rayPlaneIntersect(
-    const Vec3& rayOrigin,
-    const Vec3& rayDir,
-    const Vec3& planeNormal,
-    const Vec3& pointOnPlane
-) {
-    double ndotu = dot(planeNormal, rayDir);
-    if (std::fabs(ndotu) < 1e-9) {
-        return {std::nullopt, std::numeric_limits<double>::infinity()};
-    }
-    Vec3 w = rayOrigin - pointOnPlane;
-    double t = -dot(planeNormal, w) / ndotu;
-    if (t < 1e-7) {
-        return {std::nullopt, std::numeric_limits<double>::infinity()};
-    }
-    Vec3 p = rayOrigin + rayDir * t;
-    return {p, t};
-}
-
-// Project 3D polygon and point onto the dominant plane and do 2D point-in-polygon test (winding/non-zero)
-static bool isPointInPolygon2D(const std::vector<std::array<double,2>>& poly, double x, double y) {
-    // Ray casting even-odd rule
-    bool inside = false;
-    size_t n = poly.size();
-    for (size_t i = 0, j = n - 1; i < n; j = i++) {
-        const auto& pi = poly[i];
-        const auto& pj = poly[j];
-        bool intersect = ((pi[1] > y) != (pj[1] > y)) &&
-                         (x < (pj[0] - pi[0]) * (y - pi[1]) / ((pj[1] - pi[1]) + 1e-30) + pi[0]);
-        if (intersect) inside = !inside;
-    }
-    return inside;
-}
-
-inline bool isPointInPolygon3D(const Vec3& p, const std::vector<Vec3>& polygon, const Vec3& polygonNormal) {
-    Vec3 absn { std::fabs(polygonNormal.x), std::fabs(polygonNormal.y), std::fabs(polygonNormal.z) };
-    int a = 0, b = 1; // indices to keep
-    if (absn.x >= absn.y && absn.x >= absn.z) { a = 1; b = 2; }
-    else if (absn.y >= absn.x && absn.y >= absn.z) { a = 0; b = 2; }
-    else { a = 0; b = 1; }
-
-    std::vector<std::array<double,2>> poly2d;
-    poly2d.reserve(polygon.size());
-    for (const auto& v : polygon) {
-        double coords[3] = {v.x, v.y, v.z};
-        poly2d.push_back({coords[a], coords[b]});
-    }
-    double pc[3] = {p.x, p.y, p.z};
-    return isPointInPolygon2D(poly2d, pc[a], pc[b]);
-}
+class RequestMetrics {
+public:
+	void begin() { inFlight_.fetch_add(1, std::memory_order_relaxed); }
+
+	void end(const std::string& endpoint, int status, double seconds) {
+		inFlight_.fetch_sub(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(mutex_);
+		EndpointMetrics& m = endpoints_[endpoint];
+		++m.responses[status];
+		++m.count;
+		m.seconds += seconds;
+		size_t b = 0;
+		while (b < kNumLatencyBuckets && seconds > kLatencyBuckets[b]) ++b;
+		if (b < kNumLatencyBuckets) ++m.buckets[b];
+	}
 
-// Generate cosine-weighted hemisphere directions around a given normal (using provided RNG)
-std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng) {
-    std::vector<Vec3> rays;
-    if (numRays == 0) return rays;
-    rays.reserve(numRays);
+	std::map<std::string, EndpointMetrics> snapshot() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return endpoints_;
+	}
 
-    Vec3 w = normalize(surfaceNormal);
-    Vec3 u;
-    if (std::fabs(w.x) > 0.9999) {
-        u = normalize(cross({0.0, 1.0, 0.0}, w));
-    } else {
-        u = normalize(cross({1.0, 0.0, 0.0}, w));
-    }
-	Vec3 v = cross(w, u);
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
-
-    for (size_t i = 0; i < numRays; ++i) {
-        double u1 = dist(rng);
-        double u2 = dist(rng);
-        double phi = 2.0 * M_PI * u1;
-        double cosTheta = std::sqrt(1.0 - u2);
-        double sinTheta = std::sqrt(u2);
-        double x = sinTheta * std::cos(phi);
-        double y = sinTheta * std::sin(phi);
-        double z = cosTheta;
-        Vec3 local {x, y, z};
-        // rotate to world
-        Vec3 world {
-            u.x * local.x + v.x * local.y + w.x * local.z,
-            u.y * local.x + v.y * local.y + w.y * local.z,
-            u.z * local.x + v.z * local.y + w.z * local.z
-        };
-        rays.push_back(world);
-    }
-    return rays;
-}
+	int inFlight() const { return inFlight_.load(std::memory_order_relaxed); }
 
-// Calculate view factors from a point origin to a set of polygon emitters with occlusion between them
-struct ViewFactorResult {
-    std::vector<double> viewFactors; // per polygon
-    std::vector<Vec3> allRayDirs;
-    std::vector<Vec3> hitPoints;
-    std::vector<Vec3> hitRayDirs; // those rays that hit some polygon
+private:
+	std::mutex mutex_;
+	std::map<std::string, EndpointMetrics> endpoints_;
+	std::atomic<int> inFlight_ {0};
 };
 
-ViewFactorResult calculateViewFactorsWithBlockage(
-	const Vec3& origin,
-	const Vec3& originNormal,
-	const std::vector<PolygonWithTemp>& emitterPolygons,
-	const std::vector<std::vector<Vec3>>& inertPolygons,
-	size_t numRays,
-	std::mt19937_64& rng
-) {
-	ViewFactorResult res;
-	res.viewFactors.assign(emitterPolygons.size(), 0.0);
-	if (numRays == 0) return res;
-
-	std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, originNormal, rng);
-	res.allRayDirs = rays;
-
-	struct PolyData { std::vector<Vec3> verts; Vec3 normal; Vec3 point; bool valid; };
-	std::vector<PolyData> inertScene;
-	inertScene.reserve(inertPolygons.size());
-	for (const auto& poly : inertPolygons) {
-		auto pl = getPolygonPlane(poly);
-		if (!pl) inertScene.push_back({poly, {0,0,0}, {0,0,0}, false});
-		else inertScene.push_back({poly, pl->normal, pl->point, true});
-	}
-
-	std::vector<PolyData> emitScene;
-	emitScene.reserve(emitterPolygons.size());
-	for (const auto& poly : emitterPolygons) {
-		auto pl = getPolygonPlane(poly.vertices);
-		if (!pl) emitScene.push_back({poly.vertices, {0,0,0}, {0,0,0}, false});
-		else emitScene.push_back({poly.vertices, pl->normal, pl->point, true});
-	}
-
-	std::vector<std::size_t> hitCounts(emitterPolygons.size(), 0);
-
-	for (size_t i = 0; i < numRays; ++i) {
-		const Vec3& rdir = rays[i];
-		double closestInert = std::numeric_limits<double>::infinity();
-		double closestEmit = std::numeric_limits<double>::infinity();
-		int finalIdx = -1;
-		Vec3 closestPoint;
-
-		// Check inert polygons first (find closest inert hit)
-		for (size_t p = 0; p < inertScene.size(); ++p) {
-			const auto& pd = inertScene[p];
-			if (!pd.valid) continue;
-			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-			if (hit) {
-				if (t < closestInert) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-						closestInert = t;
-					}
-				}
-			}
+static RequestMetrics g_requestMetrics;
+
+// Times a handler and records it under its route; probes pass traceable = false
+static httplib::Server::Handler instrumented(std::string endpoint, httplib::Server::Handler handler, bool traceable = true) {
+	return [endpoint = std::move(endpoint), handler = std::move(handler), traceable](const httplib::Request& req, httplib::Response& res) {
+		static std::atomic<std::uint64_t> nextRequestId {1};
+		t_requestId = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+		g_requestMetrics.begin();
+		auto start = std::chrono::steady_clock::now();
+		std::unique_ptr<JobTrace> trace;
+		if (traceable && (g_traceAll || (g_traceRequests && req.get_header_value("X-Trace") == "1"))) {
+			trace = std::make_unique<JobTrace>(t_requestId);
 		}
-
-		// Then check emitter polygons (find closest emitter hit)
-		for (size_t p = 0; p < emitScene.size(); ++p) {
-			const auto& pd = emitScene[p];
-			if (!pd.valid) continue;
-			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
-			if (hit) {
-				if (t < closestEmit) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
-						closestEmit = t;
-						finalIdx = static_cast<int>(p);
-						closestPoint = *hit;
-					}
-				}
-			}
+		{
+			ActiveTrace activeTrace(trace.get());
+			TraceSpan span("request", endpoint);
+			handler(req, res);
 		}
-
-		bool blockedByInert = (closestInert < std::numeric_limits<double>::infinity()) && (closestInert <= closestEmit);
-		if (!blockedByInert && finalIdx != -1) {
-			hitCounts[static_cast<size_t>(finalIdx)] += 1;
-			res.hitPoints.push_back(closestPoint);
-			res.hitRayDirs.push_back(rdir);
+		if (trace) {
+			std::string name = g_traceWriter.submit(std::move(trace));
+			if (!name.empty()) res.set_header("X-Trace-File", name);
 		}
-	}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const int status = res.status > 0 ? res.status : 200;
+		g_requestMetrics.end(endpoint, status, seconds);
+		LogRecord(status < 400 ? LogLevel::Info : LogLevel::Warn, "Request handled").field("endpoint", endpoint)
+			.field("status", status).field("bytes_in", req.body.size()).field("bytes_out", res.body.size()).field("ms", seconds * 1000.0);
+		t_requestId = 0;
+	};
+}
 
-	for (size_t p = 0; p < emitterPolygons.size(); ++p) {
-		res.viewFactors[p] = static_cast<double>(hitCounts[p]) / static_cast<double>(numRays);
-	}
-	return res;
+static std::uint64_t peakRssBytes() {
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+	return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
 }
 
-// JSON parsing functions
-namespace mini_json {
-	inline void skipSpaces(const std::string& s, size_t& i) {
-		while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) ++i;
-	}
-	inline bool expectChar(const std::string& s, size_t& i, char c) {
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == c) { ++i; return true; }
-		return false;
-	}
-	inline bool parseNumber(const std::string& s, size_t& i, double& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		out = std::strtod(start, &endptr);
-		if (endptr == start) return false;
-		i += static_cast<size_t>(endptr - start);
-		return true;
-	}
-	inline bool parseUInt64(const std::string& s, size_t& i, std::uint64_t& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		unsigned long long v = std::strtoull(start, &endptr, 10);
-		if (endptr == start) return false;
-		out = static_cast<std::uint64_t>(v);
-		i += static_cast<size_t>(endptr - start);
-		return true;
-	}
-	inline bool parseKey(const std::string& s, size_t& i, const std::string& key) {
-		skipSpaces(s, i);
-		if (!expectChar(s, i, '"')) return false;
-		size_t k = i;
-		while (k < s.size() && s[k] != '"') ++k;
-		if (k >= s.size()) return false;
-		std::string found = s.substr(i, k - i);
-		i = k + 1;
-		skipSpaces(s, i);
-		if (!expectChar(s, i, ':')) return false;
-		return found == key;
-	}
-	inline bool parseVec3(const std::string& s, size_t& i, Vec3& v) {
-		if (!expectChar(s, i, '[')) return false;
-		double a, b, c;
-		if (!parseNumber(s, i, a)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, b)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, c)) return false;
-		if (!expectChar(s, i, ']')) return false;
-		v = Vec3{a, b, c};
-		return true;
-	}
-	inline bool parsePolygons(const std::string& s, size_t& i, std::vector<std::vector<Vec3>>& polys) {
-		if (!expectChar(s, i, '[')) return false; // polygons array start
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		while (i < s.size()) {
-			if (!expectChar(s, i, '[')) return false; // one polygon start
-			std::vector<Vec3> poly;
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ']') { ++i; polys.push_back(std::move(poly)); }
-			else {
-				while (i < s.size()) {
-					Vec3 v;
-					if (!parseVec3(s, i, v)) return false;
-					poly.push_back(v);
-					skipSpaces(s, i);
-					if (i < s.size() && s[i] == ',') { ++i; continue; }
-					if (i < s.size() && s[i] == ']') { ++i; break; }
-					return false;
-				}
-				polys.push_back(std::move(poly));
-			}
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-	inline bool parseReceiverPoint(const std::string& s, size_t& i, ReceiverPoint& rp) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool haveOrigin = false, haveNormal = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "origin")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.origin = v; haveOrigin = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "normal")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.normal = v; haveNormal = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return haveOrigin && haveNormal;
-	}
-	inline bool parseReceiverPoints(const std::string& s, size_t& i, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			ReceiverPoint rp;
-			if (!parseReceiverPoint(s, i, rp)) return false;
-			points.push_back(rp);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
-	}
-	
-	inline bool parseReceiverPlaneData(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "width")) {
-				double w;
-				if (!parseNumber(s, i, w)) return false;
-				width = w;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "height")) {
-				double h;
-				if (!parseNumber(s, i, h)) return false;
-				height = h;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "points")) {
-				if (!parseReceiverPoints(s, i, points)) return false;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		return true;
-	}
-	
-	inline bool parseReceiverPlanes(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			// Parse plane name as key
-			if (!expectChar(s, i, '"')) return false;
-			size_t nameStart = i;
-			while (i < s.size() && s[i] != '"') ++i;
-			if (i >= s.size()) return false;
-			planeName = s.substr(nameStart, i - nameStart);
-			++i; // skip closing quote
-			
-			skipSpaces(s, i);
-			if (!expectChar(s, i, ':')) return false;
-			
-			if (!parseReceiverPlaneData(s, i, planeName, width, height, points)) return false;
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		return true;
-	}
-	
-	// New function to parse multiple receiver planes into a map
-	inline bool parseReceiverPlanesMulti(const std::string& s, size_t& i, std::map<std::string, PlaneData>& planeMap, std::vector<ReceiverPoint>& allPoints) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			// Parse plane name as key
-			if (!expectChar(s, i, '"')) return false;
-			size_t nameStart = i;
-			while (i < s.size() && s[i] != '"') ++i;
-			if (i >= s.size()) return false;
-			std::string planeName = s.substr(nameStart, i - nameStart);
-			++i; // skip closing quote
-			
-			skipSpaces(s, i);
-			if (!expectChar(s, i, ':')) return false;
-			
-			// Parse plane data
-			double width = 0, height = 0;
-			std::vector<ReceiverPoint> planePoints;
-			std::string tempName;
-			if (!parseReceiverPlaneData(s, i, tempName, width, height, planePoints)) return false;
-			
-			// Store plane metadata
-			PlaneData pd;
-			pd.width = static_cast<size_t>(width);
-			pd.height = static_cast<size_t>(height);
-			pd.numPoints = planePoints.size();
-			planeMap[planeName] = pd;
-			
-			// Add points to global list
-			for (const auto& pt : planePoints) {
-				allPoints.push_back(pt);
-			}
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
+static std::string renderMetrics() {
+	std::ostringstream out;
+	out << std::setprecision(12);
+	auto header = [&](const char* name, const char* type, const char* help) {
+		out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+	};
+
+	const auto endpoints = g_requestMetrics.snapshot();
+	header("tra_http_requests_total", "counter", "Requests served, by endpoint and status code.");
+	for (const auto& [endpoint, m] : endpoints) {
+		for (const auto& [status, n] : m.responses) {
+			out << "tra_http_requests_total{endpoint=\"" << endpoint << "\",code=\"" << status << "\"} " << n << '\n';
 		}
-		return true;
 	}
-	
-	inline bool parseSinglePolygon(const std::string& s, size_t& i, std::vector<Vec3>& vertices) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			Vec3 v;
-			if (!parseVec3(s, i, v)) return false;
-			vertices.push_back(v);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
+	header("tra_http_request_duration_seconds", "histogram", "Request latency, by endpoint.");
+	for (const auto& [endpoint, m] : endpoints) {
+		std::uint64_t cumulative = 0;
+		for (size_t b = 0; b < kNumLatencyBuckets; ++b) {
+			cumulative += m.buckets[b];
+			out << "tra_http_request_duration_seconds_bucket{endpoint=\"" << endpoint << "\",le=\"" << kLatencyBuckets[b] << "\"} " << cumulative << '\n';
 		}
-		return true;
+		out << "tra_http_request_duration_seconds_bucket{endpoint=\"" << endpoint << "\",le=\"+Inf\"} " << m.count << '\n';
+		out << "tra_http_request_duration_seconds_sum{endpoint=\"" << endpoint << "\"} " << m.seconds << '\n';
+		out << "tra_http_request_duration_seconds_count{endpoint=\"" << endpoint << "\"} " << m.count << '\n';
 	}
-	
-	inline bool parsePolygonWithTemp(const std::string& s, size_t& i, PolygonWithTemp& poly) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool havePolygon = false, haveTemperature = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "polygon")) {
-				if (!parseSinglePolygon(s, i, poly.vertices)) return false;
-				havePolygon = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "temperature")) {
-				double temp;
-				if (!parseNumber(s, i, temp)) return false;
-				poly.temperature = temp;
-				haveTemperature = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return havePolygon && haveTemperature;
+	header("tra_log_dropped_total", "counter", "Log lines dropped because the log ring was full.");
+	out << "tra_log_dropped_total " << g_logger.dropped() << '\n';
+	header("tra_http_requests_in_flight", "gauge", "Requests being handled.");
+	out << "tra_http_requests_in_flight " << g_requestMetrics.inFlight() << '\n';
+	header("tra_heavy_jobs_running", "gauge", "Jobs over the admission limit currently running.");
+	out << "tra_heavy_jobs_running " << (g_heavyJobs.running() ? 1 : 0) << '\n';
+	header("tra_heavy_jobs_queued", "gauge", "Jobs over the admission limit waiting to run.");
+	out << "tra_heavy_jobs_queued " << g_heavyJobs.waiting() << '\n';
+
+	const std::uint64_t rays = g_engineCounters.raysTraced.load(std::memory_order_relaxed);
+	const std::uint64_t tests = g_engineCounters.polygonTests.load(std::memory_order_relaxed);
+	const double traceSeconds = static_cast<double>(g_stageTotals[static_cast<size_t>(Stage::Trace)].nanos.load(std::memory_order_relaxed)) * 1e-9;
+	header("tra_rays_traced_total", "counter", "Rays cast by all kernels.");
+	out << "tra_rays_traced_total " << rays << '\n';
+	header("tra_polygon_tests_total", "counter", "Ray-polygon intersection tests.");
+	out << "tra_polygon_tests_total " << tests << '\n';
+	header("tra_polygon_tests_per_ray", "gauge", "Mean intersection tests per ray since start.");
+	out << "tra_polygon_tests_per_ray " << (rays > 0 ? static_cast<double>(tests) / static_cast<double>(rays) : 0.0) << '\n';
+	header("tra_rays_per_second", "gauge", "Rays traced per second of trace-stage wall time.");
+	out << "tra_rays_per_second " << (traceSeconds > 0.0 ? static_cast<double>(rays) / traceSeconds : 0.0) << '\n';
+
+	header("tra_stage_seconds_total", "counter", "Wall time per request stage.");
+	for (size_t s = 0; s < static_cast<size_t>(Stage::Count); ++s) {
+		out << "tra_stage_seconds_total{stage=\"" << kStageNames[s] << "\"} " << static_cast<double>(g_stageTotals[s].nanos.load(std::memory_order_relaxed)) * 1e-9 << '\n';
 	}
-	
-	inline bool parsePolygonsWithTemp(const std::string& s, size_t& i, std::vector<PolygonWithTemp>& polys) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			PolygonWithTemp poly;
-			if (!parsePolygonWithTemp(s, i, poly)) return false;
-			polys.push_back(poly);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
+	header("tra_stage_runs_total", "counter", "Times each stage ran.");
+	for (size_t s = 0; s < static_cast<size_t>(Stage::Count); ++s) {
+		out << "tra_stage_runs_total{stage=\"" << kStageNames[s] << "\"} " << g_stageTotals[s].count.load(std::memory_order_relaxed) << '\n';
 	}
-}
-
-struct JsonInput {
-	std::vector<ReceiverPoint> receiverPoints;
-	std::vector<PolygonWithTemp> polygons;
-	std::vector<std::vector<Vec3>> inertPolygons;
-	std::size_t numRays {100000};
-	std::optional<std::uint64_t> seed;
-	
-	// Map of plane name -> plane metadata
-	std::map<std::string, PlaneData> planeDataMap;
-};
 
-static bool parseInputJson(const std::string& json, JsonInput& out, std::string& error) {
-	using namespace mini_json;
-	size_t i = 0;
-	skipSpaces(json, i);
-	if (!expectChar(json, i, '{')) { error = "Expected '{'"; return false; }
-
-	bool haveReceiverPlanes = false, havePolygons = false;
-
-	while (i < json.size()) {
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == '}') { ++i; break; }
-
-		size_t save = i;
-		if (parseKey(json, i, "receiver_planes")) {
-			if (!parseReceiverPlanesMulti(json, i, out.planeDataMap, out.receiverPoints)) { 
-				error = "Invalid receiver_planes"; 
-				return false; 
-			}
-			haveReceiverPlanes = true;
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "polygons")) {
-			size_t savePos = i;
-			if (parsePolygonsWithTemp(json, i, out.polygons)) {
-				havePolygons = true;
-			} else {
-				i = savePos;
-				std::vector<std::vector<Vec3>> legacyPolygons;
-				if (parsePolygons(json, i, legacyPolygons)) {
-					out.polygons.clear();
-					for (const auto& poly : legacyPolygons) {
-						out.polygons.push_back({poly, 0.0});
-					}
-					havePolygons = true;
-				} else {
-					error = "Invalid polygons format";
-					return false;
-				}
-			}
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "inert_polygons")) {
-			std::vector<std::vector<Vec3>> tmp;
-			if (!parsePolygons(json, i, tmp)) { error = "Invalid inert_polygons"; return false; }
-			out.inertPolygons = std::move(tmp);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "num_rays")) {
-			double n; if (!parseNumber(json, i, n)) { error = "Invalid num_rays"; return false; }
-			if (n < 0) n = 0; out.numRays = static_cast<std::size_t>(n);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "seed")) {
-			std::uint64_t s; if (!parseUInt64(json, i, s)) { error = "Invalid seed"; return false; }
-			out.seed = s;
-		} else { i = save; }
-
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == ',') { ++i; continue; }
+	const auto cache = g_viewFactorCache.stats();
+	header("tra_view_factor_cache_hits_total", "counter", "View-factor matrix cache hits.");
+	out << "tra_view_factor_cache_hits_total " << cache.hits << '\n';
+	header("tra_view_factor_cache_misses_total", "counter", "View-factor matrix cache misses.");
+	out << "tra_view_factor_cache_misses_total " << cache.misses << '\n';
+	header("tra_view_factor_cache_hit_ratio", "gauge", "Hits over lookups since start.");
+	out << "tra_view_factor_cache_hit_ratio " << (cache.hits + cache.misses > 0 ? static_cast<double>(cache.hits) / static_cast<double>(cache.hits + cache.misses) : 0.0) << '\n';
+	header("tra_view_factor_cache_entries", "gauge", "Matrices held in the cache.");
+	out << "tra_view_factor_cache_entries " << cache.entries << '\n';
+	header("tra_view_factor_cache_bytes", "gauge", "Bytes held by cached matrices.");
+	out << "tra_view_factor_cache_bytes " << cache.bytes << '\n';
+
+	if (std::uint64_t rss = peakRssBytes()) {
+		header("tra_peak_rss_bytes", "gauge", "Peak resident set size of the process.");
+		out << "tra_peak_rss_bytes " << rss << '\n';
 	}
-
-	if (!haveReceiverPlanes) {
-		error = "Must provide 'receiver_planes' field";
-		return false;
-	}
-	
-	if (out.receiverPoints.empty()) {
-		error = "receiver_planes is empty";
-		return false;
-	}
-	
-	if (!havePolygons) { error = "Missing polygons"; return false; }
-	return true;
+	return out.str();
 }
 
-static std::string runCalculation(const std::string& jsonInput, bool& ok) {
-	JsonInput in;
-	std::string err;
-	if (!parseInputJson(jsonInput, in, err)) {
-		ok = false;
-		return std::string("{\"error\": \"") + err + "\"}";
-	}
-
-	std::mt19937_64 rng;
-	if (in.seed.has_value()) {
-		rng.seed(in.seed.value());
-	} else {
-		std::random_device rd;
-		std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
-		rng = std::mt19937_64(seedSeq);
-	}
-
-	// Process each receiver plane separately
-	std::ostringstream out;
-	out << "{";
-	out << "\"success\":true,";
-	out << "\"planes\":[";
-	
-	size_t globalPointIdx = 0;
-	bool firstPlane = true;
-	
-	std::cout << "=== Processing " << in.planeDataMap.size() << " receiver planes ===" << std::endl;
-	std::cout << "Total receiver points: " << in.receiverPoints.size() << std::endl;
-	
-	// Iterate through each plane in the map
-	for (const auto& planePair : in.planeDataMap) {
-		const std::string& planeName = planePair.first;
-		const PlaneData& planeData = planePair.second;
-		
-		std::cout << "Processing plane: \"" << planeName << "\"" << std::endl;
-		std::cout << "  Grid: " << planeData.width << "x" << planeData.height << std::endl;
-		std::cout << "  Num points: " << planeData.numPoints << std::endl;
-		std::cout << "  Starting at globalPointIdx: " << globalPointIdx << std::endl;
-		
-		// Log first point's position and normal for debugging
-		if (globalPointIdx < in.receiverPoints.size()) {
-			const auto& firstPoint = in.receiverPoints[globalPointIdx];
-			std::cout << "  Sample point 0 origin: [" << firstPoint.origin.x << ", " << firstPoint.origin.y << ", " << firstPoint.origin.z << "]" << std::endl;
-			std::cout << "  Sample point 0 normal: [" << firstPoint.normal.x << ", " << firstPoint.normal.y << ", " << firstPoint.normal.z << "]" << std::endl;
-		}
-		
-		// Log emitter info
-		std::cout << "  Number of emitters: " << in.polygons.size() << std::endl;
-		for (size_t i = 0; i < in.polygons.size(); ++i) {
-			std::cout << "    Emitter " << i << ": temp=" << in.polygons[i].temperature << ", vertices=" << in.polygons[i].vertices.size() << std::endl;
-			if (in.polygons[i].vertices.size() > 0) {
-				std::cout << "      First vertex: [" << in.polygons[i].vertices[0].x << ", " << in.polygons[i].vertices[0].y << ", " << in.polygons[i].vertices[0].z << "]" << std::endl;
-			}
-		}
-		
-		if (!firstPlane) out << ",";
-		firstPlane = false;
-		
-		// Calculate temperatures for this plane's points
-		std::vector<double> planeTemperatures;
-		planeTemperatures.reserve(planeData.numPoints);
-		
-		double minTemp = std::numeric_limits<double>::infinity();
-		double maxTemp = -std::numeric_limits<double>::infinity();
-		
-		for (size_t localIdx = 0; localIdx < planeData.numPoints; ++localIdx) {
-			if (globalPointIdx >= in.receiverPoints.size()) {
-				std::cerr << "ERROR: globalPointIdx " << globalPointIdx << " exceeds receiverPoints size " << in.receiverPoints.size() << std::endl;
-				break;
-			}
-			
-			const auto& receiverPoint = in.receiverPoints[globalPointIdx];
-			
-			std::mt19937_64 pointRng = rng;
-			if (in.seed.has_value()) {
-				pointRng.seed(in.seed.value() + globalPointIdx * 12345);
-			}
-			
-			auto res = calculateViewFactorsWithBlockage(receiverPoint.origin, receiverPoint.normal, in.polygons, in.inertPolygons, in.numRays, pointRng);
-			
-			double totalTemperature = 0.0;
-			for (size_t p = 0; p < in.polygons.size(); ++p) {
-				double temperatureContribution = res.viewFactors[p] * in.polygons[p].temperature;
-				totalTemperature += temperatureContribution;
-			}
-			
-			planeTemperatures.push_back(totalTemperature);
-			
-			if (totalTemperature < minTemp) minTemp = totalTemperature;
-			if (totalTemperature > maxTemp) maxTemp = totalTemperature;
-			
-			globalPointIdx++;
-		}
-		
-		std::cout << "  Finished plane \"" << planeName << "\"" << std::endl;
-		std::cout << "    Temperature range: " << minTemp << " to " << maxTemp << std::endl;
-		std::cout << "    Next globalPointIdx: " << globalPointIdx << std::endl;
-		
-		// Output this plane's data
-		out << "{";
-		out << "\"name\":\"" << planeName << "\",";
-		out << "\"width\":" << planeData.width << ",";
-		out << "\"height\":" << planeData.height << ",";
-		out << "\"values\":[";
-		for (size_t i = 0; i < planeTemperatures.size(); ++i) {
-			if (i > 0) out << ",";
-			out << planeTemperatures[i];
-		}
-		out << "]";
-		out << "}";
-	}
-	
-	out << "]";
-	out << "}";
-	
-	ok = true;
-	return out.str();
+// Predicted runtime (and any ray downgrade) for the client; status on refusal
+static void applyJobReport(httplib::Response& res, const JobReport& job, bool ok) {
+    if (!ok) res.status = job.status;
+    if (job.estimate.points == 0 && job.estimate.tracedRays == 0.0) return;
+    std::ostringstream predicted;
+    predicted << job.estimate.predictedSeconds;
+    res.set_header("X-Predicted-Seconds", predicted.str());
+    if (job.requestedRays > 0) {
+        res.set_header("X-Requested-Rays", std::to_string(job.requestedRays));
+        res.set_header("X-Num-Rays", std::to_string(job.estimate.rays));
+    }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     using namespace httplib;
 
+    // Admission limits: --max-job-seconds S (0 = off), --admission reject|queue|downgrade,
+    // --max-queued N, --cost-ns-per-test X (skips the startup calibration);
+    // --log-level debug|info|warn|error (per-plane and per-emitter dumps are debug)
+    // Tracing (off by default): --trace-requests (honour X-Trace: 1), --trace-all,
+    // --trace-dir DIR (default ./traces), --trace-keep N (files kept, default 100)
+    std::string traceDir = "traces";
+    size_t traceKeep = 100;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--trace-all") {
+            g_traceAll = true;
+            continue;
+        }
+        if (flag == "--trace-requests") {
+            g_traceRequests = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Option '" << flag << "' needs a value" << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--trace-dir") traceDir = value;
+        else if (flag == "--trace-keep") traceKeep = static_cast<size_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (flag == "--max-job-seconds") g_admission.maxJobSeconds = std::strtod(value.c_str(), nullptr);
+        else if (flag == "--max-queued") g_admission.maxQueued = static_cast<size_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (flag == "--cost-ns-per-test") g_nsPerRayTest = std::strtod(value.c_str(), nullptr);
+        else if (flag == "--log-level") {
+            if (value == "debug") g_logger.setLevel(LogLevel::Debug);
+            else if (value == "info") g_logger.setLevel(LogLevel::Info);
+            else if (value == "warn") g_logger.setLevel(LogLevel::Warn);
+            else if (value == "error") g_logger.setLevel(LogLevel::Error);
+            else {
+                std::cerr << "Unknown --log-level '" << value << "' (debug, info, warn or error)" << std::endl;
+                return 1;
+            }
+        }
+        else if (flag == "--admission") {
+            if (value == "reject") g_admission.mode = AdmissionPolicy::Mode::Reject;
+            else if (value == "queue") g_admission.mode = AdmissionPolicy::Mode::Queue;
+            else if (value == "downgrade") g_admission.mode = AdmissionPolicy::Mode::Downgrade;
+            else {
+                std::cerr << "Unknown --admission policy '" << value << "' (reject, queue or downgrade)" << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option '" << flag << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (g_nsPerRayTest <= 0.0) g_nsPerRayTest = calibrateRayTestCost();
+
     Server svr;
 
     // Enable CORS for all routes
     svr.set_default_headers({
         {"Access-Control-Allow-Origin", "*"},
         {"Access-Control-Allow-Methods", "GET, POST, OPTIONS"},
-        {"Access-Control-Allow-Headers", "Content-Type"}
+        {"Access-Control-Allow-Headers", "Content-Type, X-Trace"},
+        {"Access-Control-Expose-Headers", "X-Predicted-Seconds, X-Requested-Rays, X-Num-Rays, X-Trace-File"}
     });
 
     // Handle OPTIONS requests (CORS preflight)
     // Note: Headers are already set globally above, just need to respond with 200
-    svr.Options(".*", [](const Request& req, Response& res) {
+    svr.Options(".*", [](const Request&, Response& res) {
         res.status = 200;
     });
 
     // Health check endpoint
-    svr.Get("/health", [](const Request& req, Response& res) {
+    svr.Get("/health", instrumented("/health", [](const Request&, Response& res) {
         res.set_content("{\"status\": \"ok\"}", "application/json");
+    }, false));
+
+    // Prometheus scrape target; deliberately not instrumented, so scrapes do not
+    // show up in the request counters they report
+    svr.Get("/metrics", [](const Request&, Response& res) {
+        res.set_content(renderMetrics(), "text/plain; version=0.0.4");
     });
 
     // Status endpoint
-    svr.Get("/status", [](const Request& req, Response& res) {
+    svr.Get("/status", instrumented("/status", [](const Request&, Response& res) {
         res.set_content("{\"status\": \"running\", \"version\": \"1.0\"}", "application/json");
-    });
+    }, false));
 
     // Main calculation endpoint
-    svr.Post("/calculate", [](const Request& req, Response& res) {
-        std::cout << "Received calculation request" << std::endl;
-        std::cout << "Request body length: " << req.body.length() << " bytes" << std::endl;
+    svr.Post("/calculate", instrumented("/calculate", [](const Request& req, Response& res) {
+        LogRecord(LogLevel::Info, "Received calculation request").field("bytes", req.body.length());
         
+        WireFormat wire = negotiateWireFormat(req.get_header_value("Content-Type"), req.get_header_value("Accept"));
         bool ok = false;
-        std::string result = runCalculation(req.body, ok);
+        JobReport job;
+        std::string result = runCalculation(req.body, wire, job, ok);
+        applyJobReport(res, job, ok);
         
         if (ok) {
-            std::cout << "Calculation successful" << std::endl;
-            res.set_content(result, "application/json");
+            res.set_content(result, wire.binaryResponse ? kBinaryContentType : "application/json");
         } else {
-            std::cout << "Calculation failed: " << result << std::endl;
-            res.status = 400;
+            LogRecord(LogLevel::Warn, "Calculation failed").field("error", result);
             res.set_content(result, "application/json");
         }
-    });
+    }));
+
+    // Dry run: cost estimate and admission decision for a /calculate body
+    svr.Post("/estimate", instrumented("/estimate", [](const Request& req, Response& res) {
+        WireFormat wire = negotiateWireFormat(req.get_header_value("Content-Type"), "");
+        bool ok = false;
+        std::string result = runEstimate(req.body, wire, ok);
+        if (!ok) res.status = 400;
+        res.set_content(result, "application/json");
+    }));
+
+    // Batch of scenario variations over one base scene
+    svr.Post("/calculate/batch", instrumented("/calculate/batch", [](const Request& req, Response& res) {
+        LogRecord(LogLevel::Info, "Received batch request").field("bytes", req.body.length());
+        bool ok = false;
+        JobReport job;
+        std::string result = runBatchCalculation(req.body, job, ok);
+        applyJobReport(res, job, ok);
+        if (!ok) LogRecord(LogLevel::Warn, "Batch failed").field("error", result);
+        res.set_content(result, "application/json");
+    }));
+
+    // Transient: emitter time series over fixed geometry
+    svr.Post("/calculate/transient", instrumented("/calculate/transient", [](const Request& req, Response& res) {
+        LogRecord(LogLevel::Info, "Received transient request").field("bytes", req.body.length());
+        bool ok = false;
+        JobReport job;
+        std::string result = runTransientCalculation(req.body, job, ok);
+        applyJobReport(res, job, ok);
+        if (!ok) LogRecord(LogLevel::Warn, "Transient calculation failed").field("error", result);
+        res.set_content(result, "application/json");
+    }));
+
+    // Inverse solve: distance at which the peak drops to a threshold
+    svr.Post("/solve/separation", instrumented("/solve/separation", [](const Request& req, Response& res) {
+        LogRecord(LogLevel::Info, "Received separation search").field("bytes", req.body.length());
+        bool ok = false;
+        JobReport job;
+        std::string result = runSeparationSearch(req.body, job, ok);
+        applyJobReport(res, job, ok);
+        if (!ok) LogRecord(LogLevel::Warn, "Separation search failed").field("error", result);
+        res.set_content(result, "application/json");
+    }));
 
     std::cout << "========================================" << std::endl;
     std::cout << "Thermal Radiation Analysis Server" << std::endl;
@@ -838,10 +352,28 @@ int main() {
     std::cout << "Endpoints:" << std::endl;
     std::cout << "  GET  /health     - Health check" << std::endl;
     std::cout << "  GET  /status     - Server status" << std::endl;
+    std::cout << "  GET  /metrics    - Prometheus metrics" << std::endl;
     std::cout << "  POST /calculate  - Run calculation" << std::endl;
+    std::cout << "  POST /estimate   - Predicted cost of a calculation (dry run)" << std::endl;
+    std::cout << "  POST /calculate/batch - Run scenario variations" << std::endl;
+    std::cout << "  POST /calculate/transient - Emitter time series" << std::endl;
+    std::cout << "  POST /solve/separation - Critical separation distance" << std::endl;
+    std::cout << "Admission: " << admissionName(g_admission.mode) << " above " << g_admission.maxJobSeconds
+              << " s predicted; calibrated " << g_nsPerRayTest << " ns per ray-polygon test" << std::endl;
+    if (g_traceAll || g_traceRequests) {
+        std::cout << "Tracing: " << (g_traceAll ? "every job" : "requests with X-Trace: 1") << " -> " << traceDir
+                  << " (newest " << traceKeep << " kept)" << std::endl;
+    } else {
+        std::cout << "Tracing: off" << std::endl;
+    }
     std::cout << "========================================" << std::endl;
 
+    g_logger.start();
+    if (g_traceAll || g_traceRequests) g_traceWriter.start(traceDir, traceKeep);
     svr.listen("0.0.0.0", 8080);
+    g_traceWriter.stop();
+    g_logger.stop();
 
     return 0;
 }
+
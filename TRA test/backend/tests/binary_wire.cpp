@@ -0,0 +1,148 @@
+// Binary /calculate encoding: a request with a point plane and a grid plane
+// decodes to the same values as the equivalent tra::Scene, payloads whose counts
+// or grid sizes cannot be right are refused before anything is allocated, and NaN
+// or infinite scalars are refused as they are in JSON
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "engine/jobs.hpp"
+#include "engine/tra.hpp"
+#include "engine/wire.hpp"
+
+static const std::vector<Vec3> kEmitter = {{-1.0, -1.0, 2.0}, {1.0, -1.0, 2.0}, {1.0, 1.0, 2.0}, {-1.0, 1.0, 2.0}};
+static const std::vector<ReceiverPoint> kPoints = {{{0.0, 0.0, 0.0}, {0.0, 0.0, 1.0}}, {{1.5, 0.5, 0.0}, {0.0, 0.0, 1.0}}};
+static const Vec3 kGridOrigin {-2.0, -2.0, 0.0}, kGridU {4.0, 0.0, 0.0}, kGridV {0.0, 4.0, 0.0}, kGridNormal {0.0, 0.0, 1.0};
+static constexpr std::uint32_t kRays = 4000;
+static constexpr std::uint64_t kSeed = 42;
+
+static void vec3(BinaryWriter& w, const Vec3& v) {
+	w.value(v.x);
+	w.value(v.y);
+	w.value(v.z);
+}
+
+static void planeHeader(BinaryWriter& w, const std::string& name, std::uint32_t kind, std::uint32_t width, std::uint32_t height, std::uint32_t count) {
+	w.value(static_cast<std::uint32_t>(name.size()));
+	w.value(kind);
+	w.value(width);
+	w.value(height);
+	w.value(count);
+	w.value(std::uint32_t(0));
+	w.bytes(name.data(), name.size());
+	w.align8();
+}
+
+// f64 request: plane "a" of explicit points, plane "b" a 5 x 4 grid, one emitter
+static std::string request(std::uint32_t emitters, std::uint32_t gridWidth, std::uint32_t gridHeight, double temperature = 100.0, double gridZ = 0.0) {
+	BinaryWriter w(1024);
+	w.bytes("TRAQ", 4);
+	w.value(kBinaryVersion);
+	w.value(std::uint8_t(8));
+	w.value(std::uint8_t(1));    // seeded
+	w.value(kRays);
+	w.value(std::uint32_t(2));
+	w.value(emitters);
+	w.value(std::uint32_t(0));
+	w.value(kSeed);
+
+	planeHeader(w, "a", 0, 2, 1, static_cast<std::uint32_t>(kPoints.size()));
+	for (const auto& rp : kPoints) {
+		vec3(w, rp.origin);
+		vec3(w, rp.normal);
+	}
+	w.align8();
+	planeHeader(w, "b", 1, gridWidth, gridHeight, 0);
+	vec3(w, {kGridOrigin.x, kGridOrigin.y, gridZ});
+	vec3(w, kGridU);
+	vec3(w, kGridV);
+	vec3(w, kGridNormal);
+	w.align8();
+
+	w.value(static_cast<std::uint32_t>(kEmitter.size()));
+	w.value(std::uint32_t(0));
+	w.value(temperature);
+	for (const auto& v : kEmitter) vec3(w, v);
+	w.align8();
+	return w.take();
+}
+
+static std::map<std::string, std::vector<double>> decodeResponse(const std::string& body) {
+	std::map<std::string, std::vector<double>> planes;
+	BinaryReader r(body);
+	char magic[4] = {};
+	std::uint16_t version = 0;
+	std::uint8_t scalarBytes = 0, reserved8 = 0;
+	std::uint32_t numPlanes = 0, reserved32 = 0;
+	bool ok = r.bytes(magic, 4) && r.value(version) && r.value(scalarBytes) && r.value(reserved8) && r.value(numPlanes) && r.value(reserved32);
+	CHECK(ok && std::string(magic, 4) == "TRAR" && version == kBinaryVersion && scalarBytes == 8);
+	for (std::uint32_t p = 0; ok && p < numPlanes; ++p) {
+		std::uint32_t nameLen = 0, width = 0, height = 0, count = 0;
+		std::string_view name;
+		ok = r.value(nameLen) && r.value(width) && r.value(height) && r.value(count) && r.view(name, nameLen) && r.align8();
+		std::vector<double>& values = planes[std::string(name)];
+		values.resize(count);
+		for (auto& v : values) ok = ok && r.scalar(v, scalarBytes);
+		ok = ok && r.align8();
+	}
+	CHECK(ok && r.atEnd());
+	return planes;
+}
+
+static std::string runBinary(const std::string& body, bool& ok) {
+	WireFormat wire;
+	wire.binaryRequest = true;
+	wire.binaryResponse = true;
+	wire.responseScalarBytes = 8;
+	JobReport job;
+	return runCalculation(body, wire, job, ok);
+}
+
+int main() {
+	bool ok = false;
+	const std::string response = runBinary(request(1, 5, 4), ok);
+	CHECK(ok);
+	const auto decoded = decodeResponse(response);
+
+	tra::Scene scene;
+	scene.addEmitter(kEmitter, 100.0);
+	CHECK(scene.addReceiverPlane("a", 2, 1, kPoints));
+	CHECK(scene.addReceiverGrid("b", 5, 4, kGridOrigin, kGridU, kGridV, kGridNormal));
+	scene.setRays(kRays);
+	scene.setSeed(kSeed);
+	const tra::Results expected = tra::solve(scene);
+
+	CHECK(decoded.size() == expected.planes.size());
+	for (const auto& plane : expected.planes) {
+		auto it = decoded.find(plane.name);
+		CHECK(it != decoded.end());
+		if (it == decoded.end()) continue;
+		CHECK(it->second.size() == plane.values.size());
+		for (size_t k = 0; k < plane.values.size() && k < it->second.size(); ++k) CHECK(it->second[k] == plane.values[k]);
+	}
+	CHECK(decoded.count("a") && decoded.at("a")[0] > 0.0);
+
+	// A header claiming a billion emitters is refused by the payload size
+	runBinary(request(1u << 30, 5, 4), ok);
+	CHECK(!ok);
+	// So is a grid past the receiver point limit, and a truncated payload
+	runBinary(request(1, 65536, 65536), ok);
+	CHECK(!ok);
+	const std::string body = request(1, 5, 4);
+	runBinary(body.substr(0, body.size() - 16), ok);
+	CHECK(!ok);
+
+	runBinary(request(1, 5, 4, std::numeric_limits<double>::quiet_NaN()), ok);
+	CHECK(!ok);
+	runBinary(request(1, 5, 4, 100.0, std::numeric_limits<double>::infinity()), ok);
+	CHECK(!ok);
+	std::string error;
+	CHECK(!tra::Scene::fromJson(R"({"receiver_planes": {"p": {"width": 1, "height": 1, "points": [{"origin": [0, 0, inf], "normal": [0, 0, 1]}]}},
+		"polygons": [{"polygon": [[-1, -1, 1], [1, -1, 1], [1, 1, 1]], "temperature": nan}]})", error).has_value());
+
+	return checkResult();
+}
@@ -0,0 +1,91 @@
+/* C ABI: a scene solves into the caller's buffer with progress up to 1.0, short
+ * buffers and malformed receiver planes are refused, new temperatures scale the
+ * cached result, and both a cancel from the progress callback and one issued
+ * before tra_solve stop the solve without affecting the next one */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "engine/tra_c.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed (%s)\n", __FILE__, __LINE__, #cond, tra_last_error()); \
+			++g_failures; \
+		} \
+	} while (0)
+
+struct progress {
+	int calls;
+	double last;
+};
+
+static int record(double fraction, void* user_data) {
+	struct progress* p = (struct progress*)user_data;
+	++p->calls;
+	p->last = fraction;
+	return 0;
+}
+
+static int cancelEarly(double fraction, void* user_data) {
+	(void)user_data;
+	return fraction >= 0.1;
+}
+
+int main(void) {
+	tra_scene* scene = tra_scene_create();
+	CHECK(scene != NULL);
+	if (!scene) return 1;
+
+	const size_t vertexCounts[1] = {4};
+	const double vertices[12] = {-2, 0, 2, 2, 0, 2, 2, 4, 2, -2, 4, 2};
+	const double temperatures[1] = {84};
+	CHECK(tra_scene_add_emitters(scene, 1, vertexCounts, vertices, temperatures) == TRA_OK);
+	const double origin[3] = {-4, -1, 0}, u[3] = {8, 0, 0}, v[3] = {0, 6, 0}, normal[3] = {0, 0, 1};
+	CHECK(tra_scene_add_receiver_grid(scene, "grid", 20, 20, origin, u, v, normal) == TRA_OK);
+	const double points[6] = {0, 2, 0, 0, 2, 1}, normals[6] = {0, 0, 1, 0, 0, 1};
+	CHECK(tra_scene_add_receivers(scene, "points", 2, 1, 2, points, normals) == TRA_OK);
+	CHECK(tra_scene_add_receivers(scene, "points", 2, 1, 2, points, normals) == TRA_INVALID_ARGUMENT);
+	/* count must be width * height, and the scene stays within 2^24 points; both
+	 * are refused before the arrays are read */
+	CHECK(tra_scene_add_receivers(scene, "mismatch", 2, 2, 2, points, normals) == TRA_INVALID_ARGUMENT);
+	CHECK(tra_scene_add_receivers(scene, "huge", 4096, 4096, (size_t)4096 * 4096, points, normals) == TRA_INVALID_ARGUMENT);
+	tra_scene_set_rays(scene, 5000);
+	tra_scene_set_seed(scene, 1);
+
+	const size_t count = tra_scene_num_points(scene);
+	CHECK(count == 402);
+	double* values = (double*)malloc(count * sizeof(double));
+	double* scaled = (double*)malloc(count * sizeof(double));
+	CHECK(tra_solve(scene, values, count - 1, NULL, NULL) == TRA_BUFFER_TOO_SMALL);
+
+	struct progress p = {0, 0.0};
+	CHECK(tra_solve(scene, values, count, record, &p) == TRA_OK);
+	CHECK(p.calls > 0 && p.last == 1.0);
+	CHECK(values[count - 2] > 0.0 && values[count - 1] > 0.0);
+
+	/* Re-solving after new temperatures reuses the cached view factors */
+	const double doubled[1] = {168};
+	CHECK(tra_scene_set_temperatures(scene, 1, doubled) == TRA_OK);
+	CHECK(tra_solve(scene, scaled, count, NULL, NULL) == TRA_OK);
+	for (size_t k = 0; k < count; ++k) CHECK(fabs(scaled[k] - 2.0 * values[k]) <= 1e-12 * fabs(scaled[k]));
+
+	/* A new seed re-traces, so the callback runs and can cancel */
+	tra_scene_set_seed(scene, 2);
+	CHECK(tra_solve(scene, values, count, cancelEarly, NULL) == TRA_CANCELLED);
+	CHECK(tra_solve(scene, values, count, NULL, NULL) == TRA_OK);
+
+	tra_scene_cancel(scene);
+	CHECK(tra_solve(scene, values, count, NULL, NULL) == TRA_CANCELLED);
+	CHECK(tra_solve(scene, values, count, NULL, NULL) == TRA_OK);
+
+	free(scaled);
+	free(values);
+	tra_scene_destroy(scene);
+	if (g_failures > 0) fprintf(stderr, "%d check(s) failed\n", g_failures);
+	return g_failures > 0 ? 1 : 0;
+}
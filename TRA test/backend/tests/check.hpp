@@ -0,0 +1,43 @@
+#pragma once
+
+// Minimal checks for the engine tests: a failed CHECK prints its location and
+// the test's main returns checkResult(), non-zero after any failure
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+inline int g_checkFailures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			++g_checkFailures; \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(a, b, tol) \
+	do { \
+		const double checkA = (a), checkB = (b); \
+		if (!(std::fabs(checkA - checkB) <= (tol))) { \
+			std::fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %.10g vs %.10g (tolerance %.3g)\n", \
+			             __FILE__, __LINE__, #a, #b, checkA, checkB, static_cast<double>(tol)); \
+			++g_checkFailures; \
+		} \
+	} while (0)
+
+inline int checkResult() {
+	if (g_checkFailures > 0) std::fprintf(stderr, "%d check(s) failed\n", g_checkFailures);
+	return g_checkFailures > 0 ? 1 : 0;
+}
+
+// First number after "key": in a JSON response, or NaN if the key is missing
+inline double jsonNumber(std::string_view json, std::string_view key, size_t from = 0) {
+	const std::string needle = "\"" + std::string(key) + "\":";
+	const size_t at = json.find(needle, from);
+	if (at == std::string_view::npos) return std::nan("");
+	return std::strtod(std::string(json.substr(at + needle.size(), 32)).c_str(), nullptr);
+}
@@ -0,0 +1,77 @@
+// "exceedance" query: the marching-squares area matches the area above the
+// threshold on the full grid, and thresholds below or above every value give
+// the whole plane or nothing
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "engine/jobs.hpp"
+#include "engine/tra.hpp"
+
+static const char* kScene = R"({
+	"receiver_planes": {
+		"floor": {"width": 21, "height": 21, "origin": [-2, -2, 0], "u_axis": [4, 0, 0], "v_axis": [0, 4, 0], "normal": [0, 0, 1]}
+	},
+	"polygons": [{"polygon": [[-0.5, -0.5, 1], [0.5, -0.5, 1], [0.5, 0.5, 1], [-0.5, 0.5, 1]], "temperature": 100}],
+	"num_rays": 20000,
+	"seed": 7)";
+
+static std::string exceedance(double threshold, bool& ok) {
+	const std::string body = std::string(kScene) + ", \"query\": \"exceedance\", \"threshold\": " + std::to_string(threshold) + "}";
+	WireFormat wire;
+	JobReport job;
+	return runCalculation(body, wire, job, ok);
+}
+
+// Area above threshold of the bilinear surface through the grid values
+static double gridArea(const std::vector<double>& values, size_t w, size_t h, double planeArea, double threshold) {
+	const size_t sub = 16;
+	size_t above = 0, total = 0;
+	for (size_t j = 0; j + 1 < h; ++j) {
+		for (size_t i = 0; i + 1 < w; ++i) {
+			const double a = values[j * w + i], b = values[j * w + i + 1];
+			const double c = values[(j + 1) * w + i], d = values[(j + 1) * w + i + 1];
+			for (size_t sj = 0; sj < sub; ++sj) {
+				for (size_t si = 0; si < sub; ++si) {
+					const double x = (static_cast<double>(si) + 0.5) / sub, y = (static_cast<double>(sj) + 0.5) / sub;
+					const double v = (1 - x) * (1 - y) * a + x * (1 - y) * b + (1 - x) * y * c + x * y * d;
+					above += v > threshold ? 1 : 0;
+					++total;
+				}
+			}
+		}
+	}
+	return planeArea * static_cast<double>(above) / static_cast<double>(total);
+}
+
+int main() {
+	std::string error;
+	auto scene = tra::Scene::fromJson(std::string(kScene) + "}", error);
+	CHECK(scene.has_value());
+	if (!scene) return checkResult();
+	const tra::Results full = tra::solve(*scene);
+	CHECK(full.planes.size() == 1);
+	const std::vector<double>& values = full.planes[0].values;
+	const double lo = *std::min_element(values.begin(), values.end());
+	const double hi = *std::max_element(values.begin(), values.end());
+	const double planeArea = 16.0;
+
+	bool ok = false;
+	const double threshold = 0.5 * (lo + hi);
+	const std::string response = exceedance(threshold, ok);
+	CHECK(ok);
+	CHECK_NEAR(jsonNumber(response, "plane_area"), planeArea, 1e-9);
+	const double area = jsonNumber(response, "area");
+	CHECK(area > 0.0 && area < planeArea);
+	CHECK_NEAR(area, gridArea(values, 21, 21, planeArea, threshold), 0.03 * planeArea);
+	CHECK(response.find("\"regions\":[[[") != std::string::npos);
+
+	CHECK_NEAR(jsonNumber(exceedance(lo - 1.0, ok), "area"), planeArea, 1e-9);
+	CHECK(ok);
+	CHECK_NEAR(jsonNumber(exceedance(hi + 1.0, ok), "area"), 0.0, 1e-12);
+	CHECK(ok);
+
+	return checkResult();
+}
@@ -0,0 +1,54 @@
+// Inter-reflections: a receiver facing away from the emitter sees it only through
+// a reflective floor, a patch limit below the triangle count is refused rather
+// than searched for forever, and the engine itself stops at one patch per triangle
+
+#include <string>
+
+#include "check.hpp"
+#include "engine/calculation.hpp"
+#include "engine/jobs.hpp"
+
+// Receiver between an emitter above and a floor below, looking down at the floor
+static std::string scene(double reflectivity, const std::string& reflections) {
+	return R"({
+		"receiver_planes": {"p": {"width": 1, "height": 1, "points": [{"origin": [0, 0, 0.5], "normal": [0, 0, -1]}]}},
+		"polygons": [{"polygon": [[-0.5, -0.5, 1], [0.5, -0.5, 1], [0.5, 0.5, 1], [-0.5, 0.5, 1]], "temperature": 100}],
+		"inert_polygons": [{"polygon": [[-3, -3, 0], [3, -3, 0], [3, 3, 0], [-3, 3, 0]], "reflectivity": )" +
+		std::to_string(reflectivity) + R"(}],
+		"reflections": )" + reflections + R"(,
+		"num_rays": 4000,
+		"seed": 3})";
+}
+
+static CalculationResult compute(const std::string& body) {
+	JsonInput in;
+	std::string error;
+	const bool parsed = parseInputJson(body, in, error);
+	CHECK(parsed);
+	expandReceiverGrids(in);
+	return computeCalculation(in);
+}
+
+int main() {
+	const CalculationResult black = compute(scene(0.0, "{}"));
+	const CalculationResult reflective = compute(scene(0.5, R"({"rays_per_patch": 200, "patch_size": 1})"));
+	CHECK(black.planes.size() == 1 && reflective.planes.size() == 1);
+	CHECK(reflective.reflections.has_value());
+	if (black.planes.empty() || reflective.planes.empty() || !reflective.reflections) return checkResult();
+	CHECK(reflective.planes[0].values[0] > black.planes[0].values[0] + 1e-6);
+	CHECK(reflective.reflections->patches > 2 && reflective.reflections->patches <= 2000);
+
+	// The floor's two fan triangles cannot fit one patch
+	bool ok = true;
+	WireFormat wire;
+	JobReport job;
+	const std::string response = runCalculation(scene(0.5, R"({"max_patches": 1})"), wire, job, ok);
+	CHECK(!ok);
+	CHECK(response.find("max_patches") != std::string::npos);
+
+	// Scenes built without the request checks get one patch per triangle
+	const CalculationResult minimal = compute(scene(0.5, R"({"max_patches": 1, "rays_per_patch": 50})"));
+	CHECK(minimal.reflections.has_value() && minimal.reflections->patches == 2);
+
+	return checkResult();
+}
@@ -0,0 +1,57 @@
+// Variance-driven ray allocation: the budget of num_rays x points is spent,
+// noisy points get more rays than quiet ones, and "minmax" lowers the worst
+// standard error compared with spreading the same budget evenly
+
+#include <string>
+
+#include "check.hpp"
+#include "engine/calculation.hpp"
+
+// Points under the emitter's edge see it half the time (high variance); those
+// far out barely see it
+static const char* kScene = R"({
+	"receiver_planes": {
+		"floor": {"width": 12, "height": 4, "origin": [-3, -0.5, 0], "u_axis": [6, 0, 0], "v_axis": [0, 1, 0], "normal": [0, 0, 1]}
+	},
+	"polygons": [{"polygon": [[-3, -3, 0.5], [0, -3, 0.5], [0, 3, 0.5], [-3, 3, 0.5]], "temperature": 100}],
+	"num_rays": 4000,
+	"seed": 11,
+	)";
+
+static BudgetReport budgeted(const std::string& settings) {
+	JsonInput in;
+	std::string error;
+	const bool parsed = parseInputJson(std::string(kScene) + settings + "}", in, error);
+	CHECK(parsed);
+	expandReceiverGrids(in);
+	CalculationResult result = computeBudgetedCalculation(in);
+	CHECK(result.budget.has_value() && result.budget->planes.size() == 1);
+	return result.budget ? *result.budget : BudgetReport();
+}
+
+int main() {
+	const double budget = 4000.0 * 48.0;
+
+	const BudgetReport uniform = budgeted(R"("deadline_ms": 1e9)");
+	CHECK(uniform.objective == "uniform");
+	CHECK(uniform.complete);
+
+	const BudgetReport minmax = budgeted(R"("allocation": {"objective": "minmax"})");
+	CHECK(minmax.objective == "minmax");
+	CHECK(minmax.complete);
+	CHECK(minmax.totalRays <= budget);
+	CHECK_NEAR(minmax.totalRays, budget, 0.02 * budget);
+
+	const BudgetReport mean = budgeted(R"("allocation": {"objective": "mean", "phases": 2})");
+	CHECK(mean.objective == "mean" && mean.phases == 2);
+	CHECK_NEAR(mean.totalRays, budget, 0.02 * budget);
+
+	if (uniform.planes.empty() || minmax.planes.empty() || mean.planes.empty()) return checkResult();
+	CHECK(minmax.planes[0].minRays < minmax.planes[0].maxRays);
+	CHECK(minmax.planes[0].minRays >= minmax.pilotRays);
+	CHECK(minmax.planes[0].maxStdError < uniform.planes[0].maxStdError);
+	// Mean-error allocation spreads rays less unevenly than minmax
+	CHECK(mean.planes[0].maxRays <= minmax.planes[0].maxRays);
+
+	return checkResult();
+}
@@ -0,0 +1,77 @@
+// Separation search: lifting an emitter away from a row of receivers finds the
+// distance where the peak drops to the threshold, repeatably and within the rays
+// admission priced it at; a tolerance finer than the distance can resolve still
+// terminates, a cancelled job stops, and thresholds already met at min_distance
+// or never met by max_distance are refused
+
+#include <atomic>
+#include <cmath>
+#include <string>
+
+#include "check.hpp"
+#include "engine/jobs.hpp"
+#include "engine/parallel.hpp"
+
+static std::string request(double threshold, const std::string& tolerance, double maxDistance = 50.0) {
+	return R"({
+		"receiver_planes": {"row": {"width": 3, "height": 1, "points": [
+			{"origin": [0, 0, 0], "normal": [0, 0, 1]}, {"origin": [1, 0, 0], "normal": [0, 0, 1]}, {"origin": [2, 0, 0], "normal": [0, 0, 1]}]}},
+		"polygons": [{"polygon": [[-0.5, -0.5, 1], [0.5, -0.5, 1], [0.5, 0.5, 1], [-0.5, 0.5, 1]], "temperature": 100}],
+		"num_rays": 2000,
+		"seed": 9,
+		"search": {"threshold": )" + std::to_string(threshold) + R"(, "move": {"emitters": [0]}, "direction": [0, 0, 1],
+			"min_distance": 0, "max_distance": )" + std::to_string(maxDistance) + R"(, "initial_step": 0.5, "tolerance": )" + tolerance + "}}";
+}
+
+static std::string search(const std::string& body, bool& ok, JobReport& job) {
+	return runSeparationSearch(body, job, ok);
+}
+
+static std::string search(const std::string& body, bool& ok) {
+	JobReport job;
+	return search(body, ok, job);
+}
+
+// Rays actually traced, from the response's evaluation log
+static double tracedRays(const std::string& response) {
+	double traced = 0.0;
+	for (size_t at = response.find("\"evaluations\""); (at = response.find("\"rays\":", at)) != std::string::npos; ++at) {
+		traced += jsonNumber(response, "rays", at) * jsonNumber(response, "points", at);
+	}
+	return traced;
+}
+
+int main() {
+	bool ok = false;
+	JobReport job;
+	const std::string found = search(request(1.0, "0.01"), ok, job);
+	CHECK(ok);
+	CHECK(tracedRays(found) > 0.0 && tracedRays(found) <= job.estimate.tracedRays);
+	// Points are traced in parallel; the outcome must not depend on scheduling
+	CHECK(search(request(1.0, "0.01"), ok) == found);
+	const double distance = jsonNumber(found, "distance");
+	CHECK(distance > 0.5 && distance < 50.0);
+	CHECK(std::fabs(jsonNumber(found, "peak") - 1.0) < 0.25);
+
+	// 1e-300 is far below the spacing of doubles near the answer
+	const std::string fine = search(request(1.0, "1e-300"), ok);
+	CHECK(ok);
+	CHECK_NEAR(jsonNumber(fine, "distance"), distance, 0.05 * distance);
+
+	{
+		std::atomic<bool> cancel {true};
+		JobControl control(3, nullptr, &cancel);
+		ActiveJob active(&control);
+		JobReport cancelled;
+		const std::string response = search(request(1.0, "0.01"), ok, cancelled);
+		CHECK(!ok && cancelled.status == 503 && response.find("cancelled") != std::string::npos);
+	}
+
+	// Already below at min_distance, and still above at a max_distance short of the answer
+	const std::string below = search(request(1000.0, "0.01"), ok);
+	CHECK(!ok && below.find("min_distance") != std::string::npos);
+	const std::string above = search(request(1.0, "0.01", 0.5 * distance), ok);
+	CHECK(!ok && above.find("max_distance") != std::string::npos);
+
+	return checkResult();
+}
@@ -0,0 +1,73 @@
+// Temperature fields: a wall with a linear vertical field matches a stack of
+// thin uniform slices (same rays, so only the slice discretisation differs), a
+// constant field matches a plain emitter, and grids whose size is not a sane
+// whole number are refused
+
+#include <cmath>
+#include <string>
+
+#include "check.hpp"
+#include "engine/tra.hpp"
+
+static const char* kReceivers = R"("receiver_planes": {
+		"row": {"width": 5, "height": 1, "points": [
+			{"origin": [0, 0.2, 0], "normal": [0, 0, 1]}, {"origin": [0, 0.6, 0], "normal": [0, 0, 1]},
+			{"origin": [0, 1.0, 0], "normal": [0, 0, 1]}, {"origin": [0.5, 1.4, 0], "normal": [0, 0, 1]},
+			{"origin": [-0.5, 1.8, 0], "normal": [0, 0, 1]}]}
+	},
+	"num_rays": 20000,
+	"seed": 5)";
+
+static constexpr int kSlices = 20;
+static constexpr double kHeight = 2.0;
+
+// Wall in z = 1 over x in [-1, 1] and y in [y0, y1]
+static std::string wall(double y0, double y1, const std::string& temperature) {
+	return "{\"polygon\": [[-1, " + std::to_string(y0) + ", 1], [1, " + std::to_string(y0) + ", 1], [1, " + std::to_string(y1) +
+		", 1], [-1, " + std::to_string(y1) + ", 1]], " + temperature + "}";
+}
+
+static std::vector<double> solve(const std::string& polygons) {
+	std::string error;
+	auto scene = tra::Scene::fromJson("{" + std::string(kReceivers) + ", \"polygons\": [" + polygons + "]}", error);
+	CHECK(scene.has_value());
+	if (!scene) return {};
+	const tra::Results results = tra::solve(*scene);
+	return results.planes.empty() ? std::vector<double>() : results.planes[0].values;
+}
+
+int main() {
+	// T(y) = 100 + 100 y, held by samples at both ends of the wall
+	const std::vector<double> field = solve(wall(0.0, kHeight, "\"temperature\": 0, \"temperature_field\": {\"vertical\": {\"heights\": [0, 2], \"values\": [100, 300]}}"));
+	std::string slices;
+	for (int k = 0; k < kSlices; ++k) {
+		const double y0 = kHeight * k / kSlices, y1 = kHeight * (k + 1) / kSlices;
+		if (k > 0) slices += ",";
+		slices += wall(y0, y1, "\"temperature\": " + std::to_string(100.0 + 50.0 * (y0 + y1)));
+	}
+	const std::vector<double> stacked = solve(slices);
+	const std::vector<double> viewFactor = solve(wall(0.0, kHeight, "\"temperature\": 1"));
+
+	CHECK(field.size() == 5 && stacked.size() == 5 && viewFactor.size() == 5);
+	for (size_t k = 0; k < field.size() && k < stacked.size() && k < viewFactor.size(); ++k) {
+		CHECK(field[k] > 0.0);
+		// Each hit differs by at most half a slice of the gradient
+		CHECK_NEAR(field[k], stacked[k], 100.0 * (kHeight / kSlices) / 2.0 * viewFactor[k] + 1e-9);
+	}
+
+	const std::vector<double> constant = solve(wall(0.0, kHeight, "\"temperature\": 0, \"temperature_field\": {\"grid\": {\"width\": 2, \"height\": 2, \"values\": [150, 150, 150, 150]}}"));
+	const std::vector<double> plain = solve(wall(0.0, kHeight, "\"temperature\": 150"));
+	CHECK(constant.size() == plain.size());
+	for (size_t k = 0; k < constant.size() && k < plain.size(); ++k) CHECK_NEAR(constant[k], plain[k], 1e-9 * plain[k]);
+
+	// 2^32 x 2^32 used to wrap to zero samples and accept an empty array
+	for (const char* grid : {R"("width": 4294967296, "height": 4294967296, "values": [])", R"("width": 1e300, "height": 1, "values": [1])",
+	                         R"("width": 1.5, "height": 2, "values": [1, 2, 3])", R"("width": 0, "height": 1, "values": [])"}) {
+		std::string error;
+		auto scene = tra::Scene::fromJson("{" + std::string(kReceivers) + ", \"polygons\": [" +
+			wall(0.0, kHeight, "\"temperature_field\": {\"grid\": {" + std::string(grid) + "}}") + "]}", error);
+		CHECK(!scene.has_value() && !error.empty());
+	}
+
+	return checkResult();
+}
@@ -1,7 +1,7 @@
 @echo off
 REM Thermal Radiation Analysis System - Windows Control Script
 REM Usage: run.bat [command]
-REM Commands: setup, start, stop, restart, status, test
+REM Commands: setup, start, stop, restart, status, test, bench
 
 setlocal EnableDelayedExpansion
 
@@ -21,6 +21,7 @@ if /i "%1"=="stop" goto :stop
 if /i "%1"=="restart" goto :restart
 if /i "%1"=="status" goto :status
 if /i "%1"=="test" goto :test
+if /i "%1"=="bench" goto :bench
 if /i "%1"=="help" goto :usage
 if /i "%1"=="--help" goto :usage
 if /i "%1"=="-h" goto :usage
@@ -58,7 +59,7 @@ if not exist "bin" mkdir bin
 REM Try g++ first (MinGW)
 where g++ >nul 2>&1
 if %errorlevel%==0 (
-    g++ -std=c++17 -O2 -o %BACKEND_BINARY% backend\server.cpp -I backend -lpthread
+    g++ -std=c++17 -O2 -o %BACKEND_BINARY% backend\server.cpp backend\engine\*.cpp -I backend -lpthread -lws2_32
     if errorlevel 1 (
         echo [91mERROR: Failed to compile server with g++[0m
         echo.
@@ -67,6 +68,8 @@ if %errorlevel%==0 (
         exit /b 1
     )
     echo [92mSUCCESS: Server compiled successfully[0m
+    g++ -std=c++17 -O2 -o bin\calcus.exe backend\calcus.cpp backend\engine\*.cpp -I backend -lpthread
+    g++ -std=c++17 -O2 -o bin\bench.exe backend\bench.cpp backend\engine\*.cpp -I backend -lpthread
     echo.
     echo [92mSetup complete! Run 'run.bat start' to begin[0m
     goto :eof
@@ -411,6 +414,24 @@ powershell -Command "try { $response = Invoke-WebRequest -Uri 'http://localhost:
 echo.
 goto :eof
 
+REM ============================================
+REM Benchmarks
+REM ============================================
+:bench
+echo ==========================================
+echo Benchmarks
+echo ==========================================
+echo.
+if not exist "bin\bench.exe" (
+    echo [91mERROR: Benchmarks not compiled. Run 'run.bat setup' first[0m
+    exit /b 1
+)
+set BENCH_MB=%2
+if "%BENCH_MB%"=="" set BENCH_MB=50
+echo Engine benchmarks (%BENCH_MB% MB parse payload)...
+bin\bench.exe %BENCH_MB%
+goto :eof
+
 REM ============================================
 REM Usage
 REM ============================================
@@ -427,6 +448,7 @@ echo   stop       Stop all servers
 echo   restart    Restart all servers
 echo   status     Check if servers are running
 echo   test       Test server endpoints
+echo   bench [MB] Run backend benchmarks (default 50 MB payload)
 echo   help       Show this help message
 echo.
 echo Examples:
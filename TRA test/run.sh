@@ -2,7 +2,7 @@
 
 # Thermal Radiation Analysis System - Master Control Script
 # Usage: ./run.sh [command]
-# Commands: setup, start, stop, restart, status, test
+# Commands: setup, start, stop, restart, status, test, bench
 
 BACKEND_PORT=8080
 FRONTEND_PORT=3000
@@ -50,9 +50,18 @@ setup() {
         print_success "cpp-httplib already present"
     fi
     
-    # Compile the server
+    # Compile the engine library, the server, the calcus CLI and the benchmarks
     echo "Compiling server..."
-    g++ -std=c++17 -O2 -o bin/server backend/server.cpp -I backend -lpthread
+    mkdir -p bin
+    if command -v cmake >/dev/null 2>&1; then
+        cmake -S backend -B bin/cmake -DCMAKE_BUILD_TYPE=Release -DCMAKE_RUNTIME_OUTPUT_DIRECTORY="$PWD/bin" \
+            && cmake --build bin/cmake --target server calcus bench
+    else
+        ENGINE_SOURCES=$(ls backend/engine/*.cpp)
+        g++ -std=c++17 -O2 -o bin/server backend/server.cpp $ENGINE_SOURCES -I backend -lpthread \
+            && g++ -std=c++17 -O2 -o bin/calcus backend/calcus.cpp $ENGINE_SOURCES -I backend -lpthread \
+            && g++ -std=c++17 -O2 -o bin/bench backend/bench.cpp $ENGINE_SOURCES -I backend -lpthread
+    fi
     
     if [ $? -eq 0 ]; then
         print_success "Server compiled successfully"
@@ -243,6 +252,19 @@ test_system() {
     echo
 }
 
+# Benchmarks
+bench() {
+    print_header "Benchmarks"
+
+    if [ ! -f "bin/bench" ]; then
+        print_error "Benchmarks not compiled. Run './run.sh setup' first"
+        return 1
+    fi
+
+    echo "Engine benchmarks (${1:-50} MB parse payload)..."
+    ./bin/bench ${1:-50}
+}
+
 # Show usage
 usage() {
     echo "Thermal Radiation Analysis System - Control Script"
@@ -256,6 +278,7 @@ usage() {
     echo "  restart    Restart all servers"
     echo "  status     Check if servers are running"
     echo "  test       Test server endpoints"
+    echo "  bench [MB] Run backend benchmarks (default 50 MB payload)"
     echo "  help       Show this help message"
     echo
     echo "Examples:"
@@ -286,6 +309,9 @@ case "${1:-}" in
     test)
         test_system
         ;;
+    bench)
+        bench "$2"
+        ;;
     help|--help|-h)
         usage
         ;;